@@ -6,7 +6,10 @@
 #include <stdexcept>
 #include <cstdint>
 #include <algorithm>
+#include <string>
 #include "glad.h"
+#include "Core/GLState.h"
+#include "Texture/ScopTex.h"
 
 class BMPLoader {
 private:
@@ -44,102 +47,144 @@ private:
     };
 
 public:
+    // Header fields needed to decode any part of the pixel array
+    struct BMPInfo {
+        int width;              // Image width
+        int height;             // Image height
+        int bytes_per_pixel;    // 3 (BGR) or 4 (BGRA)
+        uint32_t offset_data;   // Offset to image data in bytes
+        size_t row_stride;      // Bytes per stored row, padding included
+    };
+
     /**
-     * Load BMP file and prepare for OpenGL texture
+     * Read and validate the headers of an opened BMP file
      * 
-     * @param filename Path to BMP file
-     * @param width Output width of image
-     * @param height Output height of image
-     * @return Vector of decoded image data in RGBA
+     * @param file BMP file opened in binary mode
+     * @param filename Path used in error messages
+     * @return Layout of the pixel array
      */
-    static std::vector<uint8_t> loadBMP(const std::string& filename, int& width, int& height) {
-        // Open file in binary mode
-        std::ifstream file(filename, std::ios::binary);
-        if (!file) {
-            throw std::runtime_error("Could not open BMP file: " + filename);
-        }
-
+    static BMPInfo readBMPInfo(std::ifstream& file, const std::string& filename) {
         // Read file header
         BMPFileHeader file_header;
         file.read(reinterpret_cast<char*>(&file_header), sizeof(BMPFileHeader));
         
         // Validate BMP signature
-        if (file_header.file_type != 0x4D42) {
-            throw std::runtime_error("Invalid BMP file: Incorrect signature");
+        if (!file || file_header.file_type != 0x4D42) {
+            throw std::runtime_error("Invalid BMP file: Incorrect signature: " + filename);
         }
 
         // Read info header
         BMPInfoHeader info_header;
         file.read(reinterpret_cast<char*>(&info_header), sizeof(BMPInfoHeader));
 
-        // Set output dimensions
-        width = std::abs(info_header.width);
-        height = std::abs(info_header.height);
-
         // Check compression and bit depth
         if (info_header.compression != static_cast<uint32_t>(Compression::BI_RGB)) {
             throw std::runtime_error("Compressed BMPs are not supported");
         }
+        if (info_header.bit_count != 24 && info_header.bit_count != 32) {
+            throw std::runtime_error("Unsupported BMP bit depth");
+        }
 
-        // Determine bytes per pixel and padding
-        int bytes_per_pixel = info_header.bit_count / 8;
-        int padding = (4 - (width * bytes_per_pixel) % 4) % 4;
-
-        // Seek to image data
-        file.seekg(file_header.offset_data);
-
-        // Read pixel data
-        std::vector<uint8_t> pixel_data(width * height * bytes_per_pixel);
-        std::vector<uint8_t> rgba_data(width * height * 4);
-
-        // Read rows in reverse order (BMPs are stored bottom-up)
-        for (int y = height - 1; y >= 0; --y) {
-            // Read a row of pixels
-            file.read(reinterpret_cast<char*>(pixel_data.data() + y * width * bytes_per_pixel), 
-                      width * bytes_per_pixel);
-            
-            // Skip padding bytes
-            file.seekg(padding, std::ios_base::cur);
+        BMPInfo info;
+        info.width = std::abs(info_header.width);
+        info.height = std::abs(info_header.height);
+        info.bytes_per_pixel = info_header.bit_count / 8;
+        info.offset_data = file_header.offset_data;
+        // Rows are padded to a multiple of 4 bytes
+        info.row_stride = (static_cast<size_t>(info.width) * info.bytes_per_pixel + 3) & ~static_cast<size_t>(3);
+        return info;
+    }
+
+    /**
+     * Decode a rectangle of the image to RGBA without reading the rest of
+     * the file. Row 0 is the last row stored in the file, matching loadBMP.
+     * 
+     * @param file BMP file whose headers were read with readBMPInfo
+     * @param info Layout returned by readBMPInfo
+     * @param x, y Top left corner of the rectangle
+     * @param w, h Size of the rectangle
+     * @param dst Destination of the RGBA texels
+     * @param dst_stride Bytes between destination rows
+     */
+    static void readBMPRegion(std::ifstream& file, const BMPInfo& info, int x, int y, int w, int h,
+                              uint8_t* dst, size_t dst_stride) {
+        if (x < 0 || y < 0 || w < 0 || h < 0 || x + w > info.width || y + h > info.height) {
+            throw std::runtime_error("BMP region out of bounds");
         }
+        size_t row_bytes = static_cast<size_t>(w) * info.bytes_per_pixel;
+        std::vector<uint8_t> pixel_data(row_bytes);
+
+        for (int row = 0; row < h; ++row) {
+            // BMPs are stored bottom-up
+            size_t file_row = static_cast<size_t>(info.height - 1 - (y + row));
+            file.seekg(info.offset_data + file_row * info.row_stride
+                       + static_cast<size_t>(x) * info.bytes_per_pixel);
+            file.read(reinterpret_cast<char*>(pixel_data.data()), row_bytes);
+            if (!file) {
+                throw std::runtime_error("Truncated BMP pixel data");
+            }
 
-        // Convert to RGBA
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                size_t src_idx = (y * width + x) * bytes_per_pixel;
-                size_t dst_idx = (y * width + x) * 4;
-
-                if (bytes_per_pixel == 3) {  // BGR format
-                    rgba_data[dst_idx + 0] = pixel_data[src_idx + 2];  // R
-                    rgba_data[dst_idx + 1] = pixel_data[src_idx + 1];  // G
-                    rgba_data[dst_idx + 2] = pixel_data[src_idx + 0];  // B
-                    rgba_data[dst_idx + 3] = 255;                      // A
-                }
-                else if (bytes_per_pixel == 4) {  // BGRA format
-                    rgba_data[dst_idx + 0] = pixel_data[src_idx + 2];  // R
-                    rgba_data[dst_idx + 1] = pixel_data[src_idx + 1];  // G
-                    rgba_data[dst_idx + 2] = pixel_data[src_idx + 0];  // B
-                    rgba_data[dst_idx + 3] = pixel_data[src_idx + 3];  // A
-                }
-                else {
-                    throw std::runtime_error("Unsupported BMP bit depth");
-                }
+            // Convert to RGBA
+            uint8_t* out = dst + row * dst_stride;
+            for (int px = 0; px < w; ++px) {
+                const uint8_t* in = &pixel_data[static_cast<size_t>(px) * info.bytes_per_pixel];
+                out[px * 4 + 0] = in[2];                                        // R
+                out[px * 4 + 1] = in[1];                                        // G
+                out[px * 4 + 2] = in[0];                                        // B
+                out[px * 4 + 3] = info.bytes_per_pixel == 4 ? in[3] : 255;     // A
             }
         }
+    }
 
+    /**
+     * Load BMP file and prepare for OpenGL texture
+     * 
+     * @param filename Path to BMP file
+     * @param width Output width of image
+     * @param height Output height of image
+     * @return Vector of decoded image data in RGBA
+     */
+    static std::vector<uint8_t> loadBMP(const std::string& filename, int& width, int& height) {
+        // Open file in binary mode
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Could not open BMP file: " + filename);
+        }
+
+        BMPInfo info = readBMPInfo(file, filename);
+
+        // Set output dimensions
+        width = info.width;
+        height = info.height;
+
+        std::vector<uint8_t> rgba_data(static_cast<size_t>(width) * height * 4);
+        readBMPRegion(file, info, 0, 0, width, height, rgba_data.data(), static_cast<size_t>(width) * 4);
         return rgba_data;
     }
 
     /**
      * Load BMP directly into OpenGL texture
      * 
+     * The decoded image is written once to a .scoptex container in the
+     * cache directory; while the source file is unchanged, later loads map
+     * that container and upload from the mapping without decoding.
+     * 
      * @param filename Path to BMP file
      * @param textureID OpenGL texture ID to bind
      */
     static void loadBMPTexture(const std::string& filename, GLuint textureID) {
+        std::string cachePath = ScopTex::cachePathForSource(filename);
+        ScopTex::Mapping mapping;
+        if (mapping.open(cachePath) && mapping.matchesSource(filename)
+            && ScopTex::upload(mapping, textureID)) {
+            return;
+        }
+        mapping.close();
+
         int width, height;
         std::vector<uint8_t> imageData = loadBMP(filename, width, height);
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::bindTexture(GL_TEXTURE_2D, textureID);
         
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -157,6 +202,13 @@ public:
             GL_UNSIGNED_BYTE,   // Data type of the pixel data
             imageData.data()    // Pointer to image data
         );
+
+        std::vector<ScopTex::Level> levels(1);
+        levels[0].width = width;
+        levels[0].height = height;
+        levels[0].data = imageData.data();
+        levels[0].size = imageData.size();
+        ScopTex::write(cachePath, ScopTex::Format::RGBA8, width, height, levels, filename);
     }
 };
 
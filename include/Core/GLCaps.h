@@ -0,0 +1,51 @@
+#ifndef GLCAPS_H
+# define GLCAPS_H
+
+# include "glad.h"
+
+# include <string>
+# include <vector>
+
+// queries about the current context; all calls need a current GL context
+class GLCaps {
+public:
+    static bool hasExtension(const std::string &name)
+    {
+        const std::vector<std::string> &list = extensions();
+        for (size_t i = 0; i < list.size(); ++i)
+            if (list[i] == name)
+                return true;
+        return false;
+    }
+
+    static bool hasVersion(int major, int minor)
+    {
+        GLint ctxMajor = 0, ctxMinor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &ctxMajor);
+        glGetIntegerv(GL_MINOR_VERSION, &ctxMinor);
+        return ctxMajor > major || (ctxMajor == major && ctxMinor >= minor);
+    }
+
+private:
+    // enumerated once, the extension list does not change for a context
+    static const std::vector<std::string> &extensions()
+    {
+        static std::vector<std::string> list;
+        static bool loaded = false;
+        if (!loaded)
+        {
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; ++i)
+            {
+                const GLubyte *ext = glGetStringi(GL_EXTENSIONS, i);
+                if (ext)
+                    list.push_back(reinterpret_cast<const char*>(ext));
+            }
+            loaded = true;
+        }
+        return list;
+    }
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef GLSTATE_H
+# define GLSTATE_H
+
+# include "glad.h"
+
+# include <cstddef>
+# include <string>
+
+// Shadow of the bind and render state of the (single) GL context. Every
+// setter compares against the last value it set and skips the GL call when
+// nothing would change. Engine code goes through here instead of calling
+// glUseProgram / glBindVertexArray / glBindBuffer / glBindTexture / glEnable
+// directly; code that must call GL itself afterwards calls invalidate().
+//
+// Deleting through the delete* wrappers matters: GL reuses names, so a
+// cached binding of a deleted object would filter the bind of a new one.
+class GLState {
+public:
+    struct Stats {
+        size_t issued;      // GL calls made
+        size_t filtered;    // calls dropped as redundant
+    };
+
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint vao);
+    static void bindBuffer(GLenum target, GLuint buffer);
+    // indexed binding (GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER); also
+    // sets the generic binding of target, as GL does
+    static void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    static void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    static void activeTexture(unsigned unit);
+    // binds on the active unit
+    static void bindTexture(GLenum target, GLuint texture);
+    static void bindTexture(unsigned unit, GLenum target, GLuint texture);
+
+    static void setBlend(bool enabled);
+    static void blendFunc(GLenum source, GLenum destination);
+    static void setDepthTest(bool enabled);
+    static void depthFunc(GLenum func);
+    static void depthMask(bool write);
+
+    static void deleteProgram(GLuint program);
+    static void deleteVertexArrays(GLsizei count, const GLuint *vaos);
+    static void deleteBuffers(GLsizei count, const GLuint *buffers);
+    static void deleteTextures(GLsizei count, const GLuint *textures);
+
+    // forget everything, the next call of each kind is always issued
+    static void invalidate();
+
+    // call once per frame; frameStats() then refers to the finished frame
+    static void beginFrame();
+    static Stats frameStats();
+    static Stats currentStats();
+    // "GL calls: N issued, M filtered (P%)" for the finished frame
+    static std::string report();
+};
+
+#endif
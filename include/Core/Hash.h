@@ -0,0 +1,70 @@
+#ifndef HASH_H
+# define HASH_H
+
+# include <cstdint>
+# include <cstddef>
+# include <string>
+# include <fstream>
+# include <stdexcept>
+
+class Hash {
+public:
+    static const uint64_t FNV64_OFFSET = 14695981039346656037ULL;
+    static const uint64_t FNV64_PRIME = 1099511628211ULL;
+
+    // 64-bit FNV-1a over a byte range, chainable through seed
+    static uint64_t fnv1a64(const void *data, size_t size, uint64_t seed = FNV64_OFFSET)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t*>(data);
+        uint64_t hash = seed;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= FNV64_PRIME;
+        }
+        return hash;
+    }
+
+    static uint64_t fnv1a64(const std::string &str, uint64_t seed = FNV64_OFFSET)
+    {
+        return fnv1a64(str.data(), str.size(), seed);
+    }
+
+    // 32-bit FNV-1a, evaluable at compile time for string literals
+    static constexpr uint32_t fnv1a32(const char *str, uint32_t hash = 2166136261u)
+    {
+        return *str ? fnv1a32(str + 1, (hash ^ static_cast<uint32_t>(static_cast<uint8_t>(*str))) * 16777619u)
+                    : hash;
+    }
+
+    // hash of a whole file's contents
+    static uint64_t hashFile(const std::string &filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file)
+            throw std::runtime_error("Could not open file for hashing: " + filename);
+        uint64_t hash = FNV64_OFFSET;
+        char buffer[64 * 1024];
+        while (file)
+        {
+            file.read(buffer, sizeof(buffer));
+            hash = fnv1a64(buffer, static_cast<size_t>(file.gcount()), hash);
+        }
+        return hash;
+    }
+
+    // fixed-width hex, used to build cache file names
+    static std::string toHex(uint64_t value)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string out(16, '0');
+        for (int i = 15; i >= 0; --i)
+        {
+            out[i] = digits[value & 0xF];
+            value >>= 4;
+        }
+        return out;
+    }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef JOB_SYSTEM_H
+# define JOB_SYSTEM_H
+
+# include <atomic>
+# include <condition_variable>
+# include <cstddef>
+# include <exception>
+# include <functional>
+# include <mutex>
+# include <thread>
+# include <vector>
+
+// Persistent worker threads for data-parallel loops, started on first use
+// so per-frame work does not pay for creating threads. One job runs at a
+// time: run() called from inside a job, or while another thread's job is
+// in flight, executes its chunks on the calling thread instead.
+class JobSystem {
+public:
+    static JobSystem &instance();
+
+    // threads taking part in a job, the caller included
+    unsigned threadCount() const;
+
+    // calls fn(chunk) for every chunk in [0, chunks); the calling thread
+    // takes chunks too and returns once all are done. The first exception
+    // thrown by a chunk is rethrown here.
+    void run(size_t chunks, const std::function<void(size_t)> &fn);
+
+private:
+    JobSystem();
+    ~JobSystem();
+    JobSystem(const JobSystem &);
+    JobSystem &operator=(const JobSystem &);
+
+    void workerLoop();
+    // takes chunks of the current job until none are left
+    void work();
+
+    std::vector<std::thread> workers;
+    std::mutex submitMutex;         // held for the whole of a job
+
+    std::mutex mutex;
+    std::condition_variable wakeWorkers;
+    std::condition_variable jobDone;
+    const std::function<void(size_t)> *job;
+    size_t jobChunks;
+    std::atomic<size_t> nextChunk;
+    size_t finishedChunks;
+    unsigned busyWorkers;
+    unsigned long generation;
+    std::exception_ptr error;
+    bool stop;
+};
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef MATH_H
+# define MATH_H
+
+# include <cmath>
+
+struct Vec3 {
+    float x;
+    float y;
+    float z;
+
+    Vec3() : x(0.0f), y(0.0f), z(0.0f) {}
+    Vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+    Vec3 operator+(const Vec3 &o) const { return Vec3(x + o.x, y + o.y, z + o.z); }
+    Vec3 operator-(const Vec3 &o) const { return Vec3(x - o.x, y - o.y, z - o.z); }
+    Vec3 operator*(float s) const { return Vec3(x * s, y * s, z * s); }
+    Vec3 &operator+=(const Vec3 &o) { x += o.x; y += o.y; z += o.z; return *this; }
+    float operator[](int i) const { return i == 0 ? x : (i == 1 ? y : z); }
+
+    static float dot(const Vec3 &a, const Vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    static Vec3 cross(const Vec3 &a, const Vec3 &b)
+    {
+        return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+    }
+    static Vec3 min(const Vec3 &a, const Vec3 &b)
+    {
+        return Vec3(a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z);
+    }
+    static Vec3 max(const Vec3 &a, const Vec3 &b)
+    {
+        return Vec3(a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z);
+    }
+    float length() const { return std::sqrt(dot(*this, *this)); }
+    Vec3 normalized() const
+    {
+        float len = length();
+        return len > 0.0f ? *this * (1.0f / len) : *this;
+    }
+};
+
+// std140 vec4, also used as plane (xyz normal, w distance)
+struct Vec4 {
+    float x;
+    float y;
+    float z;
+    float w;
+
+    Vec4() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
+    Vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+    Vec4(const Vec3 &v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+};
+
+// axis-aligned box, empty (min > max) until something is added
+struct AABB {
+    Vec3 min;
+    Vec3 max;
+
+    AABB() : min(HUGE_VALF, HUGE_VALF, HUGE_VALF), max(-HUGE_VALF, -HUGE_VALF, -HUGE_VALF) {}
+    AABB(const Vec3 &min, const Vec3 &max) : min(min), max(max) {}
+
+    void grow(const Vec3 &p) { min = Vec3::min(min, p); max = Vec3::max(max, p); }
+    void grow(const AABB &b) { min = Vec3::min(min, b.min); max = Vec3::max(max, b.max); }
+    Vec3 center() const { return (min + max) * 0.5f; }
+    Vec3 extents() const { return (max - min) * 0.5f; }
+    // half the surface area, all the SAH needs
+    float halfArea() const
+    {
+        Vec3 d = max - min;
+        return d.x < 0.0f ? 0.0f : d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+};
+
+// column-major like GLSL: m[column * 4 + row], uploads without transposing
+struct Mat4 {
+    float m[16];
+
+    Mat4() { *this = identity(); }
+
+    float &at(int row, int column) { return m[column * 4 + row]; }
+    float at(int row, int column) const { return m[column * 4 + row]; }
+    const float *data() const { return m; }
+
+    static Mat4 identity()
+    {
+        Mat4 r(0.0f);
+        r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0f;
+        return r;
+    }
+
+    static Mat4 translate(const Vec3 &t)
+    {
+        Mat4 r = identity();
+        r.m[12] = t.x;
+        r.m[13] = t.y;
+        r.m[14] = t.z;
+        return r;
+    }
+
+    static Mat4 scale(const Vec3 &s)
+    {
+        Mat4 r = identity();
+        r.m[0] = s.x;
+        r.m[5] = s.y;
+        r.m[10] = s.z;
+        return r;
+    }
+
+    static Mat4 rotateY(float radians)
+    {
+        Mat4 r = identity();
+        float c = std::cos(radians), s = std::sin(radians);
+        r.m[0] = c;
+        r.m[2] = -s;
+        r.m[8] = s;
+        r.m[10] = c;
+        return r;
+    }
+
+    // right handed, depth to [-1, 1] like gluPerspective
+    static Mat4 perspective(float fovyRadians, float aspect, float zNear, float zFar)
+    {
+        Mat4 r(0.0f);
+        float f = 1.0f / std::tan(fovyRadians * 0.5f);
+        r.m[0] = f / aspect;
+        r.m[5] = f;
+        r.m[10] = (zFar + zNear) / (zNear - zFar);
+        r.m[11] = -1.0f;
+        r.m[14] = 2.0f * zFar * zNear / (zNear - zFar);
+        return r;
+    }
+
+    static Mat4 lookAt(const Vec3 &eye, const Vec3 &center, const Vec3 &up)
+    {
+        Vec3 f = (center - eye).normalized();
+        Vec3 s = Vec3::cross(f, up).normalized();
+        Vec3 u = Vec3::cross(s, f);
+        Mat4 r = identity();
+        r.at(0, 0) = s.x; r.at(0, 1) = s.y; r.at(0, 2) = s.z;
+        r.at(1, 0) = u.x; r.at(1, 1) = u.y; r.at(1, 2) = u.z;
+        r.at(2, 0) = -f.x; r.at(2, 1) = -f.y; r.at(2, 2) = -f.z;
+        r.at(0, 3) = -Vec3::dot(s, eye);
+        r.at(1, 3) = -Vec3::dot(u, eye);
+        r.at(2, 3) = Vec3::dot(f, eye);
+        return r;
+    }
+
+    Mat4 operator*(const Mat4 &o) const
+    {
+        Mat4 r(0.0f);
+        for (int c = 0; c < 4; ++c)
+            for (int row = 0; row < 4; ++row)
+            {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; ++k)
+                    sum += at(row, k) * o.at(k, c);
+                r.at(row, c) = sum;
+            }
+        return r;
+    }
+
+    Vec3 transformPoint(const Vec3 &p) const
+    {
+        return Vec3(m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+                    m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+                    m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]);
+    }
+
+private:
+    explicit Mat4(float fill)
+    {
+        for (int i = 0; i < 16; ++i)
+            m[i] = fill;
+    }
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef PARALLEL_H
+# define PARALLEL_H
+
+# include "Core/JobSystem.h"
+
+# include <cstddef>
+
+class Parallel {
+public:
+    static unsigned workerCount()
+    {
+        return JobSystem::instance().threadCount();
+    }
+
+    // number of chunks forChunks() will split count items into
+    static size_t chunkCount(size_t count, size_t minChunk)
+    {
+        if (minChunk == 0)
+            minChunk = 1;
+        size_t chunks = (count + minChunk - 1) / minChunk;
+        if (chunks > workerCount())
+            chunks = workerCount();
+        return chunks ? chunks : 1;
+    }
+
+    // calls fn(chunk, begin, end) over [0, count) split into contiguous chunks,
+    // one per core, on the JobSystem's threads; the calling thread takes
+    // chunks too. The first exception thrown by any chunk is rethrown here.
+    template <typename Fn>
+    static void forChunks(size_t count, size_t minChunk, Fn fn)
+    {
+        size_t chunks = chunkCount(count, minChunk);
+        if (chunks <= 1)
+        {
+            fn(static_cast<size_t>(0), static_cast<size_t>(0), count);
+            return;
+        }
+        size_t step = (count + chunks - 1) / chunks;
+        JobSystem::instance().run(chunks, [&fn, step, count](size_t c) {
+            size_t begin = c * step < count ? c * step : count;
+            size_t end = begin + step < count ? begin + step : count;
+            fn(c, begin, end);
+        });
+    }
+};
+
+#endif
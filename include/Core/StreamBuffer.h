@@ -0,0 +1,79 @@
+#ifndef STREAM_BUFFER_H
+# define STREAM_BUFFER_H
+
+# include "glad.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <string>
+# include <vector>
+
+// One buffer for everything rewritten every frame: uniforms, instance
+// data, indirect commands, dynamic geometry. It is split into frame
+// regions used in turn; allocations bump a pointer through the current
+// region and a fence placed at the end of the frame guards it, so the CPU
+// only blocks when it laps the GPU, and never re-specifies storage.
+//
+// With GL 4.4 / ARB_buffer_storage the buffer is mapped once, persistently
+// and coherently, and allocations are written in place. Otherwise they are
+// written to a CPU copy that commit() sends with glBufferSubData.
+//
+// Per frame: beginFrame(); allocate() / write / commit() ...; draw; endFrame().
+// Allocations are only valid until the next beginFrame().
+class StreamBuffer {
+public:
+    struct Allocation {
+        void *data;         // write pointer, NULL for an empty allocation
+        GLuint buffer;
+        GLintptr offset;    // from the start of the buffer
+        GLsizeiptr size;
+    };
+
+    StreamBuffer(size_t regionSize, int frames = 3);
+    ~StreamBuffer();
+
+    // moves to the next region, waiting for the GPU if it still reads it
+    void beginFrame();
+    // fences the current region after the frame's draws
+    void endFrame();
+
+    // size bytes at an offset multiple of alignment (any value, not only
+    // powers of two: offsets of InstanceData arrays may need 80);
+    // throws when the region is exhausted
+    Allocation allocate(size_t size, size_t alignment = 16);
+    // makes bytes written to an allocation visible to the GPU
+    void commit(const Allocation &allocation, size_t bytes);
+    void commit(const Allocation &allocation);
+
+    GLuint buffer() const;
+    size_t regionSize() const;
+    // all regions
+    size_t size() const;
+    size_t used() const;
+    bool isPersistent() const;
+    // counts beginFrame() calls, allocations of an older frame are stale
+    uint64_t frame() const;
+
+    // time spent in glClientWaitSync by the last beginFrame()
+    double waitMs() const;
+    // "stream: U/R KiB, wait W ms" for the current frame
+    std::string report() const;
+
+private:
+    StreamBuffer(const StreamBuffer &);
+    StreamBuffer &operator=(const StreamBuffer &);
+
+    size_t bytesPerRegion;
+    int frames;
+    int region;
+    size_t cursor;
+    uint64_t frameCount;
+    double lastWaitMs;
+    GLuint id;
+    bool persistent;
+    uint8_t *mapped;
+    std::vector<uint8_t> staging;
+    std::vector<GLsync> fences;
+};
+
+#endif
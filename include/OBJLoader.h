@@ -0,0 +1,222 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+
+class OBJLoader {
+public:
+    // Interleaved vertices: position (3), normal (3), texcoord (2)
+    struct MeshData {
+        std::vector<float> vertices;
+        std::vector<uint32_t> indices;
+        float bounds_min[3];
+        float bounds_max[3];
+    };
+
+    static const int FLOATS_PER_VERTEX = 8;
+
+    /**
+     * Load a Wavefront OBJ file as an indexed triangle mesh
+     *
+     * Polygons are triangulated as fans. Vertices are shared between faces
+     * that use the same v/vt/vn triple. Files without normals get smooth
+     * normals averaged from the faces around each position.
+     *
+     * @param filename Path to the OBJ file
+     * @return Interleaved vertices and triangle indices
+     */
+    static MeshData loadOBJ(const std::string& filename) {
+        std::ifstream file(filename);
+        if (!file) {
+            throw std::runtime_error("Failed to open OBJ file: " + filename);
+        }
+
+        std::vector<float> positions;
+        std::vector<float> normals;
+        std::vector<float> texcoords;
+        MeshData mesh;
+        // v/vt/vn triple -> output vertex
+        std::unordered_map<CornerKey, uint32_t, CornerKeyHash> vertex_index;
+        // output vertex -> position index, to average normals afterwards
+        std::vector<uint32_t> vertex_position;
+        bool has_normals = false;
+
+        std::string line;
+        std::vector<uint32_t> face;
+        while (std::getline(file, line)) {
+            std::istringstream stream(line);
+            std::string keyword;
+            stream >> keyword;
+
+            if (keyword == "v") {
+                float x = 0, y = 0, z = 0;
+                stream >> x >> y >> z;
+                positions.push_back(x);
+                positions.push_back(y);
+                positions.push_back(z);
+            } else if (keyword == "vn") {
+                float x = 0, y = 0, z = 0;
+                stream >> x >> y >> z;
+                normals.push_back(x);
+                normals.push_back(y);
+                normals.push_back(z);
+            } else if (keyword == "vt") {
+                float u = 0, v = 0;
+                stream >> u >> v;
+                texcoords.push_back(u);
+                texcoords.push_back(v);
+            } else if (keyword == "f") {
+                face.clear();
+                std::string corner;
+                while (stream >> corner) {
+                    int v = 0, vt = 0, vn = 0;
+                    parseCorner(corner, v, vt, vn);
+                    // negative indices count back from the last element
+                    v = resolveIndex(v, positions.size() / 3, filename);
+                    vt = vt ? resolveIndex(vt, texcoords.size() / 2, filename) : -1;
+                    vn = vn ? resolveIndex(vn, normals.size() / 3, filename) : -1;
+                    if (vn >= 0) {
+                        has_normals = true;
+                    }
+
+                    CornerKey key = { v, vt, vn };
+                    std::unordered_map<CornerKey, uint32_t, CornerKeyHash>::iterator found = vertex_index.find(key);
+                    if (found != vertex_index.end()) {
+                        face.push_back(found->second);
+                        continue;
+                    }
+                    uint32_t index = static_cast<uint32_t>(mesh.vertices.size() / FLOATS_PER_VERTEX);
+                    for (int i = 0; i < 3; ++i) {
+                        mesh.vertices.push_back(positions[v * 3 + i]);
+                    }
+                    for (int i = 0; i < 3; ++i) {
+                        mesh.vertices.push_back(vn >= 0 ? normals[vn * 3 + i] : 0.0f);
+                    }
+                    mesh.vertices.push_back(vt >= 0 ? texcoords[vt * 2] : 0.0f);
+                    mesh.vertices.push_back(vt >= 0 ? texcoords[vt * 2 + 1] : 0.0f);
+                    vertex_index[key] = index;
+                    vertex_position.push_back(static_cast<uint32_t>(v));
+                    face.push_back(index);
+                }
+                for (size_t i = 2; i < face.size(); ++i) {
+                    mesh.indices.push_back(face[0]);
+                    mesh.indices.push_back(face[i - 1]);
+                    mesh.indices.push_back(face[i]);
+                }
+            }
+            // o, g, s, usemtl and mtllib do not change the geometry
+        }
+
+        if (mesh.indices.empty()) {
+            throw std::runtime_error("OBJ file has no faces: " + filename);
+        }
+        if (!has_normals) {
+            computeNormals(mesh, vertex_position, positions.size() / 3);
+        }
+        computeBounds(mesh);
+        return mesh;
+    }
+
+private:
+    // 0-based indices of a face corner, -1 for a missing vt or vn; compared
+    // whole, so no index count can make two corners share a vertex
+    struct CornerKey {
+        int v;
+        int vt;
+        int vn;
+
+        bool operator==(const CornerKey& other) const {
+            return v == other.v && vt == other.vt && vn == other.vn;
+        }
+    };
+
+    struct CornerKeyHash {
+        size_t operator()(const CornerKey& key) const {
+            uint64_t hash = static_cast<uint32_t>(key.v);
+            hash = hash * 0x9E3779B97F4A7C15ULL + static_cast<uint32_t>(key.vt + 1);
+            hash = hash * 0x9E3779B97F4A7C15ULL + static_cast<uint32_t>(key.vn + 1);
+            return static_cast<size_t>(hash ^ (hash >> 29));
+        }
+    };
+
+    // "v", "v/vt", "v//vn" or "v/vt/vn"; missing parts are left at 0
+    static void parseCorner(const std::string& corner, int& v, int& vt, int& vn) {
+        const char* cursor = corner.c_str();
+        char* end;
+        v = static_cast<int>(std::strtol(cursor, &end, 10));
+        if (*end != '/') {
+            return;
+        }
+        cursor = end + 1;
+        if (*cursor != '/') {
+            vt = static_cast<int>(std::strtol(cursor, &end, 10));
+            cursor = end;
+        }
+        if (*cursor == '/') {
+            vn = static_cast<int>(std::strtol(cursor + 1, &end, 10));
+        }
+    }
+
+    // 1-based or negative OBJ index to 0-based
+    static int resolveIndex(int index, size_t count, const std::string& filename) {
+        int resolved = index > 0 ? index - 1 : static_cast<int>(count) + index;
+        if (index == 0 || resolved < 0 || resolved >= static_cast<int>(count)) {
+            throw std::runtime_error("Invalid face index in OBJ file: " + filename);
+        }
+        return resolved;
+    }
+
+    // Area weighted face normals summed per position, so vertices split by
+    // texcoords still get the same normal
+    static void computeNormals(MeshData& mesh, const std::vector<uint32_t>& vertex_position, size_t position_count) {
+        std::vector<float> sums(position_count * 3, 0.0f);
+        for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+            const float* a = &mesh.vertices[mesh.indices[i] * FLOATS_PER_VERTEX];
+            const float* b = &mesh.vertices[mesh.indices[i + 1] * FLOATS_PER_VERTEX];
+            const float* c = &mesh.vertices[mesh.indices[i + 2] * FLOATS_PER_VERTEX];
+            float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1],
+                           e1[2] * e2[0] - e1[0] * e2[2],
+                           e1[0] * e2[1] - e1[1] * e2[0] };
+            for (int corner = 0; corner < 3; ++corner) {
+                uint32_t p = vertex_position[mesh.indices[i + corner]];
+                for (int k = 0; k < 3; ++k) {
+                    sums[p * 3 + k] += n[k];
+                }
+            }
+        }
+        for (size_t v = 0; v < vertex_position.size(); ++v) {
+            const float* n = &sums[vertex_position[v] * 3];
+            float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            float* out = &mesh.vertices[v * FLOATS_PER_VERTEX + 3];
+            for (int k = 0; k < 3; ++k) {
+                out[k] = length > 0.0f ? n[k] / length : (k == 1 ? 1.0f : 0.0f);
+            }
+        }
+    }
+
+    static void computeBounds(MeshData& mesh) {
+        for (int k = 0; k < 3; ++k) {
+            mesh.bounds_min[k] = mesh.vertices[k];
+            mesh.bounds_max[k] = mesh.vertices[k];
+        }
+        for (size_t i = 0; i < mesh.vertices.size(); i += FLOATS_PER_VERTEX) {
+            for (int k = 0; k < 3; ++k) {
+                mesh.bounds_min[k] = std::min(mesh.bounds_min[k], mesh.vertices[i + k]);
+                mesh.bounds_max[k] = std::max(mesh.bounds_max[k], mesh.vertices[i + k]);
+            }
+        }
+    }
+};
+
+#endif
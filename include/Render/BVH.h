@@ -0,0 +1,253 @@
+#ifndef BVH_H
+# define BVH_H
+
+# include "Core/Math.h"
+# include "Render/FrustumCuller.h"
+# include "OBJLoader.h"
+
+# include <algorithm>
+# include <cstddef>
+# include <cstdint>
+# include <vector>
+
+struct Ray {
+    Vec3 origin;
+    Vec3 direction;     // need not be normalized; hit distances are in its units
+};
+
+// 32 bytes, two per cache line. Nodes are stored depth first: the left
+// child of an inner node directly follows it.
+struct BVHNode {
+    float boundsMin[3];
+    uint32_t leftFirst;     // inner: index of the right child; leaf: first of indices()
+    float boundsMax[3];
+    uint32_t count;         // primitives of a leaf, 0 for inner nodes
+};
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode must stay 32 bytes");
+
+// Bounding volume hierarchy over primitive boxes: scene objects, or mesh
+// triangles through MeshBVH. Built top-down with the surface area
+// heuristic evaluated over BINS centroid bins per axis. The top levels
+// bin in parallel and the subtrees below are built as separate JobSystem
+// chunks. refit() updates the bounds of moved primitives without
+// changing the tree, which stays good while they move moderately.
+//
+// Queries take a callback for the exact primitive test, so the tree only
+// knows boxes.
+class BVH {
+public:
+    static const int BINS = 16;
+    static const uint32_t MAX_LEAF = 4;
+    // traversal stack entries kept on the frame; deeper trees use the heap
+    static const uint32_t INLINE_STACK = 64;
+
+    BVH();
+
+    void build(const std::vector<AABB> &primitives);
+    // new bounds for the same primitives, in the same order as build()
+    void refit(const std::vector<AABB> &primitives);
+    void clear();
+
+    const std::vector<BVHNode> &nodes() const;
+    // primitive of every leaf slot
+    const std::vector<uint32_t> &indices() const;
+    size_t primitiveCount() const;
+    AABB bounds() const;
+    // nodes on the longest root to leaf path, 0 when empty
+    uint32_t depth() const;
+
+    // closest hit: hit(primitive, ray, tMax) returns the primitive's hit
+    // distance, or a value >= tMax for a miss. Nodes are visited near
+    // child first and skipped once they lie beyond the closest hit.
+    template <typename Fn>
+    bool raycast(const Ray &ray, float &tHit, uint32_t &primitive, Fn hit, float tMax = HUGE_VALF) const;
+
+    // primitives whose box touches the frustum, in tree order. Planes a
+    // node lies fully inside are not tested again below it. Without the
+    // primitive boxes a leaf's primitives pass or fail together.
+    void cull(const Frustum &frustum, std::vector<uint32_t> &visible,
+              const std::vector<AABB> *primitives = NULL) const;
+
+    // primitive nearest to point: distance(primitive, point, best) returns
+    // its distance, or a value >= best if it cannot beat it
+    template <typename Fn>
+    bool nearest(const Vec3 &point, float &distance, uint32_t &primitive, Fn distanceTo,
+                 float maxDistance = HUGE_VALF) const;
+
+    // entry distance of the ray into a node's box, HUGE_VALF on a miss
+    static float intersectNode(const BVHNode &node, const Ray &ray, const Vec3 &inverseDirection, float tMax);
+    static float nodeDistance(const BVHNode &node, const Vec3 &point);
+
+private:
+    struct Task {
+        uint32_t first;
+        uint32_t count;
+        std::vector<BVHNode> nodes;
+    };
+
+    // builds the subtree of indices [first, first + count) into out; with
+    // tasks, ranges of at most taskSize become placeholders for subtrees
+    void buildNode(std::vector<BVHNode> &out, uint32_t first, uint32_t count,
+                   std::vector<Task> *tasks, uint32_t taskSize);
+    void rangeBounds(uint32_t first, uint32_t count, AABB &box, AABB &centroidBox) const;
+    // false when a leaf is cheaper than any split
+    bool findSplit(uint32_t first, uint32_t count, const AABB &box, const AABB &centroidBox,
+                   int &axis, int &bin) const;
+    void emit(const std::vector<BVHNode> &top, uint32_t index, std::vector<Task> &tasks);
+    // entries a depth-first traversal can have pending: one sibling per
+    // level plus the node being split
+    uint32_t stackSize() const { return treeDepth + 1; }
+
+    static void setBounds(BVHNode &node, const AABB &box);
+
+    std::vector<BVHNode> tree;
+    std::vector<uint32_t> order;
+    uint32_t treeDepth;
+    // build input, kept for the partition steps
+    const std::vector<AABB> *boxes;
+    std::vector<Vec3> centroids;
+};
+
+// BVH over the triangles of a mesh, in the mesh's own space
+class MeshBVH {
+public:
+    explicit MeshBVH(const OBJLoader::MeshData &mesh);
+
+    // closest triangle along the ray, Moller-Trumbore per candidate
+    bool raycast(const Ray &ray, float &t, uint32_t &triangle, float tMax = HUGE_VALF) const;
+    // closest point of the surface
+    bool nearest(const Vec3 &point, Vec3 &closest, uint32_t &triangle, float maxDistance = HUGE_VALF) const;
+
+    size_t triangleCount() const;
+    const BVH &bvh() const;
+
+private:
+    float intersectTriangle(uint32_t triangle, const Ray &ray) const;
+    Vec3 closestOnTriangle(uint32_t triangle, const Vec3 &point) const;
+
+    std::vector<Vec3> positions;
+    std::vector<uint32_t> triangles;    // three vertex indices each
+    BVH tree;
+};
+
+template <typename Fn>
+bool BVH::raycast(const Ray &ray, float &tHit, uint32_t &primitive, Fn hit, float tMax) const
+{
+    if (tree.empty())
+        return false;
+    Vec3 inverse(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+    bool found = false;
+    // nodes with their entry distance, rechecked against the closest hit on pop
+    uint32_t inlineStack[INLINE_STACK];
+    float inlineEntry[INLINE_STACK];
+    std::vector<uint32_t> heapStack;
+    std::vector<float> heapEntry;
+    uint32_t *stack = inlineStack;
+    float *entry = inlineEntry;
+    if (stackSize() > INLINE_STACK)
+    {
+        heapStack.resize(stackSize());
+        heapEntry.resize(stackSize());
+        stack = &heapStack[0];
+        entry = &heapEntry[0];
+    }
+    uint32_t top = 0;
+    entry[top] = intersectNode(tree[0], ray, inverse, tMax);
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        --top;
+        if (entry[top] >= tMax)
+            continue;
+        const BVHNode &node = tree[stack[top]];
+        if (node.count > 0)
+        {
+            for (uint32_t i = 0; i < node.count; ++i)
+            {
+                uint32_t p = order[node.leftFirst + i];
+                float t = hit(p, ray, tMax);
+                if (t < tMax)
+                {
+                    tMax = t;
+                    primitive = p;
+                    found = true;
+                }
+            }
+            continue;
+        }
+        uint32_t near = static_cast<uint32_t>(&node - &tree[0]) + 1;
+        uint32_t far = node.leftFirst;
+        float tNear = intersectNode(tree[near], ray, inverse, tMax);
+        float tFar = intersectNode(tree[far], ray, inverse, tMax);
+        if (tFar < tNear)
+        {
+            std::swap(near, far);
+            std::swap(tNear, tFar);
+        }
+        // pushed last, the near child is visited first
+        if (tFar < tMax)
+        {
+            entry[top] = tFar;
+            stack[top++] = far;
+        }
+        if (tNear < tMax)
+        {
+            entry[top] = tNear;
+            stack[top++] = near;
+        }
+    }
+    if (found)
+        tHit = tMax;
+    return found;
+}
+
+template <typename Fn>
+bool BVH::nearest(const Vec3 &point, float &distance, uint32_t &primitive, Fn distanceTo, float maxDistance) const
+{
+    if (tree.empty())
+        return false;
+    bool found = false;
+    uint32_t inlineStack[INLINE_STACK];
+    std::vector<uint32_t> heapStack;
+    uint32_t *stack = inlineStack;
+    if (stackSize() > INLINE_STACK)
+    {
+        heapStack.resize(stackSize());
+        stack = &heapStack[0];
+    }
+    uint32_t top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const BVHNode &node = tree[stack[--top]];
+        if (nodeDistance(node, point) >= maxDistance)
+            continue;
+        if (node.count > 0)
+        {
+            for (uint32_t i = 0; i < node.count; ++i)
+            {
+                uint32_t p = order[node.leftFirst + i];
+                float d = distanceTo(p, point, maxDistance);
+                if (d < maxDistance)
+                {
+                    maxDistance = d;
+                    primitive = p;
+                    found = true;
+                }
+            }
+            continue;
+        }
+        uint32_t near = static_cast<uint32_t>(&node - &tree[0]) + 1;
+        uint32_t far = node.leftFirst;
+        if (nodeDistance(tree[far], point) < nodeDistance(tree[near], point))
+            std::swap(near, far);
+        stack[top++] = far;
+        stack[top++] = near;
+    }
+    if (found)
+        distance = maxDistance;
+    return found;
+}
+
+#endif
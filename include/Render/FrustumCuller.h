@@ -0,0 +1,76 @@
+#ifndef FRUSTUM_CULLER_H
+# define FRUSTUM_CULLER_H
+
+# include "Core/Math.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <string>
+# include <vector>
+
+// Six planes (x, y, z, w) with normals pointing inside, normalized so
+// dot(normal, p) + w is a distance: left, right, bottom, top, near, far.
+struct Frustum {
+    Vec4 planes[6];
+
+    // planes of clip space pulled back through viewProjection
+    static Frustum fromMatrix(const Mat4 &viewProjection);
+    // the same planes in the space model maps from; rigid transforms
+    // keep them normalized
+    Frustum transformed(const Mat4 &model) const;
+};
+
+// Bounds of many objects in structure-of-arrays form, culled against a
+// frustum several objects at a time: 8 with AVX2 (__AVX2__), 4 with SSE2,
+// one at a time otherwise. Each object has a bounding sphere and an
+// axis-aligned box sharing its center; a plane rejects it when it rejects
+// the tighter of the two. Large sets are split across the JobSystem.
+//
+// The output is the compacted, ascending list of visible object indices.
+class FrustumCuller {
+public:
+    struct Stats {
+        size_t tested;
+        size_t visible;
+        size_t culled;
+    };
+
+    FrustumCuller();
+
+    // returns the object's index
+    uint32_t add(const Vec3 &center, float radius, const Vec3 &extents);
+    uint32_t addSphere(const Vec3 &center, float radius);
+    uint32_t addBox(const Vec3 &boundsMin, const Vec3 &boundsMax);
+    void set(uint32_t index, const Vec3 &center, float radius, const Vec3 &extents);
+    void clear();
+    size_t size() const;
+
+    // replaces visible with the indices of the objects touching the frustum
+    size_t cull(const Frustum &frustum, std::vector<uint32_t> &visible);
+
+    // counts of the last cull()
+    Stats stats() const;
+    // "cull: V/N visible (PATH)"
+    std::string report() const;
+    // "AVX2", "SSE2" or "scalar", fixed at compile time
+    static const char *simdPath();
+
+private:
+    // objects are stored in groups of this many, padding never visible
+    static const size_t GROUP = 8;
+
+    // writes the visible indices of groups [begin, end) to out, returns their count
+    size_t cullGroups(const Frustum &frustum, size_t begin, size_t end, uint32_t *out) const;
+
+    size_t count;
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius;
+    std::vector<float> extentX;
+    std::vector<float> extentY;
+    std::vector<float> extentZ;
+    Stats lastStats;
+};
+
+#endif
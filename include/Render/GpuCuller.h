@@ -0,0 +1,122 @@
+#ifndef GPU_CULLER_H
+# define GPU_CULLER_H
+
+# include "glad.h"
+# include "Core/Math.h"
+# include "Shader/ComputeShader.h"
+# include "Shader/Shader.h"
+# include "Render/MeshPool.h"
+# include "Render/MultiDrawBatch.h"
+# include "Render/OcclusionCuller.h"
+# include "Render/VertexArrayCache.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <string>
+# include <vector>
+
+// std430 Object of shaders/compute/cull.comp: an object spinning about Y
+// around its position, drawn as translate(position) * rotateY(time +
+// phase) * translate(-center)
+struct GpuObject {
+    Vec4 position;      // w: spin phase
+    Vec4 extents;       // xyz: half size of the bounds, w: bounding radius
+    Vec4 color;         // w: texture array layer, kept by the highlight
+    float center[3];    // model center, subtracted before rotating
+    uint32_t command;   // filled by upload()
+};
+
+static_assert(sizeof(GpuObject) == 64, "GpuObject must match the std430 Object");
+
+// GPU driven culling of MeshPool objects (GL 4.3). The objects are
+// uploaded once; every frame a compute pass (shaders/compute/cull.comp)
+// tests each of them against the frustum of the Frame block's
+// viewProjection and, when given, an OcclusionCuller depth pyramid. A
+// survivor atomically takes the next instance of its (material, mesh)
+// command and writes its model matrix and color to that instance's slot,
+// so the CPU does no work per object.
+//
+// There is one indirect command per material and mesh, reset every frame
+// with instanceCount 0 and a fixed baseInstance range, which keeps the
+// draw count known without GL_ARB_indirect_parameters. draw() then issues
+// one glMultiDrawElementsIndirect per material with the MULTI_DRAW
+// shader permutation: aDrawID reads baseInstance + instance, the draw
+// data texture covers the slots and drawIDBase is 0.
+//
+// Use: add() every object; upload(); per frame cull(), then draw() for
+// each material.
+class GpuCuller {
+public:
+    // invocations per work group, the local_size_x of the shader
+    static const GLuint GROUP_SIZE = 64;
+    // work groups per row of the dispatch; more objects add rows
+    static const GLuint MAX_GROUPS_X = 65535;
+    // levels of an OcclusionCuller pyramid the shader reads
+    static const int MAX_PYRAMID_LEVELS = 16;
+
+    GpuCuller(const MeshPool &pool, unsigned materials, const char *shaderPath = "shaders/compute/cull.comp");
+    ~GpuCuller();
+
+    // compute shaders and indirect draws with base instance
+    static bool supported();
+    // false when the compute shader did not build
+    bool isReady() const;
+
+    void add(const GpuObject &object, uint32_t mesh, uint32_t material);
+    // builds the commands and uploads the objects; call once after the last add()
+    void upload();
+
+    // the next cull() tests against this pyramid, built with the frame's
+    // viewProjection; NULL tests the frustum only
+    void setDepthPyramid(const OcclusionCuller *occlusion);
+    // highlight: object drawn in highlightColor instead of its own, or -1
+    void cull(int highlight, const Vec4 &highlightColor);
+    // shader must be bound; the draw data texture goes to textureUnit
+    void draw(unsigned material, Shader &shader, VertexArrayCache &vertexArrays, unsigned textureUnit);
+
+    size_t objectCount() const;
+    // objects drawn by the latest cull() whose count has reached the CPU;
+    // read back without stalling, so it lags a frame or two
+    size_t visibleCount() const;
+    // "gpu cull: V/N visible"
+    std::string report();
+
+private:
+    GpuCuller(const GpuCuller &);
+    GpuCuller &operator=(const GpuCuller &);
+
+    // polls the readback fence of an earlier cull()
+    void readCount();
+
+    const MeshPool &pool;
+    unsigned materials;
+    ComputeShader shader;
+    std::vector<GpuObject> objects;
+    // command of each object before upload(): material * meshes + mesh
+    std::vector<uint32_t> objectCommands;
+    std::vector<DrawElementsIndirectCommand> commands;
+    GLuint objectBuffer;
+    GLuint commandTemplate;     // commands with instanceCount 0, copied over every frame
+    GLuint commandBuffer;       // GL_DRAW_INDIRECT_BUFFER and storage binding 1
+    GLuint drawDataBuffer;      // InstanceData per slot
+    GLuint drawDataTexture;
+    GLuint drawIDBuffer;
+    GLuint pyramidBuffer;
+    GLuint counterBuffer;       // visible objects of the frame
+    GLuint readbackBuffer;
+    GLsync readbackFence;
+    size_t pyramidFloats;
+    bool useHiZ;
+    int levelCount;
+    GLint levels[MAX_PYRAMID_LEVELS * 4];
+    size_t visible;
+    // uniforms of the cull shader
+    UniformHandle objectCountUniform;
+    UniformHandle highlightUniform;
+    UniformHandle highlightColorUniform;
+    UniformHandle hiZUniform;
+    UniformHandle levelsUniform;
+    UniformHandle levelCountUniform;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef INSTANCE_BUFFER_H
+# define INSTANCE_BUFFER_H
+
+# include "glad.h"
+# include "Core/Math.h"
+# include "Core/StreamBuffer.h"
+# include "Render/VertexFormat.h"
+
+# include <cstddef>
+# include <cstdint>
+
+// per-instance attributes: aInstanceModel (mat4), aInstanceColor (vec4)
+struct InstanceData {
+    Mat4 model;
+    Vec4 color;         // w: layer of the TEXTURE_ARRAY permutation's texture
+};
+
+static_assert(sizeof(InstanceData) == 80, "InstanceData must match InstanceBuffer::format()");
+
+// Per-instance data rewritten every frame, allocated from the frame's
+// region of a StreamBuffer. Writes go straight to the persistent mapping
+// when there is one; the stream's fence protects the region until the GPU
+// has drawn from it.
+//
+// Per frame, between the stream's beginFrame() and endFrame():
+// map(); write up to capacity() instances; unmap(count); draw using offset().
+class InstanceBuffer {
+public:
+    InstanceBuffer(StreamBuffer &stream, size_t capacity);
+
+    static const VertexFormat &format();
+
+    // room for capacity() instances in the stream's current region
+    InstanceData *map();
+    // makes the first count instances visible to the GPU
+    void unmap(size_t count);
+
+    // start of the last map(), for the instance attribute pointers; the
+    // allocation has the same size every frame, so it repeats with the
+    // stream's regions and VAOs built on it can be cached
+    GLintptr offset() const;
+    GLuint buffer() const;
+    size_t capacity() const;
+    bool isPersistent() const;
+
+private:
+    InstanceBuffer(const InstanceBuffer &);
+    InstanceBuffer &operator=(const InstanceBuffer &);
+
+    StreamBuffer &stream;
+    size_t instanceCapacity;
+    StreamBuffer::Allocation current;
+};
+
+#endif
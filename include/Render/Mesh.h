@@ -0,0 +1,36 @@
+#ifndef MESH_H
+# define MESH_H
+
+# include "glad.h"
+# include "OBJLoader.h"
+# include "Core/Math.h"
+# include "Render/VertexFormat.h"
+
+// Indexed triangle mesh in its own vertex and index buffer, in the
+// interleaved layout produced by OBJLoader.
+class Mesh {
+public:
+    explicit Mesh(const OBJLoader::MeshData &data);
+    ~Mesh();
+
+    // aPos (3 floats), aNormal (3 floats), aTexCoord (2 floats)
+    static const VertexFormat &format();
+
+    GLuint vertexBuffer() const;
+    GLuint indexBuffer() const;
+    GLsizei indexCount() const;
+    const Vec3 &boundsMin() const;
+    const Vec3 &boundsMax() const;
+
+private:
+    Mesh(const Mesh &);
+    Mesh &operator=(const Mesh &);
+
+    GLuint vbo;
+    GLuint ebo;
+    GLsizei count;
+    Vec3 minimum;
+    Vec3 maximum;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef MESH_POOL_H
+# define MESH_POOL_H
+
+# include "glad.h"
+# include "OBJLoader.h"
+# include "Core/Math.h"
+# include "Render/VertexFormat.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <vector>
+
+// part of a mesh's indices, relative to its Range::firstIndex
+struct IndexRange {
+    GLuint first;
+    GLuint count;
+};
+
+// Every mesh in one shared vertex buffer and one shared index buffer, so
+// draws of different meshes need no buffer or VAO change between them and
+// can be submitted together. Indices stay relative to their mesh; draws
+// add baseVertex. Vertices use the Mesh::format() layout.
+//
+// A mesh can carry coarser levels of detail over its own vertices (see
+// MeshSimplifier); their indices go into the same index buffer, so a level
+// is drawn like a part of the mesh.
+class MeshPool {
+public:
+    // level 0 and up to 3 simplified levels
+    static const unsigned MAX_LODS = 4;
+
+    struct Lod {
+        GLuint firstIndex;
+        GLuint indexCount;
+        float error;        // model units the surface may be off by
+    };
+
+    struct Range {
+        GLuint firstIndex;
+        GLuint indexCount;
+        GLint baseVertex;
+        Vec3 boundsMin;
+        Vec3 boundsMax;
+        // lods[0] is the full mesh with error 0, coarser levels follow
+        Lod lods[MAX_LODS];
+        unsigned lodCount;
+    };
+
+    MeshPool();
+    ~MeshPool();
+
+    // returns the mesh id; visible to the GPU after the next upload()
+    uint32_t add(const OBJLoader::MeshData &data);
+    // appends a coarser level of mesh, indices relative to its vertices;
+    // levels past MAX_LODS are ignored. Visible after the next upload()
+    void addLod(uint32_t mesh, const std::vector<uint32_t> &lodIndices, float error);
+    // (re)creates both buffers from everything added so far
+    void upload();
+
+    const Range &range(uint32_t mesh) const;
+    size_t meshCount() const;
+    GLuint vertexBuffer() const;
+    GLuint indexBuffer() const;
+    static const VertexFormat &format();
+
+private:
+    MeshPool(const MeshPool &);
+    MeshPool &operator=(const MeshPool &);
+
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Range> ranges;
+    GLuint vbo;
+    GLuint ebo;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef MESH_SIMPLIFIER_H
+# define MESH_SIMPLIFIER_H
+
+# include "OBJLoader.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <vector>
+
+// one level of detail: triangles over the mesh's own vertices
+struct MeshLod {
+    std::vector<uint32_t> indices;
+    // how far the surface may have moved from the full mesh, in model
+    // units; normal and texcoord changes count as distance too
+    float error;
+};
+
+// Quadric error edge collapse (Garland & Heckbert): every position gets the
+// squared distance to the planes of its triangles, and the cheapest edge is
+// collapsed until the triangle target is met. A position only ever moves
+// onto a neighbour, so all levels index the original vertices and can
+// share the mesh's vertex buffer.
+//
+// Vertices that share a position (split by normals or texcoords) collapse
+// together: each must land on the vertex of the target position it shares
+// triangles with, so seams keep their attributes and only slide along
+// themselves. The cost adds the normal and texcoord differences of those
+// pairs to the distance. Border positions only move along a border onto
+// another border position, and extra planes through border edges keep the
+// outline; positions on non-manifold edges never move. A collapse that
+// would flip a triangle or pinch the surface is skipped.
+class MeshSimplifier {
+public:
+    // levels buildChain() makes, each with half the triangles of the one before
+    static const size_t LOD_LEVELS = 3;
+
+    // one level per target index count, largest first, each simplified
+    // further from the one before; a level stops early when no collapse
+    // is left
+    static std::vector<MeshLod> simplify(const OBJLoader::MeshData &mesh, const std::vector<size_t> &targetIndexCounts);
+
+    // LOD_LEVELS levels at 1/2, 1/4 and 1/8 of the triangles; levels that
+    // could not get smaller than the one before are dropped
+    static std::vector<MeshLod> buildChain(const OBJLoader::MeshData &mesh);
+    // buildChain() of every mesh, meshes spread over the JobSystem
+    static std::vector<std::vector<MeshLod> > buildChains(const std::vector<const OBJLoader::MeshData *> &meshes);
+};
+
+#endif
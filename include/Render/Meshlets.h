@@ -0,0 +1,79 @@
+#ifndef MESHLETS_H
+# define MESHLETS_H
+
+# include "Core/Math.h"
+# include "OBJLoader.h"
+# include "Render/FrustumCuller.h"
+# include "Render/MeshPool.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <vector>
+
+// a cluster of a mesh's triangles, contiguous in its index buffer
+struct Meshlet {
+    Vec3 center;        // bounding sphere
+    float radius;
+    Vec3 coneAxis;      // average facing of the triangles
+    float coneCutoff;   // sine of the cone's half angle, 1 when it cannot be culled
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t vertexCount;
+};
+
+// A mesh split into meshlets of at most MAX_VERTICES distinct vertices and
+// MAX_TRIANGLES triangles, grown greedily over shared vertices so each is
+// compact and faces one way. build() reorders the mesh's indices so every
+// meshlet is one index range; the vertices do not change.
+//
+// cull() tests the meshlets of one object in the mesh's own space: the
+// bounding sphere against the frustum, and the normal cone against the
+// eye, which drops meshlets that only face away (consistent
+// counter-clockwise winding assumed). Meshlets are stored as structure of
+// arrays and tested 8 at a time with AVX2 (__AVX2__), 4 with SSE2, one at
+// a time otherwise. cull() is const, so objects can be culled in parallel.
+class Meshlets {
+public:
+    static const uint32_t MAX_VERTICES = 64;
+    static const uint32_t MAX_TRIANGLES = 124;
+
+    Meshlets();
+
+    // splits mesh, reordering mesh.indices; returns the meshlet count
+    size_t build(OBJLoader::MeshData &mesh);
+    void clear();
+
+    size_t size() const;
+    Meshlet meshlet(size_t index) const;
+    size_t triangleCount() const;
+
+    // appends the index ranges of the meshlets that may be visible from
+    // eye, with touching ranges merged; frustum and eye are in the mesh's
+    // space. Returns the triangles kept.
+    size_t cull(const Frustum &frustum, const Vec3 &eye, std::vector<IndexRange> &ranges) const;
+
+    // "AVX2", "SSE2" or "scalar", fixed at compile time
+    static const char *simdPath();
+
+private:
+    // meshlets are stored in groups of this many, padding never visible
+    static const size_t GROUP = 8;
+
+    void add(const Meshlet &meshlet);
+
+    size_t count;
+    size_t triangles;
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius;
+    std::vector<float> axisX;
+    std::vector<float> axisY;
+    std::vector<float> axisZ;
+    std::vector<float> cutoff;
+    std::vector<uint32_t> firstIndex;
+    std::vector<uint32_t> indexCount;
+    std::vector<uint32_t> vertexCount;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef MULTI_DRAW_BATCH_H
+# define MULTI_DRAW_BATCH_H
+
+# include "glad.h"
+# include "Core/StreamBuffer.h"
+# include "Shader/Shader.h"
+# include "Render/InstanceBuffer.h"
+# include "Render/MeshPool.h"
+# include "Render/VertexArrayCache.h"
+# include "Render/VertexFormat.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <vector>
+
+// layout of GL_DRAW_INDIRECT_BUFFER entries for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Draws of MeshPool meshes sharing one material, submitted together.
+// Per-draw data (model matrix and color, as InstanceData) and the
+// commands are allocated from a StreamBuffer every upload(). The vertex
+// shader reads the data through a texture buffer spanning the whole
+// stream; the draw index comes from the aDrawID instance attribute plus
+// the drawIDBase uniform (the MULTI_DRAW permutation), which also carries
+// where this frame's data starts.
+//
+// With GL 4.3 / ARB_multi_draw_indirect the whole batch is one
+// glMultiDrawElementsIndirect: a command's baseInstance is the index of
+// its draw data, so aDrawID reads it. Several commands may share one
+// draw data, e.g. the visible meshlet ranges of an object. On GL 3.3 the
+// commands are replayed with glDrawElementsBaseVertex and drawIDBase set
+// per draw.
+class MultiDrawBatch {
+public:
+    // texels of per-draw data: four matrix columns and the color, whose
+    // alpha is the TEXTURE_ARRAY layer
+    static const int TEXELS_PER_DRAW = 5;
+
+    // maxCommands of 0 means one command per draw
+    MultiDrawBatch(StreamBuffer &stream, size_t maxDraws, size_t maxCommands = 0);
+    ~MultiDrawBatch();
+
+    static bool indirectSupported();
+    // aDrawID, an int per instance
+    static const VertexFormat &drawIDFormat();
+
+    void clear();
+    // false once maxDraws draws or maxCommands commands are recorded
+    bool add(const MeshPool::Range &range, const InstanceData &data);
+    // one draw data for parts of the mesh, a command each; false, adding
+    // nothing, when they do not all fit
+    bool add(const MeshPool::Range &range, const InstanceData &data, const IndexRange *parts, size_t partCount);
+    // copies the commands and per-draw data recorded since clear() to the
+    // stream's current region
+    void upload();
+    // shader must be bound; the draw data texture goes to textureUnit
+    void draw(Shader &shader, VertexArrayCache &vertexArrays, const MeshPool &pool, unsigned textureUnit);
+
+    size_t drawCount() const;
+    size_t commandCount() const;
+    // GL draw calls made by the last draw()
+    size_t submittedCalls() const;
+    bool usesIndirect() const;
+
+private:
+    MultiDrawBatch(const MultiDrawBatch &);
+    MultiDrawBatch &operator=(const MultiDrawBatch &);
+
+    StreamBuffer &stream;
+    size_t maxDraws;
+    size_t maxCommands;
+    bool indirect;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<InstanceData> drawData;
+    StreamBuffer::Allocation commandAllocation;
+    // index of this upload's first InstanceData in the stream
+    GLint drawBase;
+    GLuint drawDataTexture;
+    GLuint drawIDBuffer;
+    size_t calls;
+};
+
+#endif
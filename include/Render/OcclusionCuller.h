@@ -0,0 +1,98 @@
+#ifndef OCCLUSION_CULLER_H
+# define OCCLUSION_CULLER_H
+
+# include "Core/Math.h"
+# include "OBJLoader.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <string>
+# include <vector>
+
+// CPU occlusion culling. Low-poly proxies of a few large, near objects are
+// rasterized into a small depth buffer, a max-depth pyramid (hierarchical
+// Z) is built over it, and object boxes are tested against the pyramid
+// level where they cover at most 2x2 texels: a box whose nearest depth is
+// behind the farthest occluder depth there is hidden.
+//
+// Rasterization is split in tiles across the JobSystem; each tile walks
+// its triangles' edge functions 8 pixels at a time with AVX2 (__AVX2__),
+// 4 with SSE2, one at a time otherwise.
+//
+// Per frame: beginFrame(viewProjection); addOccluder() for the chosen
+// occluders; finish(); then isVisible() / cull().
+class OcclusionCuller {
+public:
+    struct Stats {
+        size_t occluders;
+        size_t triangles;   // rasterized after clipping and back-face culling
+        size_t tested;
+        size_t occluded;
+    };
+
+    OcclusionCuller(int width = 256, int height = 128);
+
+    // a proxy of mesh made of the cells of a resolution^3 grid over its
+    // bounds that lie wholly inside it; returns its index. The proxy never
+    // reaches outside the mesh, so it can only hide what the mesh hides.
+    // Cells whose inside test leaves through a hole of an open mesh are
+    // left out, and a mesh thinner than a cell gets an empty proxy.
+    uint32_t addProxy(const OBJLoader::MeshData &mesh, int resolution = 16);
+    size_t proxyTriangles(uint32_t proxy) const;
+
+    void beginFrame(const Mat4 &viewProjection);
+    void addOccluder(uint32_t proxy, const Mat4 &model);
+    // rasterizes the occluders and builds the depth pyramid
+    void finish();
+
+    bool isVisible(const AABB &box);
+    // removes from visible the objects whose bounds[index] are occluded
+    size_t cull(std::vector<uint32_t> &visible, const std::vector<AABB> &bounds);
+
+    Stats stats() const;
+    // "occlusion: O/T hidden by N occluders"
+    std::string report() const;
+    int width() const;
+    int height() const;
+    // finest level, for debugging: width() x height() depths in [0, 1]
+    const std::vector<float> &depth() const;
+    // pyramid level, 0 being depth(); levels halve rounding up down to 1x1
+    size_t levelCount() const;
+    const std::vector<float> &level(size_t index, int &levelWidth, int &levelHeight) const;
+
+private:
+    static const int TILE_WIDTH = 64;
+    static const int TILE_HEIGHT = 32;
+
+    struct Proxy {
+        std::vector<Vec3> positions;
+        std::vector<uint32_t> indices;
+    };
+
+    // screen space, counter-clockwise, depth in [0, 1]
+    struct ScreenTriangle {
+        float x[3];
+        float y[3];
+        float z[3];
+        int minX, minY, maxX, maxY;     // pixel bounds, inclusive
+    };
+
+    void rasterizeTile(int tileX, int tileY);
+    void buildPyramid();
+
+    int bufferWidth;
+    int bufferHeight;
+    int tilesX;
+    int tilesY;
+    Mat4 viewProjection;
+    std::vector<Proxy> proxies;
+    std::vector<ScreenTriangle> triangles;
+    std::vector<std::vector<uint32_t> > tileBins;
+    // levels[0] is the depth buffer, each next level the max of 2x2
+    std::vector<std::vector<float> > levels;
+    std::vector<int> levelWidths;
+    std::vector<int> levelHeights;
+    Stats frameStats;
+};
+
+#endif
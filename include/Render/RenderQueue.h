@@ -0,0 +1,63 @@
+#ifndef RENDER_QUEUE_H
+# define RENDER_QUEUE_H
+
+# include <cstddef>
+# include <cstdint>
+# include <vector>
+
+// Draws of a frame as 64-bit sort keys, each with the caller's index of
+// the draw. Keys pack, from the most significant bit:
+//
+//   opaque:       layer 4 | 0 | program 8 | material 10 | mesh 12 | depth 29
+//   translucent:  layer 4 | 1 | far depth 29 | program 8 | material 10 | mesh 12
+//
+// so sorted draws go layer by layer, opaques before translucents; opaques
+// grouped by program, then material (its textures), then mesh (its vertex
+// array), each group front to back for early-Z; translucents back to front
+// whatever their state.
+//
+// sort() is an LSD radix sort, 8 bits per pass, skipping the bytes every
+// key shares. The buffers are kept across clear(), so once they have grown
+// to a frame's draw count nothing is allocated.
+class RenderQueue {
+public:
+    static const unsigned LAYER_BITS = 4;
+    static const unsigned PROGRAM_BITS = 8;
+    static const unsigned MATERIAL_BITS = 10;
+    static const unsigned MESH_BITS = 12;
+    static const unsigned DEPTH_BITS = 29;
+
+    explicit RenderQueue(size_t capacity = 0);
+
+    // depth: 0 at the eye to 1 at the far plane, clamped; the other fields
+    // are cut to their bits
+    static uint64_t key(unsigned layer, bool translucent, unsigned program, unsigned material,
+                        unsigned mesh, float depth);
+    static unsigned layer(uint64_t key);
+    static bool translucent(uint64_t key);
+    static unsigned program(uint64_t key);
+    static unsigned material(uint64_t key);
+    static unsigned mesh(uint64_t key);
+
+    void clear();
+    void push(uint64_t key, uint32_t item);
+    void sort();
+
+    size_t size() const;
+    uint64_t keyAt(size_t index) const;
+    uint32_t itemAt(size_t index) const;
+    // radix passes the last sort() made, out of 8
+    unsigned passes() const;
+
+private:
+    // program, material and mesh together
+    static uint64_t state(uint64_t key);
+
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> items;
+    std::vector<uint64_t> keyScratch;
+    std::vector<uint32_t> itemScratch;
+    unsigned lastPasses;
+};
+
+#endif
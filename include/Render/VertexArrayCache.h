@@ -0,0 +1,55 @@
+#ifndef VERTEX_ARRAY_CACHE_H
+# define VERTEX_ARRAY_CACHE_H
+
+# include "glad.h"
+# include "Shader/Shader.h"
+# include "Render/VertexFormat.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <unordered_map>
+
+// Vertex array objects built from a VertexFormat and a program's reflected
+// attributes: each active attribute is wired to the format element of the
+// same name, at the location the linker chose. A VAO is built once per
+// (format, attribute signature, vertex buffer, index buffer) and reused, so
+// a reloaded program with the same inputs keeps its VAOs.
+class VertexArrayCache {
+public:
+    VertexArrayCache();
+    ~VertexArrayCache();
+
+    // the VAO for drawing these buffers with shader, built on first use.
+    // Attributes missing from format are looked up in instanceFormat, read
+    // from instanceBuffer at instanceOffset (a format with a divisor; without
+    // base instance support each ring region needs its own VAO).
+    GLuint get(const Shader &shader, const VertexFormat &format, GLuint vertexBuffer, GLuint indexBuffer = 0,
+               const VertexFormat *instanceFormat = NULL, GLuint instanceBuffer = 0, GLintptr instanceOffset = 0);
+
+    // deletes the VAOs that reference buffer, call before deleting it
+    void forgetBuffer(GLuint buffer);
+    void clear();
+
+    size_t size() const;
+    // VAOs built since construction
+    size_t builds() const;
+
+private:
+    VertexArrayCache(const VertexArrayCache &);
+    VertexArrayCache &operator=(const VertexArrayCache &);
+
+    struct Entry {
+        GLuint vao;
+        GLuint vertexBuffer;
+        GLuint indexBuffer;
+        GLuint instanceBuffer;
+    };
+
+    GLuint build(const Shader &shader, const VertexFormat &format, GLuint vertexBuffer, GLuint indexBuffer,
+                 const VertexFormat *instanceFormat, GLuint instanceBuffer, GLintptr instanceOffset) const;
+
+    std::unordered_map<uint64_t, Entry> entries;
+    size_t buildCount;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef VERTEX_FORMAT_H
+# define VERTEX_FORMAT_H
+
+# include "glad.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <string>
+# include <vector>
+
+// Layout of interleaved vertex data, matched to shader attributes by name
+// (aPos, aColor, aTexCoord, aNormal, ...). Elements may be quantized:
+// GL_HALF_FLOAT positions, normalized GL_SHORT / GL_INT_2_10_10_10_REV
+// normals, normalized GL_UNSIGNED_SHORT texture coordinates.
+// A format with a divisor describes per-instance data instead.
+class VertexFormat {
+public:
+    struct Element {
+        std::string name;
+        GLint components;
+        GLenum type;
+        bool normalized;    // fixed point mapped to [0, 1] / [-1, 1]
+        bool integer;       // fed to an int / ivec input (glVertexAttribIPointer)
+        GLint columns;      // > 1 for matrices, one location per column
+        GLuint offset;
+    };
+
+    // divisor 0: per vertex, N: advances every N instances
+    explicit VertexFormat(GLuint divisor = 0);
+
+    // appended after the previous element
+    VertexFormat &add(const std::string &name, GLint components, GLenum type, bool normalized = false);
+    VertexFormat &addInteger(const std::string &name, GLint components, GLenum type);
+    // GL_FLOAT column-major matrix input such as mat4
+    VertexFormat &addMatrix(const std::string &name, GLint columns, GLint rows);
+    // unused bytes, e.g. to keep the stride a multiple of 4
+    VertexFormat &pad(GLuint bytes);
+
+    const std::vector<Element> &elements() const;
+    const Element *find(const std::string &name) const;
+    GLsizei stride() const;
+    GLuint divisor() const;
+    // identifies the layout (names, types, offsets); equal formats share VAOs
+    uint64_t hash() const;
+
+    // sets the attribute pointers for element, vertex buffer bound to
+    // GL_ARRAY_BUFFER; baseOffset is where the first vertex starts
+    void setPointer(const Element &element, GLuint location, GLintptr baseOffset = 0) const;
+
+    static GLuint typeSize(GLenum type, GLint components);
+
+private:
+    VertexFormat &append(const std::string &name, GLint components, GLenum type, bool normalized, bool integer,
+                         GLint columns);
+
+    std::vector<Element> list;
+    GLuint size;
+    GLuint instanceDivisor;
+    uint64_t key;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef COMPUTE_SHADER_H
+# define COMPUTE_SHADER_H
+
+# include "glad.h"
+# include "Shader/UniformTable.h"
+
+# include <string>
+
+// A single compute stage program (GL 4.3 / ARB_compute_shader). Built
+// synchronously: compute passes are few and small, and a pass that fails
+// to build leaves its caller on the CPU path. Uniform blocks use explicit
+// layout(binding = N) in the source, which GLSL 4.30 allows. Uniforms are
+// staged and filtered like Shader's, through a UniformTable.
+class ComputeShader {
+public:
+    // defines ("#define NAME\n" lines) are inserted after #version
+    explicit ComputeShader(const char *path, const std::string &defines = "");
+    ~ComputeShader();
+
+    // the context runs compute shaders with shader storage buffers
+    static bool supported();
+
+    bool isFailed() const;
+    const std::string &path() const;
+    GLuint id() const;
+    // use/activate the program, then flush() the staged uniforms
+    void use() const;
+    // uniform lookups, served from the table built after linking
+    UniformHandle uniform(const UniformName &name) const;
+    // -1 for names the program does not use
+    GLint location(const UniformName &name) const;
+
+    // setters only stage the value, see UniformTable
+    void setInt(UniformHandle handle, int value) const;
+    void setUint(UniformHandle handle, GLuint value) const;
+    void setVec4(UniformHandle handle, float x, float y, float z, float w) const;
+    // count is the number of elements
+    void setIVec4Array(UniformHandle handle, const int *values, int count) const;
+    // uploads every dirty uniform, the program must be in use
+    void flush() const;
+    // groups of the local size declared in the source
+    void dispatch(GLuint groupsX, GLuint groupsY = 1, GLuint groupsZ = 1) const;
+
+private:
+    ComputeShader(const ComputeShader &);
+    ComputeShader &operator=(const ComputeShader &);
+
+    std::string sourcePath;
+    GLuint program;
+    UniformTable uniformTable;
+};
+
+#endif
@@ -2,12 +2,41 @@
 # define SHADER_H
 
 # include "glad.h"
+# include "Shader/UniformTable.h"
 
+# include <cstdint>
 # include <string>
+# include <vector>
 # include <fstream>
 # include <sstream>
 # include <iostream>
 
+# ifndef GL_COMPLETION_STATUS_KHR
+#  define GL_COMPLETION_STATUS_KHR 0x91B1
+# endif
+
+// C++ side description of a std140 block, checked against every program
+// that declares a block of that name; offsets from offsetof()
+struct UniformBlockMember {
+    const char *name;
+    GLint offset;
+};
+
+struct UniformBlockLayout {
+    std::string name;
+    GLuint binding;
+    GLint size;         // sizeof() the C++ struct
+    std::vector<UniformBlockMember> members;
+};
+
+// active vertex input of a linked program
+struct ShaderAttribute {
+    std::string name;
+    GLint location;
+    GLenum type;        // GL_FLOAT_VEC3, GL_INT, ...
+    GLint size;
+};
+
 class Shader {
 public:
     // the program ID
@@ -15,14 +44,122 @@ public:
     std::string vertSource;
     std::string fragSource;
 
-    // constructor reads and builds the shader
-    Shader(const char* vertexPath, const char* fragmentPath);
-    // use/activate the shader
+    // linked programs are cached here, keyed by sources and driver
+    static std::string binaryCacheDirectory;
+
+    // constructor reads and builds the shader; in async mode it only issues
+    // the compile and link, and isReady() must be polled before use().
+    // defines ("#define NAME\n" lines) are inserted after #version in both stages
+    Shader(const char* vertexPath, const char* fragmentPath, bool async = false,
+           const std::string &defines = "");
+    // inserts text on the line following the #version directive
+    static std::string injectDefines(const std::string &source, const std::string &defines);
+    // polls an async build without blocking when the driver compiles in
+    // parallel (KHR_parallel_shader_compile), otherwise finishes it now.
+    // During a reload the previous program stays ready until the swap.
+    bool isReady();
+    bool isPending() const;
+    bool isFailed() const;
+    // re-reads both files and rebuilds asynchronously; ID switches to the new
+    // program once isReady() sees it linked, and stays on the old one if it fails
+    bool reload();
+    const std::string &vertexPath() const;
+    const std::string &fragmentPath() const;
+    // blocks are bound to their binding point after every link; define them
+    // before the shaders that use them are built
+    static void defineUniformBlock(const UniformBlockLayout &layout);
+    // false when a block of the last link disagrees with its C++ layout
+    bool uniformBlocksValid() const;
+    // active attributes of the last link, sorted by location, and a hash of
+    // them: programs with equal signatures can share vertex arrays
+    const std::vector<ShaderAttribute> &attributes() const;
+    uint64_t attributeSignature() const;
+    // use/activate the shader, then flush() the staged uniforms
     void use();
+    // uniform lookups, served from the table built after linking
+    UniformHandle uniform(const UniformName &name) const;
+    GLint location(const UniformName &name) const;
+
     // utility uniform functions
+    // Setters only write a CPU-side shadow copy; a value equal to the shadow
+    // is dropped, anything else is marked dirty and uploaded by the next
+    // flush(), which needs the program to be in use. Matrices are column-major.
     void setBool(const std::string &name, bool value) const;  
     void setInt(const std::string &name, int value) const;   
     void setFloat(const std::string &name, float value) const;
+    void setVec2(const std::string &name, float x, float y) const;
+    void setVec3(const std::string &name, float x, float y, float z) const;
+    void setVec4(const std::string &name, float x, float y, float z, float w) const;
+    void setMat3(const std::string &name, const float *value) const;
+    void setMat4(const std::string &name, const float *value) const;
+
+    void setBool(UniformHandle handle, bool value) const;
+    void setInt(UniformHandle handle, int value) const;
+    void setFloat(UniformHandle handle, float value) const;
+    void setVec2(UniformHandle handle, float x, float y) const;
+    void setVec2(UniformHandle handle, const float *value) const;
+    void setVec3(UniformHandle handle, float x, float y, float z) const;
+    void setVec3(UniformHandle handle, const float *value) const;
+    void setVec4(UniformHandle handle, float x, float y, float z, float w) const;
+    void setVec4(UniformHandle handle, const float *value) const;
+    void setMat3(UniformHandle handle, const float *value) const;
+    void setMat4(UniformHandle handle, const float *value) const;
+
+    // array setters, count is the number of elements
+    void setIntArray(UniformHandle handle, const int *values, int count) const;
+    void setIVec2Array(UniformHandle handle, const int *values, int count) const;
+    void setFloatArray(UniformHandle handle, const float *values, int count) const;
+    void setVec2Array(UniformHandle handle, const float *values, int count) const;
+    void setVec3Array(UniformHandle handle, const float *values, int count) const;
+    void setVec4Array(UniformHandle handle, const float *values, int count) const;
+    void setMat4Array(UniformHandle handle, const float *values, int count) const;
+
+    // uploads every dirty uniform with one glUniform* each
+    void flush() const;
+    // glUniform* calls issued / dropped as redundant since the last reset
+    size_t uploadedUniforms() const;
+    size_t skippedUniforms() const;
+    void resetUniformStats() const;
+
+private:
+    enum class Status {
+        PENDING, READY, FAILED
+    };
+
+    Shader(const Shader &);
+    Shader &operator=(const Shader &);
+
+    // build phases: beginBuild() issues work, finishBuild() checks it and
+    // swaps the new program in; on failure the previous ID is kept
+    static bool parallelCompileSupported();
+    bool readSources();
+    void beginBuild();
+    bool finishBuild();
+    void discardPending();
+    // program binary cache, transparent fallback to compiling from source
+    static bool binaryCacheSupported();
+    static std::string binaryCachePath(uint64_t key);
+    uint64_t binaryCacheKey() const;
+    GLuint loadProgramBinary() const;
+    void saveProgramBinary() const;
+    // binds and validates GL_ACTIVE_UNIFORM_BLOCKS against the defined layouts
+    void bindUniformBlocks();
+    void reflectAttributes();
+    static std::vector<UniformBlockLayout> &blockLayouts();
+
+    // rebuilt from the reflection after every link
+    UniformTable uniformTable;
+
+    std::string vertPath;
+    std::string fragPath;
+    std::string defineText;
+    std::vector<ShaderAttribute> activeAttributes;
+    uint64_t signature;
+    Status status;
+    bool blocksValid;
+    GLuint pendingVertex;
+    GLuint pendingFragment;
+    GLuint pendingProgram;
 };
 
 #endif
\ No newline at end of file
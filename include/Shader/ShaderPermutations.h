@@ -0,0 +1,79 @@
+#ifndef SHADER_PERMUTATIONS_H
+# define SHADER_PERMUTATIONS_H
+
+# include "Shader/Shader.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <functional>
+# include <string>
+# include <unordered_map>
+# include <vector>
+
+// Feature variants of one vertex/fragment pair. A variant is the source with
+// one #define per feature bit, compiled the first time it is requested and
+// cached by its bitmask; variants nobody asks for are never compiled.
+//
+// Draws are submitted with their variant and replayed by flush() sorted by
+// key, so each variant is bound once per flush.
+class ShaderPermutations {
+public:
+    enum Feature {
+        TEXTURED        = 1 << 0,   // sampler2D texture1, aTexCoord at location 2
+        VERTEX_COLOR    = 1 << 1,   // aColor at location 1
+        LIT             = 1 << 2,   // aNormal at location 3, uniform vec3 lightDir
+        WIREFRAME       = 1 << 3,   // uniform vec4 wireColor, with glPolygonMode(GL_LINE)
+        INSTANCED       = 1 << 4,   // aInstanceModel / aInstanceColor, see InstanceBuffer
+        MULTI_DRAW      = 1 << 5,   // per-draw data from a texture buffer, see MultiDrawBatch
+        TEXTURE_ARRAY   = 1 << 6,   // sampler2DArray materialTextures, layer from the per-draw color's alpha
+        FEATURE_COUNT   = 7
+    };
+
+    // async: variants compile in the background and are skipped by flush()
+    // (or replaced by the fallback) until ready
+    ShaderPermutations(const std::string &vertexPath, const std::string &fragmentPath, bool async = true);
+    ~ShaderPermutations();
+
+    // the variant for a feature mask, compiled on first use
+    Shader &get(uint32_t features);
+    bool has(uint32_t features) const;
+    size_t variantCount() const;
+    // deletes every compiled variant; needs the context, so call it before
+    // the window is destroyed
+    void clear();
+    // rebuilds every compiled variant from disk (see Shader::reload)
+    size_t reload();
+    const std::string &vertexPath() const;
+    const std::string &fragmentPath() const;
+    static std::string defines(uint32_t features);
+
+    // drawn in place of variants that are still compiling; may be NULL
+    void setFallback(Shader *shader);
+
+    // queues a draw; the variant is already bound when it is called, uniforms
+    // it sets need a shader.flush() before its draw call
+    void submit(uint32_t features, const std::function<void(Shader &)> &draw);
+    // replays the queued draws sorted by variant, then clears the queue
+    void flush();
+    // glUseProgram calls made by the last flush()
+    size_t programSwitches() const;
+
+private:
+    ShaderPermutations(const ShaderPermutations &);
+    ShaderPermutations &operator=(const ShaderPermutations &);
+
+    struct Draw {
+        uint32_t features;
+        std::function<void(Shader &)> draw;
+    };
+
+    std::string vertPath;
+    std::string fragPath;
+    bool async;
+    Shader *fallback;
+    std::unordered_map<uint32_t, Shader *> variants;
+    std::vector<Draw> queue;
+    size_t switches;
+};
+
+#endif
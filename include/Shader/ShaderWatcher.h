@@ -0,0 +1,69 @@
+#ifndef SHADER_WATCHER_H
+# define SHADER_WATCHER_H
+
+# include "Shader/Shader.h"
+# include "Shader/ShaderPermutations.h"
+
+# include <atomic>
+# include <cstddef>
+# include <ctime>
+# include <map>
+# include <mutex>
+# include <string>
+# include <thread>
+# include <vector>
+
+// Hot reload: a background thread watches the shader directories (inotify
+// on Linux, mtime polling elsewhere) and records which files changed.
+// update(), called once per frame on the GL thread, rebuilds the shaders
+// using those files through the async path; a shader keeps drawing with
+// its previous program until the new one links, and keeps it for good if
+// the edit does not compile.
+class ShaderWatcher {
+public:
+    ShaderWatcher(const std::vector<std::string> &directories = defaultDirectories());
+    ~ShaderWatcher();
+
+    static std::vector<std::string> defaultDirectories();
+
+    // watched objects must outlive the watcher or be unwatched
+    void watch(Shader &shader);
+    void watch(ShaderPermutations &permutations);
+    void unwatch(Shader &shader);
+    void unwatch(ShaderPermutations &permutations);
+
+    // starts rebuilds for the files changed since the last call and polls
+    // the ones in flight; returns the number of rebuilds started
+    size_t update();
+
+    // false when the stat polling fallback is in use
+    bool usesInotify() const;
+    // changed files seen since the last update(), canonical paths
+    std::vector<std::string> takeChanges();
+
+private:
+    ShaderWatcher(const ShaderWatcher &);
+    ShaderWatcher &operator=(const ShaderWatcher &);
+
+    static std::string canonicalPath(const std::string &path);
+    static bool isShaderFile(const std::string &name);
+    void pushChange(const std::string &path);
+    void inotifyLoop();
+    void pollLoop();
+    void scan(std::map<std::string, time_t> &mtimes, bool report);
+
+    std::vector<std::string> directories;
+    std::vector<Shader *> shaders;
+    std::vector<ShaderPermutations *> permutations;
+    std::vector<Shader *> reloading;
+
+    int inotifyFd;
+    std::map<int, std::string> watchDirectory;  // inotify watch descriptor -> directory
+
+    std::thread worker;
+    std::atomic<bool> stop;
+    std::mutex mutex;
+    std::vector<std::string> changes;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef UNIFORM_BLOCKS_H
+# define UNIFORM_BLOCKS_H
+
+# include "Shader/Shader.h"
+# include "Core/Math.h"
+
+# include <cstddef>
+# include <cstdint>
+
+// C++ mirrors of the std140 blocks declared in the shaders. Every member
+// sits at its std140 offset (vec4 and mat4 columns on 16 bytes), padding is
+// explicit, and Shader validates the offsets after each link.
+
+enum UniformBinding {
+    FRAME_BINDING = 0,
+    MATERIAL_BINDING = 1
+};
+
+// layout(std140) uniform Frame, written once per frame
+struct FrameBlock {
+    Mat4 view;
+    Mat4 projection;
+    Mat4 viewProjection;
+    float time;
+    float pad[3];
+};
+
+// layout(std140) uniform Material, one entry per material, bound per draw
+struct MaterialBlock {
+    Vec4 baseColor;
+    float shininess;
+    int32_t flags;
+    float pad[2];
+};
+
+static_assert(sizeof(FrameBlock) == 208, "FrameBlock does not match std140");
+static_assert(sizeof(MaterialBlock) == 32, "MaterialBlock does not match std140");
+
+class UniformBlocks {
+public:
+    static UniformBlockLayout frameLayout()
+    {
+        UniformBlockLayout layout;
+        layout.name = "Frame";
+        layout.binding = FRAME_BINDING;
+        layout.size = sizeof(FrameBlock);
+        add(layout, "view", offsetof(FrameBlock, view));
+        add(layout, "projection", offsetof(FrameBlock, projection));
+        add(layout, "viewProjection", offsetof(FrameBlock, viewProjection));
+        add(layout, "time", offsetof(FrameBlock, time));
+        return layout;
+    }
+
+    static UniformBlockLayout materialLayout()
+    {
+        UniformBlockLayout layout;
+        layout.name = "Material";
+        layout.binding = MATERIAL_BINDING;
+        layout.size = sizeof(MaterialBlock);
+        add(layout, "baseColor", offsetof(MaterialBlock, baseColor));
+        add(layout, "shininess", offsetof(MaterialBlock, shininess));
+        add(layout, "materialFlags", offsetof(MaterialBlock, flags));
+        return layout;
+    }
+
+    // call once before building the shaders
+    static void define()
+    {
+        Shader::defineUniformBlock(frameLayout());
+        Shader::defineUniformBlock(materialLayout());
+    }
+
+private:
+    static void add(UniformBlockLayout &layout, const char *name, size_t offset)
+    {
+        UniformBlockMember member = { name, static_cast<GLint>(offset) };
+        layout.members.push_back(member);
+    }
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef UNIFORM_BUFFER_H
+# define UNIFORM_BUFFER_H
+
+# include "glad.h"
+# include "Core/StreamBuffer.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <vector>
+
+// Array of std140 blocks in one GL_UNIFORM_BUFFER, each entry aligned to
+// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT so a draw selects its entry with a
+// single glBindBufferRange.
+//
+// Without a stream the blocks live in their own buffer, for data that
+// rarely changes. With one, every frame's upload is a fresh allocation of
+// the StreamBuffer, so it never touches data the GPU may still read for
+// the previous frames.
+class UniformBuffer {
+public:
+    UniformBuffer(GLuint binding, size_t blockSize, size_t count = 1, StreamBuffer *stream = NULL);
+    ~UniformBuffer();
+
+    // CPU copy of an entry of the current region
+    void *entry(size_t index);
+    template <typename T>
+    T &as(size_t index) { return *static_cast<T *>(entry(index)); }
+    void write(size_t index, const void *data);
+
+    // sends the entries if they changed, or if the stream moved to a new
+    // frame since the last upload
+    void upload();
+    // binds entry index of the last upload to the block's binding point
+    void bind(size_t index = 0);
+
+    GLuint buffer() const;
+    size_t stride() const;
+    size_t count() const;
+
+private:
+    UniformBuffer(const UniformBuffer &);
+    UniformBuffer &operator=(const UniformBuffer &);
+
+    GLuint binding;
+    size_t blockSize;
+    size_t entryStride;
+    size_t entryCount;
+    StreamBuffer *stream;
+    StreamBuffer::Allocation current;
+    uint64_t uploadedFrame;
+    GLuint id;
+    std::vector<uint8_t> staging;
+    bool dirty;
+};
+
+#endif
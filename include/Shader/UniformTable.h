@@ -0,0 +1,84 @@
+#ifndef UNIFORM_TABLE_H
+# define UNIFORM_TABLE_H
+
+# include "glad.h"
+# include "Core/Hash.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <string>
+# include <vector>
+
+// uniform name hashed at compile time when declared constexpr,
+// e.g. constexpr UniformName TIME("time");
+struct UniformName {
+    constexpr UniformName(const char *name) : name(name), hash(Hash::fnv1a32(name)) {}
+
+    const char *name;
+    uint32_t hash;
+};
+
+// pre-resolved uniform: an index into the shader's uniform table
+struct UniformHandle {
+    UniformHandle() : index(-1) {}
+    explicit UniformHandle(int index) : index(index) {}
+    bool valid() const { return index >= 0; }
+
+    int index;
+};
+
+// The uniforms of one program, shared by Shader and ComputeShader. Names
+// map to entries through a flat open addressing table; each entry keeps a
+// CPU-side shadow copy of its last staged value. A value equal to the
+// shadow is dropped, anything else is marked dirty and uploaded by the
+// next flush(), which needs the program to be in use.
+class UniformTable {
+public:
+    // how a staged value is uploaded
+    enum class Kind {
+        NONE, INT, FLOAT, VEC2, VEC3, VEC4, MAT3, MAT4, IVEC2, UINT, IVEC4
+    };
+
+    UniformTable();
+
+    // enumerates GL_ACTIVE_UNIFORMS of a newly linked program
+    void reflect(GLuint program);
+    // names missing from the reflection are resolved once and cached
+    UniformHandle uniform(GLuint program, const UniformName &name) const;
+    // -1 for names the program does not use
+    GLint location(UniformHandle handle) const;
+
+    void stage(UniformHandle handle, Kind kind, const void *data, GLsizei count) const;
+    // uploads every dirty uniform with one glUniform* each
+    void flush() const;
+    // glUniform* calls issued / dropped as redundant since the last reset
+    size_t uploadedUniforms() const;
+    size_t skippedUniforms() const;
+    void resetStats() const;
+
+private:
+    struct Uniform {
+        std::string name;
+        uint32_t hash;
+        GLint location;     // -1 for names the program does not use
+        GLenum type;
+        GLint size;         // array length
+        Kind kind;          // of the last staged value
+        GLsizei count;      // elements staged
+        bool dirty;
+        std::vector<uint32_t> shadow;
+    };
+
+    int find(const char *name, uint32_t hash) const;
+    int add(const std::string &name, uint32_t hash, GLint location, GLenum type, GLint size) const;
+    void registerUniform(const std::string &name, GLint location, GLenum type, GLint size);
+
+    // power of two sized slots of indices into uniforms
+    mutable std::vector<Uniform> uniforms;
+    mutable std::vector<int> slots;
+    mutable std::vector<int> dirty;
+    mutable size_t uploadCount;
+    mutable size_t skipCount;
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef SCOPTEX_H
+# define SCOPTEX_H
+
+# include "glad.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <string>
+# include <vector>
+
+// .scoptex: precomputed texture container.
+// Layout: Header, then header.mipCount MipEntry records, then the payload of
+// each mip at its (16-byte aligned) offset from the start of the file.
+// Files are memory mapped and every mip is uploaded straight from the
+// mapping, so a cached texture costs one map instead of a decode.
+class ScopTex {
+public:
+    enum class Format : uint32_t {
+        RGBA8 = 1,
+        BGRA8 = 2,
+        BC1 = 3,
+        BC3 = 4
+    };
+
+    struct Header {
+        char magic[4];          // "SCPT"
+        uint32_t version;
+        uint32_t format;        // Format
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipCount;
+        uint64_t sourceSize;    // size of the file the payload was built from
+        int64_t sourceMtime;    // modification time of that file
+    };
+
+    struct MipEntry {
+        uint64_t offset;        // from the start of the file
+        uint64_t size;          // payload bytes
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // a mip to be written, data is not owned
+    struct Level {
+        int width;
+        int height;
+        const void *data;
+        size_t size;
+    };
+
+    // read-only memory mapping of a .scoptex file
+    class Mapping {
+    public:
+        Mapping();
+        ~Mapping();
+
+        bool open(const std::string &path);
+        void close();
+        bool isOpen() const;
+
+        const Header &header() const;
+        Format format() const;
+        const MipEntry &mip(uint32_t level) const;
+        const uint8_t *mipData(uint32_t level) const;
+        // true when the mapping was built from filename as it is now on disk
+        bool matchesSource(const std::string &filename) const;
+
+    private:
+        Mapping(const Mapping &);
+        Mapping &operator=(const Mapping &);
+
+        void *base;
+        size_t length;
+    };
+
+    // directory the containers are cached in
+    static std::string cacheDirectory;
+
+    static bool ensureCacheDirectory();
+    // cache location for a given source path / content hash
+    static std::string cachePathForSource(const std::string &filename);
+    static std::string cachePathForHash(uint64_t hash);
+
+    static size_t levelSize(Format format, int width, int height);
+    static bool write(const std::string &path, Format format, int width, int height,
+                      const std::vector<Level> &mips, const std::string &sourceFile);
+    // uploads every mip from the mapping; false when the format is unsupported
+    static bool upload(const Mapping &mapping, GLuint textureID);
+
+private:
+    static bool sourceStat(const std::string &filename, uint64_t &size, int64_t &mtime);
+};
+
+#endif
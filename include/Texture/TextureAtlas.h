@@ -0,0 +1,111 @@
+#ifndef TEXTURE_ATLAS_H
+# define TEXTURE_ATLAS_H
+
+# include "glad.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <string>
+# include <vector>
+
+// Skyline bottom-left rectangle packer
+class SkylinePacker {
+public:
+    struct Rect {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    SkylinePacker(int width, int height);
+
+    // false when the rectangle no longer fits
+    bool insert(int width, int height, Rect &out);
+
+private:
+    struct Segment {
+        int x;
+        int y;
+        int width;
+    };
+
+    // top of a width x height rectangle placed at segment index, -1 if it does not fit
+    int fit(size_t index, int width, int height) const;
+
+    int width;
+    int height;
+    std::vector<Segment> skyline;
+};
+
+// Packs many small textures into one, so draws that only differ by material
+// texture can share a single bind. Every image is surrounded by a gutter of
+// replicated edge texels and placed on a 4 texel grid, which keeps the first
+// mip levels free of bleeding from neighbours. UVs must lie in [0, 1]:
+// repeating textures cannot be atlased.
+class TextureAtlas {
+public:
+    struct Region {
+        float u0;
+        float v0;
+        float u1;
+        float v1;
+    };
+
+    TextureAtlas(int maxSize = 4096, int padding = 4);
+
+    // returns the index used to query the image's region
+    int add(const std::vector<uint8_t> &rgba, int width, int height);
+    int addBMP(const std::string &filename);
+
+    // packs every image and uploads the atlas; false when they do not fit maxSize
+    bool build(GLuint textureID, bool mipmaps = true);
+
+    const Region &region(int index) const;
+    size_t imageCount() const;
+    int width() const;
+    int height() const;
+
+    // rewrites interleaved UVs of a mesh into the image's atlas rectangle
+    void remapUVs(int index, float *vertices, size_t vertexCount,
+                  size_t strideFloats, size_t uvOffsetFloats) const;
+
+private:
+    struct Image {
+        int width;
+        int height;
+        std::vector<uint8_t> rgba;
+        SkylinePacker::Rect rect;   // including the gutter
+    };
+
+    bool pack(int atlasWidth, int atlasHeight, const std::vector<size_t> &order);
+    std::vector<uint8_t> compose() const;
+
+    int maxSize;
+    int padding;
+    int atlasWidth;
+    int atlasHeight;
+    std::vector<Image> images;
+    std::vector<Region> regions;
+};
+
+// Same-size textures as layers of a GL_TEXTURE_2D_ARRAY; a draw selects its
+// texture with a layer index instead of a glBindTexture.
+class TextureArrayBuilder {
+public:
+    TextureArrayBuilder();
+
+    // returns the layer index; every layer must have the size of the first
+    int add(const std::vector<uint8_t> &rgba, int width, int height);
+    int addBMP(const std::string &filename);
+
+    void build(GLuint textureID, bool mipmaps = true);
+    int layerCount() const;
+
+private:
+    int width;
+    int height;
+    std::vector<uint8_t> texels;
+};
+
+#endif
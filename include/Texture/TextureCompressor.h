@@ -0,0 +1,73 @@
+#ifndef TEXTURE_COMPRESSOR_H
+# define TEXTURE_COMPRESSOR_H
+
+# include "glad.h"
+
+# include <cstdint>
+# include <string>
+# include <vector>
+
+# ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#  define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+# endif
+# ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#  define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+# endif
+
+// BC1/BC3 (DXT1/DXT5) block encoder for decoded BMP data.
+// Blocks are encoded on all cores and the resulting mip chain is cached on
+// disk as a .scoptex keyed by the hash of the source file, so a texture is
+// only ever encoded once per content.
+class TextureCompressor {
+public:
+    enum class Format : uint32_t {
+        BC1 = 1,    // opaque, 8 bytes per 4x4 block
+        BC3 = 3     // interpolated alpha, 16 bytes per 4x4 block
+    };
+
+    struct MipLevel {
+        int width;
+        int height;
+        std::vector<uint8_t> data;
+    };
+
+    struct CompressedImage {
+        Format format;
+        int width;
+        int height;
+        std::vector<MipLevel> mips;
+    };
+
+    // BC3 when any texel is translucent, BC1 otherwise
+    static Format chooseFormat(const std::vector<uint8_t> &rgba);
+    // encodes an RGBA8 image and its box-filtered mip chain
+    static CompressedImage compress(const std::vector<uint8_t> &rgba, int width, int height,
+                                    Format format, bool generateMips = true);
+
+    // single block encoders; rgba points to 16 texels in row order
+    static void encodeBC1Block(const uint8_t *rgba, uint8_t *out);
+    static void encodeBC3Block(const uint8_t *rgba, uint8_t *out);
+
+    static size_t blockBytes(Format format);
+    static size_t levelSize(Format format, int width, int height);
+    static GLenum glFormat(Format format);
+
+    // true when the context can sample S3TC textures
+    static bool isSupported();
+    static void upload(const CompressedImage &image, GLuint textureID);
+    // 2x2 box filter, used for mip chains and budget-driven downscaling
+    static std::vector<uint8_t> downsample(const std::vector<uint8_t> &rgba, int width, int height,
+                                           int &outWidth, int &outHeight);
+
+    // loads a BMP into textureID as BC1/BC3, using the disk cache when
+    // possible; falls back to an uncompressed upload without S3TC support
+    static void loadBMPTexture(const std::string &filename, GLuint textureID);
+
+private:
+    static void writeCache(const std::string &path, const CompressedImage &image,
+                           const std::string &sourceFile);
+    static void encodeLevel(const std::vector<uint8_t> &rgba, int width, int height,
+                            Format format, std::vector<uint8_t> &out);
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef TEXTURE_MANAGER_H
+# define TEXTURE_MANAGER_H
+
+# include "glad.h"
+
+# include <cstddef>
+# include <cstdint>
+# include <string>
+# include <unordered_map>
+# include <vector>
+
+class TextureManager;
+class TextureStreamer;
+
+// reference-counted handle to a texture owned by a TextureManager;
+// handles must not outlive their manager
+class TextureHandle {
+public:
+    TextureHandle();
+    TextureHandle(const TextureHandle &other);
+    TextureHandle &operator=(const TextureHandle &other);
+    ~TextureHandle();
+
+    bool valid() const;
+    GLuint id() const;
+    // binds to the given texture unit and marks the texture as used this frame
+    void bind(unsigned unit = 0) const;
+    void reset();
+
+private:
+    friend class TextureManager;
+    TextureHandle(TextureManager *manager, uint32_t entry);
+
+    TextureManager *manager;
+    uint32_t entry;
+};
+
+// Front end for BMP textures: loads are deduplicated by path and by content
+// hash, and VRAM use is tracked against a budget. When over budget the least
+// recently used unreferenced textures are deleted first, then referenced
+// ones lose their largest mip level, oldest first, from their own GPU data.
+//
+// With a TextureStreamer, uncompressed loads only allocate the texture and
+// its texels arrive over the streamer's update()s instead of in load().
+class TextureManager {
+public:
+    // compress selects BC1/BC3 uploads through TextureCompressor
+    explicit TextureManager(size_t budgetBytes = 256u * 1024u * 1024u, bool compress = false);
+    ~TextureManager();
+
+    TextureHandle load(const std::string &filename);
+    // streams later uncompressed loads; NULL uploads them in load(). The
+    // streamer must outlive the manager's textures
+    void setStreamer(TextureStreamer *streamer);
+
+    // advances the LRU clock and evicts down to the budget
+    void beginFrame();
+    void setBudget(size_t bytes);
+    size_t budget() const;
+    size_t usage() const;
+    size_t textureCount() const;
+
+private:
+    friend class TextureHandle;
+
+    TextureManager(const TextureManager &);
+    TextureManager &operator=(const TextureManager &);
+
+    struct Entry {
+        GLuint id;
+        std::string path;           // first path the content was loaded from
+        uint64_t contentHash;
+        unsigned refs;
+        uint64_t lastUsed;          // frame of the last bind
+        int droppedLevels;          // mips removed to meet the budget
+        size_t bytes;
+        bool alive;
+    };
+
+    void retain(uint32_t entry);
+    void release(uint32_t entry);
+    void touch(uint32_t entry);
+    void enforceBudget();
+    void evict(uint32_t entry);
+    bool dropLevel(uint32_t entry);
+    void upload(const std::string &filename, GLuint textureID);
+    static size_t textureBytes(GLuint textureID);
+
+    size_t budgetBytes;
+    size_t usedBytes;
+    bool compress;
+    TextureStreamer *streamer;
+    uint64_t frame;
+    std::vector<Entry> entries;
+    std::vector<uint32_t> freeEntries;
+    std::unordered_map<std::string, uint32_t> byPath;
+    std::unordered_map<uint64_t, uint32_t> byHash;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef TEXTURE_STREAMER_H
+# define TEXTURE_STREAMER_H
+
+# include "glad.h"
+# include "BPMLoader.h"
+
+# include <cstddef>
+# include <deque>
+# include <fstream>
+# include <string>
+# include <vector>
+
+// Streams BMP texels to the GPU through a ring of pixel unpack buffers.
+// Each queued texture is split into row bands ("tiles") that are decoded
+// straight into a mapped PBO and uploaded with glTexSubImage2D; update()
+// only issues as many tiles as fit in the frame's time budget, and every
+// PBO is fenced so it is never rewritten while the GPU still reads it.
+// A file that turns out short or unreadable mid-stream is reported and
+// dropped; its texture keeps the rows that made it and is failed().
+class TextureStreamer {
+public:
+    // slotSize is the largest tile in bytes, slotCount the ring length
+    TextureStreamer(size_t slotSize = 256 * 1024, unsigned slotCount = 8);
+    ~TextureStreamer();
+
+    // allocates storage for textureID now, texels arrive over later update()s
+    void queueBMP(const std::string &filename, GLuint textureID);
+    // uploads tiles until budgetMs is spent or the ring is busy
+    void update(double budgetMs = 1.0);
+
+    bool idle() const;
+    // texels of textureID are still queued
+    bool pending(GLuint textureID) const;
+    // streaming textureID stopped on a read or mapping error
+    bool failed(GLuint textureID) const;
+    // forgets the rest of textureID, before it is deleted or respecified
+    void cancel(GLuint textureID);
+    bool isPersistent() const;
+    size_t pendingBytes() const;
+    // bytes uploaded by the last update()
+    size_t lastFrameBytes() const;
+
+private:
+    TextureStreamer(const TextureStreamer &);
+    TextureStreamer &operator=(const TextureStreamer &);
+
+    struct Slot {
+        GLuint pbo;
+        uint8_t *mapped;    // persistent mapping, NULL without buffer storage
+        GLsync fence;       // signaled once the GPU consumed the slot
+    };
+
+    struct Job {
+        std::string filename;
+        GLuint texture;
+        std::ifstream file;
+        BMPLoader::BMPInfo info;
+        int nextRow;
+    };
+
+    bool acquireSlot(Slot &slot);
+    // false when the tile could not be read or mapped; nothing is left
+    // mapped and the job cannot continue
+    bool uploadTile(Job &job, Slot &slot, int rows);
+
+    size_t slotSize;
+    bool persistent;
+    std::vector<Slot> slots;
+    unsigned nextSlot;
+    std::deque<Job*> jobs;
+    std::vector<GLuint> failedTextures;
+    double averageTileMs;
+    size_t frameBytes;
+};
+
+#endif
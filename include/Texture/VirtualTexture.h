@@ -0,0 +1,131 @@
+#ifndef VIRTUAL_TEXTURE_H
+# define VIRTUAL_TEXTURE_H
+
+# include "glad.h"
+# include "BPMLoader.h"
+# include "Shader/Shader.h"
+
+# include <condition_variable>
+# include <cstddef>
+# include <cstdint>
+# include <deque>
+# include <mutex>
+# include <string>
+# include <thread>
+# include <vector>
+
+// Sparse virtual texture over a BMP too large for VRAM.
+// The source is split into PAGE_SIZE x PAGE_SIZE pages per mip level; only
+// pages seen by the feedback pass are decoded (by a background thread,
+// reading just the rows and columns they cover) and kept in a fixed
+// physical page cache. An indirection texture maps every virtual page to
+// the finest resident page covering it. The coarsest level is a single
+// page that stays resident, so every texel always has a fallback.
+//
+// Per frame:
+//   beginFeedback(); draw with shaders/fragment/vt_feedback.frag; endFeedback();
+//   update();
+//   draw with shaders/fragment/virtual_texture.frag after setUniforms()
+// Both passes use shaders/vertex/virtual_texture.vert, whose transform
+// (object to clip space) is the caller's to set for each draw.
+class VirtualTexture {
+public:
+    static const int PAGE_SIZE = 128;
+    static const int PAGE_BORDER = 1;
+    static const int SLOT_SIZE = PAGE_SIZE + 2 * PAGE_BORDER;
+    static const int MAX_LEVELS = 16;
+
+    // feedbackDivisor: the feedback pass renders at 1/feedbackDivisor of the screen
+    VirtualTexture(const std::string &filename, int physicalPagesX = 16, int physicalPagesY = 16,
+                   int feedbackDivisor = 8);
+    ~VirtualTexture();
+
+    // binds the low resolution feedback framebuffer, sized from the screen
+    void beginFeedback(int screenWidth, int screenHeight);
+    // queues the readback of this frame's feedback and requests the pages
+    // seen in the previous one (one frame of latency, no pipeline stall)
+    void endFeedback();
+    // uploads at most maxUploads decoded pages and refreshes the indirection
+    void update(int maxUploads = 8);
+
+    // stages the uniforms of virtual_texture.frag / vt_feedback.frag on
+    // shader, uploaded by its next use() or flush()
+    void setUniforms(const Shader &shader, int indirectionUnit, int physicalUnit) const;
+    void bindTextures(int indirectionUnit, int physicalUnit) const;
+
+    int width() const;
+    int height() const;
+    int levelCount() const;
+    size_t residentPages() const;
+    size_t pendingPages() const;
+
+private:
+    VirtualTexture(const VirtualTexture &);
+    VirtualTexture &operator=(const VirtualTexture &);
+
+    struct LoadedPage {
+        uint32_t id;
+        std::vector<uint8_t> texels;    // SLOT_SIZE x SLOT_SIZE RGBA
+    };
+
+    enum PageState {
+        PAGE_ABSENT = 0,
+        PAGE_QUEUED = 1,
+        PAGE_RESIDENT = 2
+    };
+
+    uint32_t pageId(int level, int x, int y) const;
+    void pageCoords(uint32_t id, int &level, int &x, int &y) const;
+    void processFeedback(const uint8_t *pixels, size_t count);
+    void requestPages(const std::vector<uint32_t> &pages);
+    int allocateSlot();
+    void rebuildIndirection();
+    void decodePage(std::ifstream &file, uint32_t id, std::vector<uint8_t> &texels) const;
+    void workerLoop();
+
+    std::string filename;
+    BMPLoader::BMPInfo info;
+    int levels;
+    int levelPagesX[MAX_LEVELS];
+    int levelPagesY[MAX_LEVELS];
+    uint32_t levelBase[MAX_LEVELS];     // first page id of each level
+    int levelRow[MAX_LEVELS];           // first indirection row of each level
+    uint32_t totalPages;
+    uint32_t pinnedPage;
+
+    // main thread state
+    int physicalPagesX;
+    int physicalPagesY;
+    int feedbackDivisor;
+    std::vector<uint8_t> pageState;
+    std::vector<int> pageSlot;
+    std::vector<int> slotPage;
+    std::vector<uint64_t> slotLastUsed;
+    std::vector<uint8_t> indirection;
+    std::vector<uint64_t> pageLastSeen;
+    std::deque<LoadedPage> uploadQueue;
+    bool indirectionDirty;
+    uint64_t frame;
+
+    GLuint physicalTexture;
+    GLuint indirectionTexture;
+    GLuint feedbackFbo;
+    GLuint feedbackColor;
+    GLuint feedbackDepth;
+    GLuint readbackPbo[2];
+    bool readbackPending[2];
+    int readbackIndex;
+    int feedbackWidth;
+    int feedbackHeight;
+    GLint previousViewport[4];
+
+    // shared with the worker thread
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable wakeWorker;
+    std::deque<uint32_t> requests;
+    std::vector<LoadedPage> completed;
+    bool stopWorker;
+};
+
+#endif
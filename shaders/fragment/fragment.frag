@@ -1,7 +1,43 @@
 #version 330 core
+// feature defines (TEXTURED, VERTEX_COLOR, LIT, WIREFRAME, INSTANCED,
+// MULTI_DRAW, TEXTURE_ARRAY) are inserted after the #version line by
+// ShaderPermutations
+#if defined(VERTEX_COLOR) || defined(INSTANCED) || defined(MULTI_DRAW)
+#define HAS_COLOR
+#endif
+#if defined(TEXTURED) || defined(TEXTURE_ARRAY)
+#define HAS_TEXCOORD
+#endif
 
 out vec4 FragColor;
+#ifdef HAS_COLOR
 in vec3 ourColor;
+#endif
+#ifdef HAS_TEXCOORD
+in vec2 TexCoord;
+#endif
+#ifdef TEXTURED
+uniform sampler2D texture1;
+#endif
+#ifdef TEXTURE_ARRAY
+// every material's texture as a layer, bound once for all of them
+flat in float Layer;
+uniform sampler2DArray materialTextures;
+#endif
+#ifdef LIT
+in vec3 Normal;
+uniform vec3 lightDir;
+#endif
+#ifdef WIREFRAME
+uniform vec4 wireColor;
+#endif
+
+// per-material data, see MaterialBlock in include/Shader/UniformBlocks.h
+layout (std140) uniform Material {
+    vec4 baseColor;
+    float shininess;
+    int materialFlags;
+};
 
 // uniform vec4 ourColor; GLOBAL VARIABLE BETWEEN SHADER PROGRAMS
 
@@ -14,6 +50,24 @@ void main()
     //FRAGMENT SHADER -> in vec3 vecPos;
     //FragColor = vec4(vecPos, 1.0); 
 
-
-    FragColor = vec4(ourColor, 1.0);
-}
\ No newline at end of file
+    vec4 color = baseColor;
+#ifdef HAS_COLOR
+    color.rgb *= ourColor;
+#endif
+#ifdef TEXTURED
+    color *= texture(texture1, TexCoord);
+#endif
+#ifdef TEXTURE_ARRAY
+    color *= texture(materialTextures, vec3(TexCoord, Layer));
+#endif
+#ifdef LIT
+    // half lambert keeps the unlit side readable
+    float diffuse = dot(normalize(Normal), -normalize(lightDir)) * 0.5 + 0.5;
+    color.rgb *= diffuse;
+#endif
+#ifdef WIREFRAME
+    // lines are drawn on top of the shaded pass, in a flat colour
+    color = wireColor;
+#endif
+    FragColor = color;
+}
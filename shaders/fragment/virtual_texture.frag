@@ -0,0 +1,40 @@
+#version 330 core
+
+// Samples a virtual texture through its indirection texture.
+// An indirection texel holds the physical slot (r, g) and the mip level (b)
+// of the finest resident page covering the virtual page; a = 0 when none is.
+out vec4 FragColor;
+in vec2 TexCoord;
+
+const float VT_PAGE_SIZE = 128.0;
+const float VT_PAGE_BORDER = 1.0;
+const float VT_SLOT_SIZE = VT_PAGE_SIZE + 2.0 * VT_PAGE_BORDER;
+
+uniform sampler2D vtIndirection;
+uniform sampler2D vtPhysical;
+uniform vec2 vtVirtualSize;
+uniform int vtMaxLevel;
+uniform ivec2 vtLevelPages[16];
+uniform int vtLevelRow[16];
+
+vec4 sampleVirtual(vec2 uv)
+{
+    vec2 texel = uv * vtVirtualSize;
+    float footprint = max(length(dFdx(texel)), length(dFdy(texel)));
+    int level = int(clamp(floor(log2(max(footprint, 1.0))), 0.0, float(vtMaxLevel)));
+    ivec2 page = clamp(ivec2(texel / (VT_PAGE_SIZE * exp2(float(level)))), ivec2(0), vtLevelPages[level] - 1);
+
+    vec4 entry = floor(texelFetch(vtIndirection, ivec2(page.x, vtLevelRow[level] + page.y), 0) * 255.0 + 0.5);
+    if (entry.a == 0.0)
+        return vec4(0.5, 0.5, 0.5, 1.0);
+
+    // position inside the resident page, which may be coarser than requested
+    vec2 within = fract(texel / (VT_PAGE_SIZE * exp2(entry.b)));
+    vec2 physical = entry.rg * VT_SLOT_SIZE + VT_PAGE_BORDER + within * VT_PAGE_SIZE;
+    return texture(vtPhysical, physical / vec2(textureSize(vtPhysical, 0)));
+}
+
+void main()
+{
+    FragColor = sampleVirtual(TexCoord);
+}
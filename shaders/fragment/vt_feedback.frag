@@ -0,0 +1,24 @@
+#version 330 core
+
+// Virtual texture feedback pass: writes the page each fragment needs.
+// r/g: low 8 bits of the page x/y, b: their high 4 bits, a: mip level + 1
+out vec4 FragColor;
+in vec2 TexCoord;
+
+const float VT_PAGE_SIZE = 128.0;
+
+uniform vec2 vtVirtualSize;
+uniform int vtMaxLevel;
+uniform ivec2 vtLevelPages[16];
+uniform float vtFeedbackBias;
+
+void main()
+{
+    vec2 texel = TexCoord * vtVirtualSize;
+    float footprint = max(length(dFdx(texel)), length(dFdy(texel)));
+    int level = int(clamp(floor(log2(max(footprint, 1.0)) + vtFeedbackBias), 0.0, float(vtMaxLevel)));
+    ivec2 page = clamp(ivec2(texel / (VT_PAGE_SIZE * exp2(float(level)))), ivec2(0), vtLevelPages[level] - 1);
+
+    FragColor = vec4(float(page.x & 255), float(page.y & 255),
+                     float((page.x >> 8) | ((page.y >> 8) << 4)), float(level + 1)) / 255.0;
+}
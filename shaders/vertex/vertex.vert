@@ -1,8 +1,50 @@
 #version 330 core
+// feature defines (TEXTURED, VERTEX_COLOR, LIT, WIREFRAME, INSTANCED,
+// MULTI_DRAW, TEXTURE_ARRAY) are inserted after the #version line by
+// ShaderPermutations
+#if defined(VERTEX_COLOR) || defined(INSTANCED) || defined(MULTI_DRAW)
+#define HAS_COLOR
+#endif
+#if defined(TEXTURED) || defined(TEXTURE_ARRAY)
+#define HAS_TEXCOORD
+#endif
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aColor;
 
+// per-frame data, see FrameBlock in include/Shader/UniformBlocks.h
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    float time;
+};
+#ifdef VERTEX_COLOR
+layout (location = 1) in vec3 aColor;
+#endif
+#ifdef HAS_COLOR
 out vec3 ourColor;
+#endif
+#ifdef HAS_TEXCOORD
+layout (location = 2) in vec2 aTexCoord;
+out vec2 TexCoord;
+#endif
+#ifdef TEXTURE_ARRAY
+flat out float Layer;
+#endif
+#ifdef LIT
+layout (location = 3) in vec3 aNormal;
+out vec3 Normal;
+#endif
+#ifdef INSTANCED
+// per instance, see InstanceData in include/Render/InstanceBuffer.h
+layout (location = 4) in mat4 aInstanceModel;
+layout (location = 8) in vec4 aInstanceColor;
+#endif
+#ifdef MULTI_DRAW
+// per draw, see MultiDrawBatch: 5 texels (model columns, color) per draw
+layout (location = 9) in int aDrawID;
+uniform int drawIDBase;
+uniform samplerBuffer drawData;
+#endif
 
 void main()
 {
@@ -13,6 +55,43 @@ void main()
     // vec4(aPos.x + offset, aPos.y, aPos.z, 1.0);
     // IN OpenGL Code -> shader.setFloat("offset", 0.1f);
     
-    ourColor = aColor;
-    gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);
-}
\ No newline at end of file
+#if defined(INSTANCED)
+    mat4 model = aInstanceModel;
+#elif defined(MULTI_DRAW)
+    int draw = (aDrawID + drawIDBase) * 5;
+    mat4 model = mat4(texelFetch(drawData, draw), texelFetch(drawData, draw + 1),
+                      texelFetch(drawData, draw + 2), texelFetch(drawData, draw + 3));
+#else
+    mat4 model = mat4(1.0);
+#endif
+#ifdef HAS_COLOR
+    ourColor = vec3(1.0);
+#endif
+#ifdef VERTEX_COLOR
+    ourColor *= aColor;
+#endif
+#ifdef INSTANCED
+    ourColor *= aInstanceColor.rgb;
+#endif
+#ifdef MULTI_DRAW
+    ourColor *= texelFetch(drawData, draw + 4).rgb;
+#endif
+#ifdef HAS_TEXCOORD
+    TexCoord = aTexCoord;
+#endif
+#ifdef TEXTURE_ARRAY
+    // the layer rides in the alpha of the per-draw color
+#if defined(INSTANCED)
+    Layer = aInstanceColor.a;
+#elif defined(MULTI_DRAW)
+    Layer = texelFetch(drawData, draw + 4).a;
+#else
+    Layer = 0.0;
+#endif
+#endif
+#ifdef LIT
+    // instance transforms are rotation and uniform scale only
+    Normal = mat3(model) * aNormal;
+#endif
+    gl_Position = viewProjection * model * vec4(aPos.x, aPos.y, aPos.z, 1.0);
+}
@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoord;
+
+out vec2 TexCoord;
+
+// object to clip space, set by the caller for each draw; the texture's own
+// uniforms come from VirtualTexture::setUniforms()
+uniform mat4 transform;
+
+void main()
+{
+    TexCoord = aTexCoord;
+    gl_Position = transform * vec4(aPos, 1.0);
+}
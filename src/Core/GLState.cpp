@@ -0,0 +1,368 @@
+#include "Core/GLState.h"
+
+#include <cstdio>
+
+namespace
+{
+    // "unknown": never equal to a value passed by the caller
+    const GLuint UNKNOWN = 0xFFFFFFFFu;
+    const int UNKNOWN_FLAG = -1;
+
+    const int MAX_UNITS = 32;
+    const int MAX_INDEXED = 16;
+
+    // buffer targets with a cached generic binding
+    const GLenum BUFFER_TARGETS[] = {
+        GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER,
+        GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_COPY_READ_BUFFER,
+        GL_COPY_WRITE_BUFFER, GL_TEXTURE_BUFFER, GL_DRAW_INDIRECT_BUFFER,
+        GL_DISPATCH_INDIRECT_BUFFER, GL_SHADER_STORAGE_BUFFER, GL_PARAMETER_BUFFER
+    };
+    const int BUFFER_TARGET_COUNT = sizeof(BUFFER_TARGETS) / sizeof(BUFFER_TARGETS[0]);
+
+    const GLenum TEXTURE_TARGETS[] = {
+        GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BUFFER
+    };
+    const int TEXTURE_TARGET_COUNT = sizeof(TEXTURE_TARGETS) / sizeof(TEXTURE_TARGETS[0]);
+
+    struct IndexedBinding {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    struct State {
+        GLuint program;
+        GLuint vao;
+        GLuint buffers[BUFFER_TARGET_COUNT];
+        IndexedBinding uniformBindings[MAX_INDEXED];
+        IndexedBinding storageBindings[MAX_INDEXED];
+        unsigned activeUnit;
+        GLuint textures[MAX_UNITS][TEXTURE_TARGET_COUNT];
+        int blend;
+        GLenum blendSource;
+        GLenum blendDestination;
+        int depthTest;
+        GLenum depthFunc;
+        int depthMask;
+
+        GLState::Stats current;
+        GLState::Stats lastFrame;
+    };
+
+    State &state()
+    {
+        static State s;
+        static bool initialized = false;
+        if (!initialized)
+        {
+            initialized = true;
+            s.current.issued = s.current.filtered = 0;
+            s.lastFrame = s.current;
+            GLState::invalidate();
+        }
+        return s;
+    }
+
+    int bufferSlot(GLenum target)
+    {
+        for (int i = 0; i < BUFFER_TARGET_COUNT; ++i)
+            if (BUFFER_TARGETS[i] == target)
+                return i;
+        return -1;
+    }
+
+    int textureSlot(GLenum target)
+    {
+        for (int i = 0; i < TEXTURE_TARGET_COUNT; ++i)
+            if (TEXTURE_TARGETS[i] == target)
+                return i;
+        return -1;
+    }
+
+    IndexedBinding *indexedBinding(GLenum target, GLuint index)
+    {
+        if (index >= static_cast<GLuint>(MAX_INDEXED))
+            return NULL;
+        if (target == GL_UNIFORM_BUFFER)
+            return &state().uniformBindings[index];
+        if (target == GL_SHADER_STORAGE_BUFFER)
+            return &state().storageBindings[index];
+        return NULL;
+    }
+
+    // true when the call must be issued; updates the cached value
+    template <typename T>
+    bool changes(T &cached, T value)
+    {
+        State &s = state();
+        if (cached == value)
+        {
+            ++s.current.filtered;
+            return false;
+        }
+        cached = value;
+        ++s.current.issued;
+        return true;
+    }
+
+    void issued()
+    {
+        ++state().current.issued;
+    }
+
+    void setCapability(GLenum capability, int &cached, bool enabled)
+    {
+        if (!changes(cached, enabled ? 1 : 0))
+            return;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+}
+
+void GLState::useProgram(GLuint program)
+{
+    if (changes(state().program, program))
+        glUseProgram(program);
+}
+
+void GLState::bindVertexArray(GLuint vao)
+{
+    State &s = state();
+    if (!changes(s.vao, vao))
+        return;
+    glBindVertexArray(vao);
+    // the element buffer binding is part of the VAO
+    s.buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+    int slot = bufferSlot(target);
+    if (slot < 0)
+    {
+        issued();
+        glBindBuffer(target, buffer);
+        return;
+    }
+    if (changes(state().buffers[slot], buffer))
+        glBindBuffer(target, buffer);
+}
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    IndexedBinding *binding = indexedBinding(target, index);
+    int slot = bufferSlot(target);
+    if (binding && binding->buffer == buffer && binding->offset == offset && binding->size == size)
+    {
+        ++state().current.filtered;
+        return;
+    }
+    issued();
+    glBindBufferRange(target, index, buffer, offset, size);
+    if (binding)
+    {
+        binding->buffer = buffer;
+        binding->offset = offset;
+        binding->size = size;
+    }
+    if (slot >= 0)
+        state().buffers[slot] = buffer;
+}
+
+void GLState::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    // a whole-buffer binding never equals a cached range
+    IndexedBinding *binding = indexedBinding(target, index);
+    int slot = bufferSlot(target);
+    if (binding && binding->buffer == buffer && binding->offset == 0 && binding->size == -1)
+    {
+        ++state().current.filtered;
+        return;
+    }
+    issued();
+    glBindBufferBase(target, index, buffer);
+    if (binding)
+    {
+        binding->buffer = buffer;
+        binding->offset = 0;
+        binding->size = -1;
+    }
+    if (slot >= 0)
+        state().buffers[slot] = buffer;
+}
+
+void GLState::activeTexture(unsigned unit)
+{
+    if (changes(state().activeUnit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture)
+{
+    State &s = state();
+    int slot = textureSlot(target);
+    if (slot < 0 || s.activeUnit >= static_cast<unsigned>(MAX_UNITS))
+    {
+        issued();
+        glBindTexture(target, texture);
+        return;
+    }
+    if (changes(s.textures[s.activeUnit][slot], texture))
+        glBindTexture(target, texture);
+}
+
+void GLState::bindTexture(unsigned unit, GLenum target, GLuint texture)
+{
+    State &s = state();
+    int slot = textureSlot(target);
+    // checked first so a redundant bind does not even switch the unit
+    if (slot >= 0 && unit < static_cast<unsigned>(MAX_UNITS) && s.textures[unit][slot] == texture)
+    {
+        ++s.current.filtered;
+        return;
+    }
+    activeTexture(unit);
+    bindTexture(target, texture);
+}
+
+void GLState::setBlend(bool enabled)
+{
+    setCapability(GL_BLEND, state().blend, enabled);
+}
+
+void GLState::blendFunc(GLenum source, GLenum destination)
+{
+    State &s = state();
+    if (s.blendSource == source && s.blendDestination == destination)
+    {
+        ++s.current.filtered;
+        return;
+    }
+    issued();
+    glBlendFunc(source, destination);
+    s.blendSource = source;
+    s.blendDestination = destination;
+}
+
+void GLState::setDepthTest(bool enabled)
+{
+    setCapability(GL_DEPTH_TEST, state().depthTest, enabled);
+}
+
+void GLState::depthFunc(GLenum func)
+{
+    if (changes(state().depthFunc, func))
+        glDepthFunc(func);
+}
+
+void GLState::depthMask(bool write)
+{
+    if (changes(state().depthMask, write ? 1 : 0))
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void GLState::deleteProgram(GLuint program)
+{
+    State &s = state();
+    if (program && s.program == program)
+        s.program = UNKNOWN;
+    glDeleteProgram(program);
+}
+
+void GLState::deleteVertexArrays(GLsizei count, const GLuint *vaos)
+{
+    State &s = state();
+    for (GLsizei i = 0; i < count; ++i)
+        if (vaos[i] && s.vao == vaos[i])
+            s.vao = UNKNOWN;
+    glDeleteVertexArrays(count, vaos);
+}
+
+void GLState::deleteBuffers(GLsizei count, const GLuint *buffers)
+{
+    State &s = state();
+    for (GLsizei i = 0; i < count; ++i)
+    {
+        if (!buffers[i])
+            continue;
+        for (int t = 0; t < BUFFER_TARGET_COUNT; ++t)
+            if (s.buffers[t] == buffers[i])
+                s.buffers[t] = UNKNOWN;
+        for (int b = 0; b < MAX_INDEXED; ++b)
+        {
+            if (s.uniformBindings[b].buffer == buffers[i])
+                s.uniformBindings[b].buffer = UNKNOWN;
+            if (s.storageBindings[b].buffer == buffers[i])
+                s.storageBindings[b].buffer = UNKNOWN;
+        }
+    }
+    glDeleteBuffers(count, buffers);
+}
+
+void GLState::deleteTextures(GLsizei count, const GLuint *textures)
+{
+    State &s = state();
+    for (GLsizei i = 0; i < count; ++i)
+    {
+        if (!textures[i])
+            continue;
+        for (int u = 0; u < MAX_UNITS; ++u)
+            for (int t = 0; t < TEXTURE_TARGET_COUNT; ++t)
+                if (s.textures[u][t] == textures[i])
+                    s.textures[u][t] = UNKNOWN;
+    }
+    glDeleteTextures(count, textures);
+}
+
+void GLState::invalidate()
+{
+    State &s = state();
+    s.program = UNKNOWN;
+    s.vao = UNKNOWN;
+    for (int i = 0; i < BUFFER_TARGET_COUNT; ++i)
+        s.buffers[i] = UNKNOWN;
+    for (int i = 0; i < MAX_INDEXED; ++i)
+    {
+        s.uniformBindings[i].buffer = UNKNOWN;
+        s.storageBindings[i].buffer = UNKNOWN;
+    }
+    s.activeUnit = UNKNOWN;
+    for (int u = 0; u < MAX_UNITS; ++u)
+        for (int t = 0; t < TEXTURE_TARGET_COUNT; ++t)
+            s.textures[u][t] = UNKNOWN;
+    s.blend = UNKNOWN_FLAG;
+    s.blendSource = s.blendDestination = UNKNOWN;
+    s.depthTest = UNKNOWN_FLAG;
+    s.depthFunc = UNKNOWN;
+    s.depthMask = UNKNOWN_FLAG;
+}
+
+void GLState::beginFrame()
+{
+    State &s = state();
+    s.lastFrame = s.current;
+    s.current.issued = s.current.filtered = 0;
+}
+
+GLState::Stats GLState::frameStats()
+{
+    return state().lastFrame;
+}
+
+GLState::Stats GLState::currentStats()
+{
+    return state().current;
+}
+
+std::string GLState::report()
+{
+    Stats stats = frameStats();
+    size_t total = stats.issued + stats.filtered;
+    char buffer[96];
+    std::snprintf(buffer, sizeof(buffer), "GL calls: %zu issued, %zu filtered (%.0f%%)",
+                  stats.issued, stats.filtered, total ? 100.0 * stats.filtered / total : 0.0);
+    return buffer;
+}
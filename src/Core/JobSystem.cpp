@@ -0,0 +1,118 @@
+#include "Core/JobSystem.h"
+
+namespace
+{
+    // set on pool threads, whose nested jobs must run inline
+    thread_local bool insideJob = false;
+}
+
+JobSystem &JobSystem::instance()
+{
+    static JobSystem system;
+    return system;
+}
+
+JobSystem::JobSystem()
+    : job(NULL), jobChunks(0), nextChunk(0), finishedChunks(0), busyWorkers(0), generation(0), stop(false)
+{
+    unsigned count = std::thread::hardware_concurrency();
+    for (unsigned i = 1; i < count; ++i)
+        workers.push_back(std::thread(&JobSystem::workerLoop, this));
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wakeWorkers.notify_all();
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+unsigned JobSystem::threadCount() const
+{
+    return static_cast<unsigned>(workers.size()) + 1;
+}
+
+void JobSystem::run(size_t chunks, const std::function<void(size_t)> &fn)
+{
+    std::unique_lock<std::mutex> submit(submitMutex, std::defer_lock);
+    if (chunks <= 1 || workers.empty() || insideJob || !submit.try_lock())
+    {
+        for (size_t c = 0; c < chunks; ++c)
+            fn(c);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        jobChunks = chunks;
+        nextChunk = 0;
+        finishedChunks = 0;
+        error = std::exception_ptr();
+        ++generation;
+    }
+    wakeWorkers.notify_all();
+
+    insideJob = true;
+    work();
+    insideJob = false;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    // workers still inside work() hold a pointer to fn
+    jobDone.wait(lock, [this]() { return finishedChunks == jobChunks && busyWorkers == 0; });
+    job = NULL;
+    std::exception_ptr failure = error;
+    lock.unlock();
+    if (failure)
+        std::rethrow_exception(failure);
+}
+
+void JobSystem::work()
+{
+    size_t done = 0;
+    for (size_t c = nextChunk++; c < jobChunks; c = nextChunk++)
+    {
+        try
+        {
+            (*job)(c);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+        ++done;
+    }
+    if (done == 0)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    finishedChunks += done;
+    if (finishedChunks == jobChunks)
+        jobDone.notify_all();
+}
+
+void JobSystem::workerLoop()
+{
+    insideJob = true;
+    unsigned long seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        wakeWorkers.wait(lock, [this, seen]() { return stop || (job && generation != seen); });
+        if (stop)
+            return;
+        seen = generation;
+        ++busyWorkers;
+        lock.unlock();
+        work();
+        lock.lock();
+        --busyWorkers;
+        if (busyWorkers == 0)
+            jobDone.notify_all();
+    }
+}
@@ -0,0 +1,157 @@
+#include "Core/StreamBuffer.h"
+#include "Core/GLCaps.h"
+#include "Core/GLState.h"
+
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
+StreamBuffer::StreamBuffer(size_t regionSize, int frames)
+    : bytesPerRegion(regionSize), frames(frames > 0 ? frames : 1), region(0), cursor(0), frameCount(0),
+      lastWaitMs(0.0), persistent(false), mapped(NULL), fences(this->frames, static_cast<GLsync>(0))
+{
+    GLsizeiptr size = static_cast<GLsizeiptr>(bytesPerRegion * this->frames);
+    glGenBuffers(1, &id);
+    // a target no draw state depends on; the buffer may be bound anywhere later
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, id);
+    persistent = (GLAD_GL_VERSION_4_4 || GLCaps::hasExtension("GL_ARB_buffer_storage")) && glBufferStorage != NULL;
+    if (persistent)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+        mapped = static_cast<uint8_t *>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+        if (!mapped)
+            throw std::runtime_error("Could not map the stream buffer");
+    }
+    else
+    {
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+        staging.resize(bytesPerRegion);
+    }
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    for (size_t i = 0; i < fences.size(); ++i)
+        if (fences[i])
+            glDeleteSync(fences[i]);
+    if (mapped)
+    {
+        GLState::bindBuffer(GL_COPY_WRITE_BUFFER, id);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+    GLState::deleteBuffers(1, &id);
+}
+
+void StreamBuffer::beginFrame()
+{
+    region = (region + 1) % frames;
+    cursor = 0;
+    ++frameCount;
+    lastWaitMs = 0.0;
+    GLsync &sync = fences[region];
+    if (!sync)
+        return;
+    // already signalled in the common case: no flush, no wait
+    GLenum result = glClientWaitSync(sync, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        // flush once so the fence is guaranteed to signal, then block
+        result = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(sync, 0, 1000000);
+        lastWaitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    glDeleteSync(sync);
+    sync = 0;
+}
+
+void StreamBuffer::endFrame()
+{
+    if (fences[region])
+        glDeleteSync(fences[region]);
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+StreamBuffer::Allocation StreamBuffer::allocate(size_t size, size_t alignment)
+{
+    if (alignment == 0)
+        alignment = 1;
+    // aligned in buffer offsets, which is what binds and attribute pointers see
+    size_t base = static_cast<size_t>(region) * bytesPerRegion;
+    size_t start = (base + cursor + alignment - 1) / alignment * alignment - base;
+    if (start + size > bytesPerRegion)
+        throw std::runtime_error("Stream buffer region exhausted");
+    cursor = start + size;
+
+    Allocation allocation;
+    allocation.buffer = id;
+    allocation.offset = static_cast<GLintptr>(base + start);
+    allocation.size = static_cast<GLsizeiptr>(size);
+    if (size == 0)
+        allocation.data = NULL;
+    else if (persistent)
+        allocation.data = mapped + base + start;
+    else
+        allocation.data = &staging[start];
+    return allocation;
+}
+
+void StreamBuffer::commit(const Allocation &allocation, size_t bytes)
+{
+    if (persistent || bytes == 0 || !allocation.data)
+        return;
+    if (bytes > static_cast<size_t>(allocation.size))
+        bytes = static_cast<size_t>(allocation.size);
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, id);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.offset, static_cast<GLsizeiptr>(bytes), allocation.data);
+}
+
+void StreamBuffer::commit(const Allocation &allocation)
+{
+    commit(allocation, static_cast<size_t>(allocation.size));
+}
+
+GLuint StreamBuffer::buffer() const
+{
+    return id;
+}
+
+size_t StreamBuffer::regionSize() const
+{
+    return bytesPerRegion;
+}
+
+size_t StreamBuffer::size() const
+{
+    return bytesPerRegion * frames;
+}
+
+size_t StreamBuffer::used() const
+{
+    return cursor;
+}
+
+bool StreamBuffer::isPersistent() const
+{
+    return persistent;
+}
+
+uint64_t StreamBuffer::frame() const
+{
+    return frameCount;
+}
+
+double StreamBuffer::waitMs() const
+{
+    return lastWaitMs;
+}
+
+std::string StreamBuffer::report() const
+{
+    char text[96];
+    std::snprintf(text, sizeof(text), "stream: %zu/%zu KiB, wait %.2f ms",
+                  (cursor + 1023) / 1024, (bytesPerRegion + 1023) / 1024, lastWaitMs);
+    return text;
+}
@@ -0,0 +1,547 @@
+#include "Render/BVH.h"
+#include "Core/Parallel.h"
+
+namespace
+{
+    // ranges at least this large compute bounds and bins on the JobSystem
+    const uint32_t PARALLEL_RANGE = 1u << 15;
+    // a leaf may hold up to this many primitives when SAH prefers it
+    const uint32_t MAX_SAH_LEAF = 16;
+    // cost of visiting a node relative to testing one primitive
+    const float TRAVERSAL_COST = 1.0f;
+    // count of a node standing for a subtree that is built separately
+    const uint32_t PLACEHOLDER = 0xFFFFFFFFu;
+    // no axis separates the centroids: split the range in the middle
+    const int MEDIAN_SPLIT = -1;
+
+    struct Bins {
+        AABB boxes[3][BVH::BINS];
+        uint32_t counts[3][BVH::BINS];
+
+        Bins()
+        {
+            for (int a = 0; a < 3; ++a)
+                for (int b = 0; b < BVH::BINS; ++b)
+                    counts[a][b] = 0;
+        }
+
+        void merge(const Bins &other)
+        {
+            for (int a = 0; a < 3; ++a)
+                for (int b = 0; b < BVH::BINS; ++b)
+                {
+                    boxes[a][b].grow(other.boxes[a][b]);
+                    counts[a][b] += other.counts[a][b];
+                }
+        }
+    };
+
+    int binOf(float value, float low, float scale)
+    {
+        int bin = static_cast<int>((value - low) * scale);
+        return bin < 0 ? 0 : (bin >= BVH::BINS ? BVH::BINS - 1 : bin);
+    }
+
+    float binScale(const AABB &centroidBox, int axis)
+    {
+        float extent = centroidBox.max[axis] - centroidBox.min[axis];
+        return extent > 0.0f ? BVH::BINS / extent * 0.9999f : 0.0f;
+    }
+
+    AABB nodeBox(const BVHNode &node)
+    {
+        return AABB(Vec3(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]),
+                    Vec3(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]));
+    }
+
+    // false when a plane of mask rejects the box; planes the box lies
+    // fully inside are removed from mask
+    bool classify(const Frustum &frustum, const AABB &box, unsigned &mask)
+    {
+        Vec3 center = box.center();
+        Vec3 extents = box.extents();
+        for (int p = 0; p < 6 && mask; ++p)
+        {
+            if (!(mask & (1u << p)))
+                continue;
+            const Vec4 &plane = frustum.planes[p];
+            float d = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            float r = std::fabs(plane.x) * extents.x + std::fabs(plane.y) * extents.y + std::fabs(plane.z) * extents.z;
+            if (d + r < 0.0f)
+                return false;
+            if (d - r >= 0.0f)
+                mask &= ~(1u << p);
+        }
+        return true;
+    }
+}
+
+BVH::BVH() : treeDepth(0), boxes(NULL)
+{
+}
+
+void BVH::setBounds(BVHNode &node, const AABB &box)
+{
+    node.boundsMin[0] = box.min.x;
+    node.boundsMin[1] = box.min.y;
+    node.boundsMin[2] = box.min.z;
+    node.boundsMax[0] = box.max.x;
+    node.boundsMax[1] = box.max.y;
+    node.boundsMax[2] = box.max.z;
+}
+
+void BVH::build(const std::vector<AABB> &primitives)
+{
+    clear();
+    uint32_t count = static_cast<uint32_t>(primitives.size());
+    if (count == 0)
+        return;
+    boxes = &primitives;
+    order.resize(count);
+    centroids.resize(count);
+    Parallel::forChunks(count, PARALLEL_RANGE, [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            order[i] = static_cast<uint32_t>(i);
+            centroids[i] = primitives[i].center();
+        }
+    });
+
+    // the top levels split on this thread (binning in parallel), then
+    // every range below taskSize becomes an independent subtree
+    std::vector<BVHNode> top;
+    std::vector<Task> tasks;
+    unsigned threads = Parallel::workerCount();
+    uint32_t taskSize = count / (threads * 4);
+    if (taskSize < 4096)
+        taskSize = 4096;
+    buildNode(top, 0, count, threads > 1 ? &tasks : NULL, taskSize);
+    Parallel::forChunks(tasks.size(), 1, [&](size_t, size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t)
+        {
+            tasks[t].nodes.reserve(tasks[t].count * 2 / MAX_LEAF + 1);
+            buildNode(tasks[t].nodes, tasks[t].first, tasks[t].count, NULL, 0);
+        }
+    });
+
+    tree.reserve(count * 2 / MAX_LEAF + 1);
+    emit(top, 0, tasks);
+    boxes = NULL;
+    std::vector<Vec3>().swap(centroids);
+
+    // children follow their parent, so one forward pass finds every depth;
+    // the traversal stacks are sized from it
+    std::vector<uint32_t> depths(tree.size(), 1);
+    for (size_t i = 0; i < tree.size(); ++i)
+    {
+        treeDepth = std::max(treeDepth, depths[i]);
+        if (tree[i].count == 0)
+            depths[i + 1] = depths[tree[i].leftFirst] = depths[i] + 1;
+    }
+}
+
+void BVH::emit(const std::vector<BVHNode> &top, uint32_t index, std::vector<Task> &tasks)
+{
+    const BVHNode &node = top[index];
+    if (node.count == PLACEHOLDER)
+    {
+        // subtree indices are relative to its own array
+        std::vector<BVHNode> &nodes = tasks[node.leftFirst].nodes;
+        uint32_t base = static_cast<uint32_t>(tree.size());
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            tree.push_back(nodes[i]);
+            if (nodes[i].count == 0)
+                tree.back().leftFirst += base;
+        }
+        std::vector<BVHNode>().swap(nodes);
+        return;
+    }
+    uint32_t position = static_cast<uint32_t>(tree.size());
+    tree.push_back(node);
+    if (node.count > 0)
+        return;
+    emit(top, index + 1, tasks);
+    tree[position].leftFirst = static_cast<uint32_t>(tree.size());
+    emit(top, node.leftFirst, tasks);
+}
+
+void BVH::rangeBounds(uint32_t first, uint32_t count, AABB &box, AABB &centroidBox) const
+{
+    size_t chunks = Parallel::chunkCount(count, PARALLEL_RANGE);
+    std::vector<AABB> partialBoxes(chunks);
+    std::vector<AABB> partialCentroids(chunks);
+    Parallel::forChunks(count, PARALLEL_RANGE, [&](size_t chunk, size_t begin, size_t end) {
+        AABB b, c;
+        for (size_t i = first + begin; i < first + end; ++i)
+        {
+            b.grow((*boxes)[order[i]]);
+            c.grow(centroids[order[i]]);
+        }
+        partialBoxes[chunk] = b;
+        partialCentroids[chunk] = c;
+    });
+    box = AABB();
+    centroidBox = AABB();
+    for (size_t c = 0; c < chunks; ++c)
+    {
+        box.grow(partialBoxes[c]);
+        centroidBox.grow(partialCentroids[c]);
+    }
+}
+
+bool BVH::findSplit(uint32_t first, uint32_t count, const AABB &box, const AABB &centroidBox,
+                    int &axis, int &bin) const
+{
+    float scales[3];
+    for (int a = 0; a < 3; ++a)
+        scales[a] = binScale(centroidBox, a);
+    if (scales[0] == 0.0f && scales[1] == 0.0f && scales[2] == 0.0f)
+    {
+        axis = MEDIAN_SPLIT;
+        return count > MAX_LEAF;
+    }
+
+    size_t chunks = Parallel::chunkCount(count, PARALLEL_RANGE);
+    std::vector<Bins> partial(chunks);
+    Parallel::forChunks(count, PARALLEL_RANGE, [&](size_t chunk, size_t begin, size_t end) {
+        Bins &bins = partial[chunk];
+        for (size_t i = first + begin; i < first + end; ++i)
+        {
+            uint32_t p = order[i];
+            for (int a = 0; a < 3; ++a)
+            {
+                if (scales[a] == 0.0f)
+                    continue;
+                int b = binOf(centroids[p][a], centroidBox.min[a], scales[a]);
+                bins.boxes[a][b].grow((*boxes)[p]);
+                ++bins.counts[a][b];
+            }
+        }
+    });
+    for (size_t c = 1; c < chunks; ++c)
+        partial[0].merge(partial[c]);
+    const Bins &bins = partial[0];
+
+    // SAH: sweep prefix boxes from the left, suffix boxes from the right
+    float bestCost = HUGE_VALF;
+    for (int a = 0; a < 3; ++a)
+    {
+        if (scales[a] == 0.0f)
+            continue;
+        float rightArea[BINS];
+        uint32_t rightCount[BINS];
+        AABB right;
+        uint32_t n = 0;
+        for (int b = BINS - 1; b > 0; --b)
+        {
+            right.grow(bins.boxes[a][b]);
+            n += bins.counts[a][b];
+            rightArea[b] = right.halfArea();
+            rightCount[b] = n;
+        }
+        AABB left;
+        n = 0;
+        for (int b = 1; b < BINS; ++b)
+        {
+            left.grow(bins.boxes[a][b - 1]);
+            n += bins.counts[a][b - 1];
+            if (n == 0 || rightCount[b] == 0)
+                continue;
+            float cost = left.halfArea() * n + rightArea[b] * rightCount[b];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                axis = a;
+                bin = b;
+            }
+        }
+    }
+    if (bestCost == HUGE_VALF)
+    {
+        axis = MEDIAN_SPLIT;
+        return count > MAX_LEAF;
+    }
+    float parentArea = box.halfArea();
+    float leafCost = parentArea * count;
+    float splitCost = parentArea * TRAVERSAL_COST + bestCost;
+    return splitCost < leafCost || count > MAX_SAH_LEAF;
+}
+
+void BVH::buildNode(std::vector<BVHNode> &out, uint32_t first, uint32_t count,
+                    std::vector<Task> *tasks, uint32_t taskSize)
+{
+    AABB box, centroidBox;
+    rangeBounds(first, count, box, centroidBox);
+    uint32_t index = static_cast<uint32_t>(out.size());
+    out.push_back(BVHNode());
+    setBounds(out[index], box);
+    out[index].leftFirst = first;
+    out[index].count = count;
+
+    if (tasks && count <= taskSize)
+    {
+        Task task;
+        task.first = first;
+        task.count = count;
+        out[index].leftFirst = static_cast<uint32_t>(tasks->size());
+        out[index].count = PLACEHOLDER;
+        tasks->push_back(task);
+        return;
+    }
+    if (count <= MAX_LEAF)
+        return;
+
+    int axis = MEDIAN_SPLIT, bin = 0;
+    if (!findSplit(first, count, box, centroidBox, axis, bin))
+        return;
+    uint32_t middle = first + count / 2;
+    if (axis != MEDIAN_SPLIT)
+    {
+        float low = centroidBox.min[axis];
+        float scale = binScale(centroidBox, axis);
+        uint32_t *split = std::partition(&order[first], &order[first] + count, [&](uint32_t p) {
+            return binOf(centroids[p][axis], low, scale) < bin;
+        });
+        middle = static_cast<uint32_t>(split - &order[0]);
+        if (middle == first || middle == first + count)
+            middle = first + count / 2;
+    }
+
+    out[index].count = 0;
+    buildNode(out, first, middle - first, tasks, taskSize);
+    out[index].leftFirst = static_cast<uint32_t>(out.size());
+    buildNode(out, middle, first + count - middle, tasks, taskSize);
+}
+
+void BVH::refit(const std::vector<AABB> &primitives)
+{
+    // children always follow their parent, so one backward pass suffices
+    for (size_t i = tree.size(); i-- > 0;)
+    {
+        BVHNode &node = tree[i];
+        AABB box;
+        if (node.count > 0)
+        {
+            for (uint32_t k = 0; k < node.count; ++k)
+                box.grow(primitives[order[node.leftFirst + k]]);
+        }
+        else
+        {
+            box = nodeBox(tree[i + 1]);
+            box.grow(nodeBox(tree[node.leftFirst]));
+        }
+        setBounds(node, box);
+    }
+}
+
+void BVH::clear()
+{
+    tree.clear();
+    order.clear();
+    treeDepth = 0;
+}
+
+uint32_t BVH::depth() const
+{
+    return treeDepth;
+}
+
+const std::vector<BVHNode> &BVH::nodes() const
+{
+    return tree;
+}
+
+const std::vector<uint32_t> &BVH::indices() const
+{
+    return order;
+}
+
+size_t BVH::primitiveCount() const
+{
+    return order.size();
+}
+
+AABB BVH::bounds() const
+{
+    return tree.empty() ? AABB() : nodeBox(tree[0]);
+}
+
+float BVH::intersectNode(const BVHNode &node, const Ray &ray, const Vec3 &inverseDirection, float tMax)
+{
+    float tMin = 0.0f;
+    for (int a = 0; a < 3; ++a)
+    {
+        float t0 = (node.boundsMin[a] - ray.origin[a]) * inverseDirection[a];
+        float t1 = (node.boundsMax[a] - ray.origin[a]) * inverseDirection[a];
+        if (t0 > t1)
+            std::swap(t0, t1);
+        tMin = t0 > tMin ? t0 : tMin;
+        tMax = t1 < tMax ? t1 : tMax;
+    }
+    return tMin <= tMax ? tMin : HUGE_VALF;
+}
+
+float BVH::nodeDistance(const BVHNode &node, const Vec3 &point)
+{
+    float squared = 0.0f;
+    for (int a = 0; a < 3; ++a)
+    {
+        float d = 0.0f;
+        if (point[a] < node.boundsMin[a])
+            d = node.boundsMin[a] - point[a];
+        else if (point[a] > node.boundsMax[a])
+            d = point[a] - node.boundsMax[a];
+        squared += d * d;
+    }
+    return std::sqrt(squared);
+}
+
+void BVH::cull(const Frustum &frustum, std::vector<uint32_t> &visible, const std::vector<AABB> *primitives) const
+{
+    visible.clear();
+    if (tree.empty())
+        return;
+    const unsigned ALL_PLANES = 0x3F;
+    uint32_t inlineStack[INLINE_STACK];
+    unsigned inlineMasks[INLINE_STACK];
+    std::vector<uint32_t> heapStack;
+    std::vector<unsigned> heapMasks;
+    uint32_t *stack = inlineStack;
+    unsigned *masks = inlineMasks;
+    if (stackSize() > INLINE_STACK)
+    {
+        heapStack.resize(stackSize());
+        heapMasks.resize(stackSize());
+        stack = &heapStack[0];
+        masks = &heapMasks[0];
+    }
+    uint32_t top = 0;
+    stack[top] = 0;
+    masks[top++] = ALL_PLANES;
+    while (top > 0)
+    {
+        --top;
+        const BVHNode &node = tree[stack[top]];
+        unsigned mask = masks[top];
+        if (!classify(frustum, nodeBox(node), mask))
+            continue;
+        if (node.count > 0)
+        {
+            for (uint32_t k = 0; k < node.count; ++k)
+            {
+                uint32_t p = order[node.leftFirst + k];
+                unsigned primitiveMask = mask;
+                if (!primitives || !mask || classify(frustum, (*primitives)[p], primitiveMask))
+                    visible.push_back(p);
+            }
+            continue;
+        }
+        stack[top] = node.leftFirst;
+        masks[top++] = mask;
+        stack[top] = static_cast<uint32_t>(&node - &tree[0]) + 1;
+        masks[top++] = mask;
+    }
+}
+
+MeshBVH::MeshBVH(const OBJLoader::MeshData &mesh)
+{
+    size_t vertexCount = mesh.vertices.size() / OBJLoader::FLOATS_PER_VERTEX;
+    positions.resize(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        const float *p = &mesh.vertices[v * OBJLoader::FLOATS_PER_VERTEX];
+        positions[v] = Vec3(p[0], p[1], p[2]);
+    }
+    triangles = mesh.indices;
+
+    std::vector<AABB> boxes(triangles.size() / 3);
+    for (size_t t = 0; t < boxes.size(); ++t)
+    {
+        boxes[t].grow(positions[triangles[t * 3]]);
+        boxes[t].grow(positions[triangles[t * 3 + 1]]);
+        boxes[t].grow(positions[triangles[t * 3 + 2]]);
+    }
+    tree.build(boxes);
+}
+
+float MeshBVH::intersectTriangle(uint32_t triangle, const Ray &ray) const
+{
+    const Vec3 &a = positions[triangles[triangle * 3]];
+    Vec3 e1 = positions[triangles[triangle * 3 + 1]] - a;
+    Vec3 e2 = positions[triangles[triangle * 3 + 2]] - a;
+    Vec3 p = Vec3::cross(ray.direction, e2);
+    float det = Vec3::dot(e1, p);
+    if (std::fabs(det) < 1e-12f)
+        return HUGE_VALF;
+    float inverse = 1.0f / det;
+    Vec3 s = ray.origin - a;
+    float u = Vec3::dot(s, p) * inverse;
+    if (u < 0.0f || u > 1.0f)
+        return HUGE_VALF;
+    Vec3 q = Vec3::cross(s, e1);
+    float v = Vec3::dot(ray.direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f)
+        return HUGE_VALF;
+    float t = Vec3::dot(e2, q) * inverse;
+    return t >= 0.0f ? t : HUGE_VALF;
+}
+
+Vec3 MeshBVH::closestOnTriangle(uint32_t triangle, const Vec3 &p) const
+{
+    // Ericson, Real-Time Collision Detection 5.1.5: Voronoi regions in turn
+    const Vec3 &a = positions[triangles[triangle * 3]];
+    const Vec3 &b = positions[triangles[triangle * 3 + 1]];
+    const Vec3 &c = positions[triangles[triangle * 3 + 2]];
+    Vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = Vec3::dot(ab, ap), d2 = Vec3::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+    Vec3 bp = p - b;
+    float d3 = Vec3::dot(ab, bp), d4 = Vec3::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+    Vec3 cp = p - c;
+    float d5 = Vec3::dot(ab, cp), d6 = Vec3::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    float denominator = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+bool MeshBVH::raycast(const Ray &ray, float &t, uint32_t &triangle, float tMax) const
+{
+    return tree.raycast(ray, t, triangle, [this](uint32_t p, const Ray &r, float) {
+        return intersectTriangle(p, r);
+    }, tMax);
+}
+
+bool MeshBVH::nearest(const Vec3 &point, Vec3 &closest, uint32_t &triangle, float maxDistance) const
+{
+    float distance;
+    bool found = tree.nearest(point, distance, triangle, [this](uint32_t p, const Vec3 &q, float) {
+        return (closestOnTriangle(p, q) - q).length();
+    }, maxDistance);
+    if (found)
+        closest = closestOnTriangle(triangle, point);
+    return found;
+}
+
+size_t MeshBVH::triangleCount() const
+{
+    return triangles.size() / 3;
+}
+
+const BVH &MeshBVH::bvh() const
+{
+    return tree;
+}
@@ -0,0 +1,284 @@
+#include "Render/FrustumCuller.h"
+#include "Core/Parallel.h"
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+# include <emmintrin.h>
+# define FRUSTUM_SSE2
+#endif
+
+namespace
+{
+    // groups per job chunk; smaller sets are culled on the calling thread
+    const size_t MIN_CHUNK_GROUPS = 4096;
+
+    // plane normals with their absolute values, splatted once per cull
+    struct PlaneTerms {
+        float nx, ny, nz, w;
+        float ax, ay, az;
+    };
+
+    void planeTerms(const Frustum &frustum, PlaneTerms terms[6])
+    {
+        for (int p = 0; p < 6; ++p)
+        {
+            const Vec4 &plane = frustum.planes[p];
+            terms[p].nx = plane.x;
+            terms[p].ny = plane.y;
+            terms[p].nz = plane.z;
+            terms[p].w = plane.w;
+            terms[p].ax = std::fabs(plane.x);
+            terms[p].ay = std::fabs(plane.y);
+            terms[p].az = std::fabs(plane.z);
+        }
+    }
+
+    // appends base + the index of every set bit of mask
+    inline size_t emitMask(unsigned mask, uint32_t base, uint32_t *out, size_t n)
+    {
+        while (mask)
+        {
+            out[n++] = base + static_cast<uint32_t>(__builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+        return n;
+    }
+}
+
+Frustum Frustum::fromMatrix(const Mat4 &m)
+{
+    // Gribb / Hartmann: -w <= x, y, z <= w in clip space
+    Frustum frustum;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (int side = 0; side < 2; ++side)
+        {
+            float sign = side == 0 ? 1.0f : -1.0f;
+            Vec4 plane(m.at(3, 0) + sign * m.at(axis, 0), m.at(3, 1) + sign * m.at(axis, 1),
+                       m.at(3, 2) + sign * m.at(axis, 2), m.at(3, 3) + sign * m.at(axis, 3));
+            float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+            if (length > 0.0f)
+            {
+                plane.x /= length;
+                plane.y /= length;
+                plane.z /= length;
+                plane.w /= length;
+            }
+            frustum.planes[axis * 2 + side] = plane;
+        }
+    }
+    return frustum;
+}
+
+Frustum Frustum::transformed(const Mat4 &model) const
+{
+    // dot(plane, model * p) == dot(transpose(model) * plane, p)
+    Frustum local;
+    for (int p = 0; p < 6; ++p)
+    {
+        const Vec4 &plane = planes[p];
+        const float *m = model.m;
+        local.planes[p] = Vec4(m[0] * plane.x + m[1] * plane.y + m[2] * plane.z + m[3] * plane.w,
+                               m[4] * plane.x + m[5] * plane.y + m[6] * plane.z + m[7] * plane.w,
+                               m[8] * plane.x + m[9] * plane.y + m[10] * plane.z + m[11] * plane.w,
+                               m[12] * plane.x + m[13] * plane.y + m[14] * plane.z + m[15] * plane.w);
+    }
+    return local;
+}
+
+FrustumCuller::FrustumCuller() : count(0)
+{
+    lastStats.tested = lastStats.visible = lastStats.culled = 0;
+}
+
+uint32_t FrustumCuller::add(const Vec3 &center, float sphereRadius, const Vec3 &extents)
+{
+    if (count % GROUP == 0)
+    {
+        // a new group of padding: infinitely negative radius, never visible
+        size_t padded = count + GROUP;
+        centerX.resize(padded, 0.0f);
+        centerY.resize(padded, 0.0f);
+        centerZ.resize(padded, 0.0f);
+        radius.resize(padded, -std::numeric_limits<float>::infinity());
+        extentX.resize(padded, 0.0f);
+        extentY.resize(padded, 0.0f);
+        extentZ.resize(padded, 0.0f);
+    }
+    uint32_t index = static_cast<uint32_t>(count++);
+    set(index, center, sphereRadius, extents);
+    return index;
+}
+
+uint32_t FrustumCuller::addSphere(const Vec3 &center, float sphereRadius)
+{
+    return add(center, sphereRadius, Vec3(sphereRadius, sphereRadius, sphereRadius));
+}
+
+uint32_t FrustumCuller::addBox(const Vec3 &boundsMin, const Vec3 &boundsMax)
+{
+    Vec3 extents = (boundsMax - boundsMin) * 0.5f;
+    return add((boundsMin + boundsMax) * 0.5f, extents.length(), extents);
+}
+
+void FrustumCuller::set(uint32_t index, const Vec3 &center, float sphereRadius, const Vec3 &extents)
+{
+    centerX[index] = center.x;
+    centerY[index] = center.y;
+    centerZ[index] = center.z;
+    radius[index] = sphereRadius;
+    extentX[index] = extents.x;
+    extentY[index] = extents.y;
+    extentZ[index] = extents.z;
+}
+
+void FrustumCuller::clear()
+{
+    count = 0;
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    radius.clear();
+    extentX.clear();
+    extentY.clear();
+    extentZ.clear();
+}
+
+size_t FrustumCuller::size() const
+{
+    return count;
+}
+
+size_t FrustumCuller::cullGroups(const Frustum &frustum, size_t begin, size_t end, uint32_t *out) const
+{
+    PlaneTerms terms[6];
+    planeTerms(frustum, terms);
+    size_t n = 0;
+#if defined(__AVX2__)
+    const __m256 zero = _mm256_setzero_ps();
+    for (size_t g = begin; g < end; ++g)
+    {
+        size_t i = g * GROUP;
+        __m256 cx = _mm256_loadu_ps(&centerX[i]);
+        __m256 cy = _mm256_loadu_ps(&centerY[i]);
+        __m256 cz = _mm256_loadu_ps(&centerZ[i]);
+        __m256 r = _mm256_loadu_ps(&radius[i]);
+        __m256 ex = _mm256_loadu_ps(&extentX[i]);
+        __m256 ey = _mm256_loadu_ps(&extentY[i]);
+        __m256 ez = _mm256_loadu_ps(&extentZ[i]);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p)
+        {
+            const PlaneTerms &t = terms[p];
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(t.nx)),
+                                                   _mm256_mul_ps(cy, _mm256_set1_ps(t.ny))),
+                                     _mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(t.nz)), _mm256_set1_ps(t.w)));
+            __m256 box = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(t.ax)),
+                                                     _mm256_mul_ps(ey, _mm256_set1_ps(t.ay))),
+                                       _mm256_mul_ps(ez, _mm256_set1_ps(t.az)));
+            __m256 reach = _mm256_min_ps(r, box);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, reach), zero, _CMP_GE_OQ));
+        }
+        n = emitMask(static_cast<unsigned>(_mm256_movemask_ps(inside)), static_cast<uint32_t>(i), out, n);
+    }
+#elif defined(FRUSTUM_SSE2)
+    const __m128 zero = _mm_setzero_ps();
+    for (size_t g = begin; g < end; ++g)
+    {
+        for (size_t half = 0; half < GROUP; half += 4)
+        {
+            size_t i = g * GROUP + half;
+            __m128 cx = _mm_loadu_ps(&centerX[i]);
+            __m128 cy = _mm_loadu_ps(&centerY[i]);
+            __m128 cz = _mm_loadu_ps(&centerZ[i]);
+            __m128 r = _mm_loadu_ps(&radius[i]);
+            __m128 ex = _mm_loadu_ps(&extentX[i]);
+            __m128 ey = _mm_loadu_ps(&extentY[i]);
+            __m128 ez = _mm_loadu_ps(&extentZ[i]);
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                const PlaneTerms &t = terms[p];
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(t.nx)), _mm_mul_ps(cy, _mm_set1_ps(t.ny))),
+                                      _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(t.nz)), _mm_set1_ps(t.w)));
+                __m128 box = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(t.ax)), _mm_mul_ps(ey, _mm_set1_ps(t.ay))),
+                                        _mm_mul_ps(ez, _mm_set1_ps(t.az)));
+                __m128 reach = _mm_min_ps(r, box);
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, reach), zero));
+            }
+            n = emitMask(static_cast<unsigned>(_mm_movemask_ps(inside)), static_cast<uint32_t>(i), out, n);
+        }
+    }
+#else
+    for (size_t i = begin * GROUP; i < end * GROUP; ++i)
+    {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; ++p)
+        {
+            const PlaneTerms &t = terms[p];
+            float d = centerX[i] * t.nx + centerY[i] * t.ny + centerZ[i] * t.nz + t.w;
+            float box = extentX[i] * t.ax + extentY[i] * t.ay + extentZ[i] * t.az;
+            inside = d + (radius[i] < box ? radius[i] : box) >= 0.0f;
+        }
+        if (inside)
+            out[n++] = static_cast<uint32_t>(i);
+    }
+#endif
+    return n;
+}
+
+size_t FrustumCuller::cull(const Frustum &frustum, std::vector<uint32_t> &visible)
+{
+    size_t groups = (count + GROUP - 1) / GROUP;
+    visible.resize(groups * GROUP);
+    size_t chunks = Parallel::chunkCount(groups, MIN_CHUNK_GROUPS);
+    std::vector<size_t> found(chunks, 0);
+    std::vector<size_t> starts(chunks, 0);
+    // every chunk writes from the first slot of its own range, then the
+    // partial lists are moved down next to each other
+    Parallel::forChunks(groups, MIN_CHUNK_GROUPS, [&](size_t chunk, size_t begin, size_t end) {
+        starts[chunk] = begin * GROUP;
+        found[chunk] = cullGroups(frustum, begin, end, visible.data() + begin * GROUP);
+    });
+    size_t total = 0;
+    for (size_t c = 0; c < chunks; ++c)
+    {
+        if (found[c] && starts[c] != total)
+            std::memmove(&visible[total], &visible[starts[c]], found[c] * sizeof(uint32_t));
+        total += found[c];
+    }
+    visible.resize(total);
+
+    lastStats.tested = count;
+    lastStats.visible = total;
+    lastStats.culled = count - total;
+    return total;
+}
+
+FrustumCuller::Stats FrustumCuller::stats() const
+{
+    return lastStats;
+}
+
+std::string FrustumCuller::report() const
+{
+    char text[96];
+    std::snprintf(text, sizeof(text), "cull: %zu/%zu visible (%s)", lastStats.visible, lastStats.tested, simdPath());
+    return text;
+}
+
+const char *FrustumCuller::simdPath()
+{
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(FRUSTUM_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,255 @@
+#include "Render/GpuCuller.h"
+#include "Core/GLState.h"
+#include "Render/InstanceBuffer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+namespace
+{
+    // storage bindings of shaders/compute/cull.comp
+    const GLuint OBJECT_BINDING = 0;
+    const GLuint COMMAND_BINDING = 1;
+    const GLuint DRAW_DATA_BINDING = 2;
+    const GLuint PYRAMID_BINDING = 3;
+    const GLuint COUNTER_BINDING = 4;
+}
+
+GpuCuller::GpuCuller(const MeshPool &pool, unsigned materials, const char *shaderPath)
+    : pool(pool), materials(materials), shader(shaderPath), readbackFence(0), pyramidFloats(0),
+      useHiZ(false), levelCount(0), visible(0)
+{
+    GLuint buffers[8];
+    glGenBuffers(8, buffers);
+    objectBuffer = buffers[0];
+    commandTemplate = buffers[1];
+    commandBuffer = buffers[2];
+    drawDataBuffer = buffers[3];
+    drawIDBuffer = buffers[4];
+    pyramidBuffer = buffers[5];
+    counterBuffer = buffers[6];
+    readbackBuffer = buffers[7];
+    glGenTextures(1, &drawDataTexture);
+
+    const GLuint zero = 0;
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, counterBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_COPY);
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint), &zero, GL_STREAM_READ);
+
+    objectCountUniform = shader.uniform("objectCount");
+    highlightUniform = shader.uniform("highlight");
+    highlightColorUniform = shader.uniform("highlightColor");
+    hiZUniform = shader.uniform("useHiZ");
+    levelsUniform = shader.uniform("levels");
+    levelCountUniform = shader.uniform("levelCount");
+    for (int i = 0; i < MAX_PYRAMID_LEVELS * 4; ++i)
+        levels[i] = 0;
+}
+
+GpuCuller::~GpuCuller()
+{
+    if (readbackFence)
+        glDeleteSync(readbackFence);
+    GLState::deleteTextures(1, &drawDataTexture);
+    GLuint buffers[8] = {
+        objectBuffer, commandTemplate, commandBuffer, drawDataBuffer,
+        drawIDBuffer, pyramidBuffer, counterBuffer, readbackBuffer
+    };
+    GLState::deleteBuffers(8, buffers);
+}
+
+bool GpuCuller::supported()
+{
+    return ComputeShader::supported() && MultiDrawBatch::indirectSupported();
+}
+
+bool GpuCuller::isReady() const
+{
+    return !shader.isFailed();
+}
+
+void GpuCuller::add(const GpuObject &object, uint32_t mesh, uint32_t material)
+{
+    objects.push_back(object);
+    objectCommands.push_back(material * static_cast<uint32_t>(pool.meshCount()) + mesh);
+}
+
+void GpuCuller::upload()
+{
+    // one command per material and mesh; its instances are slots
+    // [baseInstance, baseInstance + objects using it)
+    size_t meshes = pool.meshCount();
+    commands.assign(materials * meshes, DrawElementsIndirectCommand());
+    std::vector<GLuint> users(commands.size(), 0);
+    for (size_t i = 0; i < objects.size(); ++i)
+        ++users[objectCommands[i]];
+    GLuint base = 0;
+    for (size_t c = 0; c < commands.size(); ++c)
+    {
+        const MeshPool::Range &range = pool.range(static_cast<uint32_t>(c % meshes));
+        DrawElementsIndirectCommand &command = commands[c];
+        command.count = range.indexCount;
+        command.instanceCount = 0;
+        command.firstIndex = range.firstIndex;
+        command.baseVertex = range.baseVertex;
+        command.baseInstance = base;
+        base += users[c];
+    }
+    for (size_t i = 0; i < objects.size(); ++i)
+        objects[i].command = objectCommands[i];
+
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    if (objects.size() * MultiDrawBatch::TEXELS_PER_DRAW > static_cast<size_t>(maxTexels))
+        throw std::runtime_error("Too many objects for the draw data texture buffer");
+
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, objectBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, objects.size() * sizeof(GpuObject), objects.data(), GL_STATIC_DRAW);
+    size_t commandBytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, commandTemplate);
+    glBufferData(GL_COPY_WRITE_BUFFER, commandBytes, commands.data(), GL_STATIC_COPY);
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, commandBytes, commands.data(), GL_DYNAMIC_COPY);
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, drawDataBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, objects.size() * sizeof(InstanceData), NULL, GL_DYNAMIC_COPY);
+
+    // aDrawID source: 0, 1, 2, ... read through baseInstance
+    std::vector<GLint> ids(objects.size());
+    for (size_t i = 0; i < ids.size(); ++i)
+        ids[i] = static_cast<GLint>(i);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, drawIDBuffer);
+    glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLint), ids.data(), GL_STATIC_DRAW);
+
+    GLState::bindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataBuffer);
+}
+
+void GpuCuller::setDepthPyramid(const OcclusionCuller *occlusion)
+{
+    useHiZ = occlusion != NULL;
+    if (!occlusion)
+        return;
+    // every level back to back, levels[] holds (offset, width, height)
+    levelCount = static_cast<int>(std::min<size_t>(occlusion->levelCount(), MAX_PYRAMID_LEVELS));
+    size_t floats = 0;
+    for (int l = 0; l < levelCount; ++l)
+    {
+        int w, h;
+        occlusion->level(l, w, h);
+        levels[l * 4] = static_cast<GLint>(floats);
+        levels[l * 4 + 1] = w;
+        levels[l * 4 + 2] = h;
+        floats += static_cast<size_t>(w) * h;
+    }
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, pyramidBuffer);
+    if (floats != pyramidFloats)
+    {
+        glBufferData(GL_COPY_WRITE_BUFFER, floats * sizeof(float), NULL, GL_STREAM_DRAW);
+        pyramidFloats = floats;
+    }
+    for (int l = 0; l < levelCount; ++l)
+    {
+        int w, h;
+        const std::vector<float> &depths = occlusion->level(l, w, h);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, levels[l * 4] * sizeof(float), depths.size() * sizeof(float),
+                        depths.data());
+    }
+}
+
+void GpuCuller::cull(int highlight, const Vec4 &highlightColor)
+{
+    readCount();
+    if (objects.empty() || shader.isFailed())
+        return;
+
+    // instance counts and the visible counter start from zero
+    size_t commandBytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+    GLState::bindBuffer(GL_COPY_READ_BUFFER, commandTemplate);
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, commandBytes);
+    const GLuint zero = 0;
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, counterBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(GLuint), &zero);
+
+    // staged values equal to last frame's are not sent again
+    shader.setUint(objectCountUniform, static_cast<GLuint>(objects.size()));
+    shader.setInt(highlightUniform, highlight);
+    shader.setVec4(highlightColorUniform, highlightColor.x, highlightColor.y, highlightColor.z, highlightColor.w);
+    shader.setInt(hiZUniform, useHiZ && pyramidFloats > 0 ? 1 : 0);
+    if (useHiZ)
+    {
+        shader.setIVec4Array(levelsUniform, levels, levelCount);
+        shader.setInt(levelCountUniform, levelCount);
+    }
+    shader.use();
+    GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_BINDING, objectBuffer);
+    GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, commandBuffer);
+    GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, drawDataBuffer);
+    GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNTER_BINDING, counterBuffer);
+    if (pyramidFloats > 0)
+        GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, PYRAMID_BINDING, pyramidBuffer);
+
+    GLuint groups = static_cast<GLuint>((objects.size() + GROUP_SIZE - 1) / GROUP_SIZE);
+    GLuint groupsX = std::min(groups, MAX_GROUPS_X);
+    shader.dispatch(groupsX, (groups + groupsX - 1) / groupsX);
+    // the draws read the commands and the draw data texture, the copy the counter
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    // one count in flight at a time, fetched once its fence has passed
+    if (!readbackFence)
+    {
+        GLState::bindBuffer(GL_COPY_READ_BUFFER, counterBuffer);
+        GLState::bindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+        readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+void GpuCuller::draw(unsigned material, Shader &drawShader, VertexArrayCache &vertexArrays, unsigned textureUnit)
+{
+    if (objects.empty() || shader.isFailed() || material >= materials)
+        return;
+    GLState::bindTexture(textureUnit, GL_TEXTURE_BUFFER, drawDataTexture);
+    drawShader.setInt("drawData", static_cast<int>(textureUnit));
+    drawShader.setInt("drawIDBase", 0);
+    drawShader.flush();
+    GLState::bindVertexArray(vertexArrays.get(drawShader, MeshPool::format(), pool.vertexBuffer(), pool.indexBuffer(),
+                                              &MultiDrawBatch::drawIDFormat(), drawIDBuffer));
+    GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    size_t meshes = pool.meshCount();
+    size_t offset = material * meshes * sizeof(DrawElementsIndirectCommand);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void *>(offset),
+                                static_cast<GLsizei>(meshes), 0);
+}
+
+void GpuCuller::readCount()
+{
+    if (!readbackFence || glClientWaitSync(readbackFence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        return;
+    glDeleteSync(readbackFence);
+    readbackFence = 0;
+    GLuint count = 0;
+    GLState::bindBuffer(GL_COPY_READ_BUFFER, readbackBuffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GLuint), &count);
+    visible = count;
+}
+
+size_t GpuCuller::objectCount() const
+{
+    return objects.size();
+}
+
+size_t GpuCuller::visibleCount() const
+{
+    return visible;
+}
+
+std::string GpuCuller::report()
+{
+    readCount();
+    char text[64];
+    std::snprintf(text, sizeof(text), "gpu cull: %zu/%zu visible", visible, objects.size());
+    return text;
+}
@@ -0,0 +1,51 @@
+#include "Render/InstanceBuffer.h"
+
+InstanceBuffer::InstanceBuffer(StreamBuffer &stream, size_t capacity)
+    : stream(stream), instanceCapacity(capacity)
+{
+    current.data = NULL;
+    current.buffer = stream.buffer();
+    current.offset = 0;
+    current.size = 0;
+}
+
+const VertexFormat &InstanceBuffer::format()
+{
+    static VertexFormat layout(1);
+    if (layout.elements().empty())
+        layout.addMatrix("aInstanceModel", 4, 4).add("aInstanceColor", 4, GL_FLOAT);
+    return layout;
+}
+
+InstanceData *InstanceBuffer::map()
+{
+    current = stream.allocate(instanceCapacity * sizeof(InstanceData));
+    return static_cast<InstanceData *>(current.data);
+}
+
+void InstanceBuffer::unmap(size_t count)
+{
+    if (count > instanceCapacity)
+        count = instanceCapacity;
+    stream.commit(current, count * sizeof(InstanceData));
+}
+
+GLintptr InstanceBuffer::offset() const
+{
+    return current.offset;
+}
+
+GLuint InstanceBuffer::buffer() const
+{
+    return current.buffer;
+}
+
+size_t InstanceBuffer::capacity() const
+{
+    return instanceCapacity;
+}
+
+bool InstanceBuffer::isPersistent() const
+{
+    return stream.isPersistent();
+}
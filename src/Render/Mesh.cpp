@@ -0,0 +1,56 @@
+#include "Render/Mesh.h"
+#include "Core/GLState.h"
+
+Mesh::Mesh(const OBJLoader::MeshData &data)
+    : count(static_cast<GLsizei>(data.indices.size())),
+      minimum(data.bounds_min[0], data.bounds_min[1], data.bounds_min[2]),
+      maximum(data.bounds_max[0], data.bounds_max[1], data.bounds_max[2])
+{
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, data.vertices.size() * sizeof(float), data.vertices.data(), GL_STATIC_DRAW);
+    // GL_ELEMENT_ARRAY_BUFFER is VAO state, uploading needs none bound
+    GLState::bindVertexArray(0);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(uint32_t), data.indices.data(), GL_STATIC_DRAW);
+}
+
+Mesh::~Mesh()
+{
+    GLState::deleteBuffers(1, &vbo);
+    GLState::deleteBuffers(1, &ebo);
+}
+
+const VertexFormat &Mesh::format()
+{
+    static VertexFormat layout;
+    if (layout.elements().empty())
+        layout.add("aPos", 3, GL_FLOAT).add("aNormal", 3, GL_FLOAT).add("aTexCoord", 2, GL_FLOAT);
+    return layout;
+}
+
+GLuint Mesh::vertexBuffer() const
+{
+    return vbo;
+}
+
+GLuint Mesh::indexBuffer() const
+{
+    return ebo;
+}
+
+GLsizei Mesh::indexCount() const
+{
+    return count;
+}
+
+const Vec3 &Mesh::boundsMin() const
+{
+    return minimum;
+}
+
+const Vec3 &Mesh::boundsMax() const
+{
+    return maximum;
+}
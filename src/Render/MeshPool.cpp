@@ -0,0 +1,83 @@
+#include "Render/MeshPool.h"
+#include "Render/Mesh.h"
+#include "Core/GLState.h"
+
+MeshPool::MeshPool() : vbo(0), ebo(0)
+{
+}
+
+MeshPool::~MeshPool()
+{
+    if (vbo)
+        GLState::deleteBuffers(1, &vbo);
+    if (ebo)
+        GLState::deleteBuffers(1, &ebo);
+}
+
+uint32_t MeshPool::add(const OBJLoader::MeshData &data)
+{
+    Range range;
+    range.firstIndex = static_cast<GLuint>(indices.size());
+    range.indexCount = static_cast<GLuint>(data.indices.size());
+    range.baseVertex = static_cast<GLint>(vertices.size() / OBJLoader::FLOATS_PER_VERTEX);
+    range.boundsMin = Vec3(data.bounds_min[0], data.bounds_min[1], data.bounds_min[2]);
+    range.boundsMax = Vec3(data.bounds_max[0], data.bounds_max[1], data.bounds_max[2]);
+    range.lods[0].firstIndex = range.firstIndex;
+    range.lods[0].indexCount = range.indexCount;
+    range.lods[0].error = 0.0f;
+    range.lodCount = 1;
+    vertices.insert(vertices.end(), data.vertices.begin(), data.vertices.end());
+    indices.insert(indices.end(), data.indices.begin(), data.indices.end());
+    ranges.push_back(range);
+    return static_cast<uint32_t>(ranges.size() - 1);
+}
+
+void MeshPool::addLod(uint32_t mesh, const std::vector<uint32_t> &lodIndices, float error)
+{
+    Range &range = ranges.at(mesh);
+    if (range.lodCount >= MAX_LODS)
+        return;
+    Lod &lod = range.lods[range.lodCount++];
+    lod.firstIndex = static_cast<GLuint>(indices.size());
+    lod.indexCount = static_cast<GLuint>(lodIndices.size());
+    lod.error = error;
+    indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+}
+
+void MeshPool::upload()
+{
+    if (!vbo)
+        glGenBuffers(1, &vbo);
+    if (!ebo)
+        glGenBuffers(1, &ebo);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    GLState::bindVertexArray(0);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+}
+
+const MeshPool::Range &MeshPool::range(uint32_t mesh) const
+{
+    return ranges.at(mesh);
+}
+
+size_t MeshPool::meshCount() const
+{
+    return ranges.size();
+}
+
+GLuint MeshPool::vertexBuffer() const
+{
+    return vbo;
+}
+
+GLuint MeshPool::indexBuffer() const
+{
+    return ebo;
+}
+
+const VertexFormat &MeshPool::format()
+{
+    return Mesh::format();
+}
@@ -0,0 +1,492 @@
+#include "Render/MeshSimplifier.h"
+#include "Core/Math.h"
+#include "Core/Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <utility>
+
+namespace
+{
+    const uint32_t NONE = 0xFFFFFFFFu;
+    // squared normal and texcoord differences against squared distance,
+    // relative to the mesh's diagonal
+    const double NORMAL_WEIGHT = 0.001;
+    const double UV_WEIGHT = 0.01;
+    // planes through border edges against the planes of the triangles
+    const double BORDER_WEIGHT = 10.0;
+    // collapses turning a triangle further than this (cosine) are skipped
+    const double MIN_FLIP_DOT = 0.2;
+    // a level must keep at most this much of the one before to be kept
+    const double MIN_LEVEL_REDUCTION = 0.9;
+
+    enum Kind { MANIFOLD, BORDER, LOCKED };
+
+    // sum of squared distances to planes, as a symmetric 4x4 matrix; weight
+    // is the area of the triangles whose planes went in
+    struct Quadric {
+        double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+        double weight;
+
+        Quadric() : xx(0), xy(0), xz(0), xw(0), yy(0), yz(0), yw(0), zz(0), zw(0), ww(0), weight(0) {}
+
+        // plane n.p + d = 0 with a unit normal
+        void addPlane(const Vec3 &n, double d, double w)
+        {
+            xx += w * n.x * n.x; xy += w * n.x * n.y; xz += w * n.x * n.z; xw += w * n.x * d;
+            yy += w * n.y * n.y; yz += w * n.y * n.z; yw += w * n.y * d;
+            zz += w * n.z * n.z; zw += w * n.z * d;
+            ww += w * d * d;
+        }
+
+        Quadric &operator+=(const Quadric &o)
+        {
+            xx += o.xx; xy += o.xy; xz += o.xz; xw += o.xw; yy += o.yy;
+            yz += o.yz; yw += o.yw; zz += o.zz; zw += o.zw; ww += o.ww;
+            weight += o.weight;
+            return *this;
+        }
+
+        double evaluate(const Vec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            return xx * x * x + 2.0 * xy * x * y + 2.0 * xz * x * z + 2.0 * xw * x
+                 + yy * y * y + 2.0 * yz * y * z + 2.0 * yw * y
+                 + zz * z * z + 2.0 * zw * z + ww;
+        }
+    };
+
+    struct Candidate {
+        double cost;
+        uint32_t from;
+        uint32_t to;
+
+        bool operator>(const Candidate &o) const { return cost > o.cost; }
+    };
+
+    // vertex of the collapsing position -> vertex of the target position
+    typedef std::vector<std::pair<uint32_t, uint32_t> > Mapping;
+
+    // one mesh being simplified; positions are the welded vertex positions,
+    // triangles keep pointing at vertices
+    class Simplification {
+    public:
+        explicit Simplification(const OBJLoader::MeshData &mesh);
+
+        size_t triangleCount() const { return live; }
+        // collapses until at most targetIndexCount indices are left; false
+        // when no collapse is left before that
+        bool run(size_t targetIndexCount);
+        MeshLod level() const;
+
+    private:
+        Vec3 vertexPosition(uint32_t vertex) const
+        {
+            const float *v = &mesh.vertices[static_cast<size_t>(vertex) * OBJLoader::FLOATS_PER_VERTEX];
+            return Vec3(v[0], v[1], v[2]);
+        }
+        int corner(uint32_t triangle, uint32_t position) const
+        {
+            for (int c = 0; c < 3; ++c)
+                if (positionOf[corners[triangle * 3 + c]] == position)
+                    return c;
+            return -1;
+        }
+        void neighbours(uint32_t position, std::vector<uint32_t> &out) const;
+        double attributeDistance(uint32_t a, uint32_t b) const;
+        // cost of moving from onto to, negative when not allowed
+        double evaluate(uint32_t from, uint32_t to, Mapping &mapping) const;
+        void collapse(uint32_t from, uint32_t to, const Mapping &mapping);
+        void push(uint32_t from, uint32_t to);
+
+        const OBJLoader::MeshData &mesh;
+        std::vector<uint32_t> positionOf;       // per vertex
+        std::vector<Vec3> positions;
+        std::vector<Kind> kinds;
+        std::vector<Quadric> quadrics;
+        std::vector<char> removed;
+        std::vector<std::vector<uint32_t> > around;     // triangles of each position
+        std::vector<uint32_t> corners;          // vertices, 3 per triangle
+        std::vector<char> alive;
+        size_t live;
+        double attributeScale;
+        double error;
+        std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate> > heap;
+        // scratch of evaluate() and push()
+        mutable std::vector<uint32_t> fromNeighbours;
+        mutable std::vector<uint32_t> toNeighbours;
+        Mapping scratch;
+    };
+
+    Simplification::Simplification(const OBJLoader::MeshData &mesh)
+        : mesh(mesh), live(0), error(0.0)
+    {
+        // weld: vertices with the same position become one position
+        size_t vertexCount = mesh.vertices.size() / OBJLoader::FLOATS_PER_VERTEX;
+        std::vector<uint32_t> order(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v)
+            order[v] = static_cast<uint32_t>(v);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            const float *pa = &mesh.vertices[static_cast<size_t>(a) * OBJLoader::FLOATS_PER_VERTEX];
+            const float *pb = &mesh.vertices[static_cast<size_t>(b) * OBJLoader::FLOATS_PER_VERTEX];
+            return std::lexicographical_compare(pa, pa + 3, pb, pb + 3);
+        });
+        positionOf.assign(vertexCount, NONE);
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            Vec3 p = vertexPosition(order[i]);
+            if (positions.empty() || p.x != positions.back().x || p.y != positions.back().y
+                || p.z != positions.back().z)
+                positions.push_back(p);
+            positionOf[order[i]] = static_cast<uint32_t>(positions.size() - 1);
+        }
+
+        // triangles that are not degenerate once welded
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            uint32_t a = positionOf[mesh.indices[i]], b = positionOf[mesh.indices[i + 1]], c = positionOf[mesh.indices[i + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            corners.insert(corners.end(), mesh.indices.begin() + i, mesh.indices.begin() + i + 3);
+        }
+        live = corners.size() / 3;
+        alive.assign(live, 1);
+        around.resize(positions.size());
+        quadrics.resize(positions.size());
+        removed.assign(positions.size(), 0);
+        kinds.assign(positions.size(), MANIFOLD);
+
+        // edges by their positions, counted over the triangles
+        std::vector<std::pair<uint64_t, uint32_t> > edges;
+        for (uint32_t t = 0; t < live; ++t)
+        {
+            Vec3 p[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                uint32_t position = positionOf[corners[t * 3 + c]];
+                around[position].push_back(t);
+                p[c] = positions[position];
+            }
+            Vec3 normal = Vec3::cross(p[1] - p[0], p[2] - p[0]);
+            double area = normal.length() * 0.5;
+            normal = normal.normalized();
+            Quadric plane;
+            plane.addPlane(normal, -Vec3::dot(normal, p[0]), area);
+            plane.weight = area;
+            for (int c = 0; c < 3; ++c)
+            {
+                quadrics[positionOf[corners[t * 3 + c]]] += plane;
+                uint32_t a = positionOf[corners[t * 3 + c]], b = positionOf[corners[t * 3 + (c + 1) % 3]];
+                uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+                edges.push_back(std::make_pair(key, t * 3 + c));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size();)
+        {
+            size_t j = i;
+            while (j < edges.size() && edges[j].first == edges[i].first)
+                ++j;
+            uint32_t a = static_cast<uint32_t>(edges[i].first >> 32);
+            uint32_t b = static_cast<uint32_t>(edges[i].first);
+            if (j - i > 2)
+                kinds[a] = kinds[b] = LOCKED;
+            else if (j - i == 1)
+            {
+                if (kinds[a] != LOCKED)
+                    kinds[a] = BORDER;
+                if (kinds[b] != LOCKED)
+                    kinds[b] = BORDER;
+                // a plane through the edge, upright on its triangle
+                uint32_t t = edges[i].second / 3;
+                Vec3 pa = positions[a], pb = positions[b];
+                Vec3 faceNormal = Vec3::cross(positions[positionOf[corners[t * 3 + 1]]] - positions[positionOf[corners[t * 3]]],
+                                              positions[positionOf[corners[t * 3 + 2]]] - positions[positionOf[corners[t * 3]]]);
+                Vec3 edge = pb - pa;
+                Vec3 normal = Vec3::cross(edge, faceNormal).normalized();
+                Quadric plane;
+                plane.addPlane(normal, -Vec3::dot(normal, pa), Vec3::dot(edge, edge) * BORDER_WEIGHT);
+                quadrics[a] += plane;
+                quadrics[b] += plane;
+            }
+            i = j;
+        }
+
+        Vec3 diagonal(mesh.bounds_max[0] - mesh.bounds_min[0], mesh.bounds_max[1] - mesh.bounds_min[1],
+                      mesh.bounds_max[2] - mesh.bounds_min[2]);
+        attributeScale = Vec3::dot(diagonal, diagonal);
+
+        for (size_t i = 0; i < edges.size(); ++i)
+        {
+            if (i > 0 && edges[i].first == edges[i - 1].first)
+                continue;
+            uint32_t a = static_cast<uint32_t>(edges[i].first >> 32);
+            uint32_t b = static_cast<uint32_t>(edges[i].first);
+            push(a, b);
+            push(b, a);
+        }
+    }
+
+    void Simplification::neighbours(uint32_t position, std::vector<uint32_t> &out) const
+    {
+        out.clear();
+        const std::vector<uint32_t> &triangles = around[position];
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            uint32_t t = triangles[i];
+            if (!alive[t])
+                continue;
+            for (int c = 0; c < 3; ++c)
+            {
+                uint32_t p = positionOf[corners[t * 3 + c]];
+                if (p != position)
+                    out.push_back(p);
+            }
+        }
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+    double Simplification::attributeDistance(uint32_t a, uint32_t b) const
+    {
+        const float *va = &mesh.vertices[static_cast<size_t>(a) * OBJLoader::FLOATS_PER_VERTEX];
+        const float *vb = &mesh.vertices[static_cast<size_t>(b) * OBJLoader::FLOATS_PER_VERTEX];
+        double normal = 0.0, uv = 0.0;
+        for (int k = 3; k < 6; ++k)
+            normal += (va[k] - vb[k]) * (va[k] - vb[k]);
+        for (int k = 6; k < 8; ++k)
+            uv += (va[k] - vb[k]) * (va[k] - vb[k]);
+        return normal * NORMAL_WEIGHT + uv * UV_WEIGHT;
+    }
+
+    double Simplification::evaluate(uint32_t from, uint32_t to, Mapping &mapping) const
+    {
+        if (removed[from] || removed[to] || kinds[from] == LOCKED)
+            return -1.0;
+        const std::vector<uint32_t> &triangles = around[from];
+
+        // each vertex at from goes to the vertex at to it shares a triangle with
+        mapping.clear();
+        size_t shared = 0;
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            uint32_t t = triangles[i];
+            int c = alive[t] ? corner(t, to) : -1;
+            if (c < 0)
+                continue;
+            ++shared;
+            uint32_t vertex = corners[t * 3 + corner(t, from)], target = corners[t * 3 + c];
+            size_t m = 0;
+            while (m < mapping.size() && mapping[m].first != vertex)
+                ++m;
+            if (m == mapping.size())
+                mapping.push_back(std::make_pair(vertex, target));
+            else if (mapping[m].second != target)
+                return -1.0;
+        }
+        if (shared == 0)
+            return -1.0;
+        // borders slide along themselves only
+        if (kinds[from] == BORDER && (kinds[to] != BORDER || shared != 1))
+            return -1.0;
+        // a vertex with no triangle on the edge would lose its attributes:
+        // a seam crossed instead of followed
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            uint32_t t = triangles[i];
+            if (!alive[t])
+                continue;
+            uint32_t vertex = corners[t * 3 + corner(t, from)];
+            size_t m = 0;
+            while (m < mapping.size() && mapping[m].first != vertex)
+                ++m;
+            if (m == mapping.size())
+                return -1.0;
+        }
+
+        // link condition: the positions next to both ends are the far
+        // corners of the edge's triangles, or the surface would pinch
+        neighbours(from, fromNeighbours);
+        neighbours(to, toNeighbours);
+        size_t common = 0;
+        for (size_t i = 0, j = 0; i < fromNeighbours.size() && j < toNeighbours.size();)
+        {
+            if (fromNeighbours[i] < toNeighbours[j])
+                ++i;
+            else if (toNeighbours[j] < fromNeighbours[i])
+                ++j;
+            else
+            {
+                ++common;
+                ++i;
+                ++j;
+            }
+        }
+        if (common != shared)
+            return -1.0;
+
+        // the triangles that stay must not turn over
+        const Vec3 &target = positions[to];
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            uint32_t t = triangles[i];
+            if (!alive[t] || corner(t, to) >= 0)
+                continue;
+            Vec3 before[3], after[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                uint32_t p = positionOf[corners[t * 3 + c]];
+                before[c] = positions[p];
+                after[c] = p == from ? target : positions[p];
+            }
+            Vec3 n0 = Vec3::cross(before[1] - before[0], before[2] - before[0]);
+            Vec3 n1 = Vec3::cross(after[1] - after[0], after[2] - after[0]);
+            double dot = Vec3::dot(n0, n1);
+            if (dot <= MIN_FLIP_DOT * n0.length() * n1.length())
+                return -1.0;
+        }
+
+        Quadric q = quadrics[from];
+        q += quadrics[to];
+        double distance = std::max(0.0, q.evaluate(target)) / std::max(q.weight, 1e-30);
+        double attributes = 0.0;
+        for (size_t m = 0; m < mapping.size(); ++m)
+            attributes = std::max(attributes, attributeDistance(mapping[m].first, mapping[m].second));
+        return distance + attributes * attributeScale;
+    }
+
+    void Simplification::push(uint32_t from, uint32_t to)
+    {
+        double cost = evaluate(from, to, scratch);
+        if (cost >= 0.0)
+        {
+            Candidate candidate = { cost, from, to };
+            heap.push(candidate);
+        }
+    }
+
+    void Simplification::collapse(uint32_t from, uint32_t to, const Mapping &mapping)
+    {
+        std::vector<uint32_t> &triangles = around[from];
+        std::vector<uint32_t> &target = around[to];
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            uint32_t t = triangles[i];
+            if (!alive[t])
+                continue;
+            if (corner(t, to) >= 0)
+            {
+                alive[t] = 0;
+                --live;
+                continue;
+            }
+            uint32_t &vertex = corners[t * 3 + corner(t, from)];
+            for (size_t m = 0; m < mapping.size(); ++m)
+                if (mapping[m].first == vertex)
+                {
+                    vertex = mapping[m].second;
+                    break;
+                }
+            target.push_back(t);
+        }
+        std::vector<uint32_t>().swap(triangles);
+        size_t kept = 0;
+        for (size_t i = 0; i < target.size(); ++i)
+            if (alive[target[i]])
+                target[kept++] = target[i];
+        target.resize(kept);
+        quadrics[to] += quadrics[from];
+        removed[from] = 1;
+
+        // every edge at to changed: its quadric and its triangles
+        std::vector<uint32_t> next;
+        neighbours(to, next);
+        for (size_t i = 0; i < next.size(); ++i)
+        {
+            push(to, next[i]);
+            push(next[i], to);
+        }
+    }
+
+    bool Simplification::run(size_t targetIndexCount)
+    {
+        Mapping mapping;
+        while (live * 3 > targetIndexCount)
+        {
+            if (heap.empty())
+                return false;
+            Candidate candidate = heap.top();
+            heap.pop();
+            double cost = evaluate(candidate.from, candidate.to, mapping);
+            if (cost < 0.0)
+                continue;
+            // stale: the neighbourhood changed since it was queued
+            if (cost > candidate.cost * (1.0 + 1e-6) + 1e-12)
+            {
+                candidate.cost = cost;
+                heap.push(candidate);
+                continue;
+            }
+            error = std::max(error, cost);
+            collapse(candidate.from, candidate.to, mapping);
+        }
+        return true;
+    }
+
+    MeshLod Simplification::level() const
+    {
+        MeshLod lod;
+        lod.indices.reserve(live * 3);
+        for (size_t t = 0; t < alive.size(); ++t)
+            if (alive[t])
+                lod.indices.insert(lod.indices.end(), corners.begin() + t * 3, corners.begin() + t * 3 + 3);
+        lod.error = static_cast<float>(std::sqrt(error));
+        return lod;
+    }
+}
+
+std::vector<MeshLod> MeshSimplifier::simplify(const OBJLoader::MeshData &mesh, const std::vector<size_t> &targetIndexCounts)
+{
+    Simplification simplification(mesh);
+    std::vector<MeshLod> levels;
+    for (size_t i = 0; i < targetIndexCounts.size(); ++i)
+    {
+        bool reached = simplification.run(targetIndexCounts[i]);
+        levels.push_back(simplification.level());
+        if (!reached)
+            break;
+    }
+    return levels;
+}
+
+std::vector<MeshLod> MeshSimplifier::buildChain(const OBJLoader::MeshData &mesh)
+{
+    size_t triangles = mesh.indices.size() / 3;
+    std::vector<size_t> targets;
+    for (size_t l = 0; l < LOD_LEVELS; ++l)
+        targets.push_back((triangles >> (l + 1)) * 3);
+    std::vector<MeshLod> levels = simplify(mesh, targets);
+
+    std::vector<MeshLod> chain;
+    size_t previous = mesh.indices.size();
+    for (size_t l = 0; l < levels.size(); ++l)
+    {
+        if (levels[l].indices.empty() || levels[l].indices.size() > previous * MIN_LEVEL_REDUCTION)
+            continue;
+        previous = levels[l].indices.size();
+        chain.push_back(levels[l]);
+    }
+    return chain;
+}
+
+std::vector<std::vector<MeshLod> > MeshSimplifier::buildChains(const std::vector<const OBJLoader::MeshData *> &meshes)
+{
+    std::vector<std::vector<MeshLod> > chains(meshes.size());
+    Parallel::forChunks(meshes.size(), 1, [&](size_t, size_t begin, size_t end) {
+        for (size_t m = begin; m < end; ++m)
+            chains[m] = buildChain(*meshes[m]);
+    });
+    return chains;
+}
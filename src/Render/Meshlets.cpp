@@ -0,0 +1,382 @@
+#include "Render/Meshlets.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+# include <emmintrin.h>
+# define MESHLETS_SSE2
+#endif
+
+namespace
+{
+    const uint32_t NONE = 0xFFFFFFFFu;
+    // how much a candidate triangle's facing counts against the vertices it adds
+    const float CONE_WEIGHT = 0.5f;
+    // meshlets whose triangles spread wider than this (cosine to the axis)
+    // keep a cone that never culls
+    const float MIN_CONE_DOT = 0.1f;
+
+    Vec3 position(const OBJLoader::MeshData &mesh, uint32_t vertex)
+    {
+        const float *v = &mesh.vertices[static_cast<size_t>(vertex) * OBJLoader::FLOATS_PER_VERTEX];
+        return Vec3(v[0], v[1], v[2]);
+    }
+
+    // bounding sphere and normal cone of the triangles starting at index first
+    Meshlet bound(const OBJLoader::MeshData &mesh, const std::vector<Vec3> &normals,
+                  const std::vector<uint32_t> &vertices, const std::vector<uint32_t> &triangles,
+                  const Vec3 &normalSum, uint32_t first)
+    {
+        AABB box;
+        for (size_t i = 0; i < vertices.size(); ++i)
+            box.grow(position(mesh, vertices[i]));
+        Meshlet meshlet;
+        meshlet.center = box.center();
+        meshlet.radius = 0.0f;
+        for (size_t i = 0; i < vertices.size(); ++i)
+            meshlet.radius = std::max(meshlet.radius, (position(mesh, vertices[i]) - meshlet.center).length());
+        // the cone's half angle reaches the normal farthest from the axis
+        meshlet.coneAxis = normalSum.normalized();
+        float minDot = normalSum.length() > 0.0f ? 1.0f : -1.0f;
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            const Vec3 &n = normals[triangles[i]];
+            if (Vec3::dot(n, n) > 0.0f)
+                minDot = std::min(minDot, Vec3::dot(n, meshlet.coneAxis));
+        }
+        meshlet.coneCutoff = minDot <= MIN_CONE_DOT ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+        meshlet.firstIndex = first;
+        meshlet.indexCount = static_cast<uint32_t>(triangles.size() * 3);
+        meshlet.vertexCount = static_cast<uint32_t>(vertices.size());
+        return meshlet;
+    }
+
+    // appends a meshlet's range, merged into the last one when they touch
+    inline void emitRange(std::vector<IndexRange> &ranges, uint32_t first, uint32_t count)
+    {
+        if (!ranges.empty() && ranges.back().first + ranges.back().count == first)
+            ranges.back().count += count;
+        else
+        {
+            IndexRange range;
+            range.first = first;
+            range.count = count;
+            ranges.push_back(range);
+        }
+    }
+}
+
+Meshlets::Meshlets() : count(0), triangles(0)
+{
+}
+
+size_t Meshlets::build(OBJLoader::MeshData &mesh)
+{
+    clear();
+    size_t vertices = mesh.vertices.size() / OBJLoader::FLOATS_PER_VERTEX;
+    size_t triangleTotal = mesh.indices.size() / 3;
+    const std::vector<uint32_t> &indices = mesh.indices;
+
+    // unit face normals, zero for degenerate triangles
+    std::vector<Vec3> normals(triangleTotal);
+    for (size_t t = 0; t < triangleTotal; ++t)
+    {
+        Vec3 a = position(mesh, indices[t * 3]);
+        Vec3 b = position(mesh, indices[t * 3 + 1]);
+        Vec3 c = position(mesh, indices[t * 3 + 2]);
+        normals[t] = Vec3::cross(b - a, c - a).normalized();
+    }
+
+    // triangles around each vertex, and how many of them are still unused
+    std::vector<uint32_t> adjacencyStart(vertices + 1, 0);
+    for (size_t i = 0; i < indices.size(); ++i)
+        ++adjacencyStart[indices[i] + 1];
+    for (size_t v = 0; v < vertices; ++v)
+        adjacencyStart[v + 1] += adjacencyStart[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> live(vertices, 0);
+    for (size_t i = 0; i < indices.size(); ++i)
+        adjacency[adjacencyStart[indices[i]] + live[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+    std::vector<bool> emitted(triangleTotal, false);
+    // meshlet that last took each vertex
+    std::vector<uint32_t> owner(vertices, NONE);
+    std::vector<uint32_t> reordered;
+    reordered.reserve(indices.size());
+
+    std::vector<uint32_t> current;      // vertices of the open meshlet
+    std::vector<uint32_t> currentTriangles;
+    Vec3 normalSum;
+    uint32_t meshletIndex = 0;
+    size_t seed = 0;
+
+    for (size_t done = 0; done < triangleTotal; ++done)
+    {
+        // the candidate sharing the most vertices and facing closest to the
+        // meshlet; bestAny ignores the limits and seeds the next meshlet
+        uint32_t best = NONE, bestAny = NONE;
+        float bestScore = HUGE_VALF, bestAnyScore = HUGE_VALF;
+        Vec3 axis = normalSum.normalized();
+        for (size_t c = 0; c < current.size(); ++c)
+        {
+            uint32_t v = current[c];
+            if (live[v] == 0)
+                continue;
+            for (uint32_t a = adjacencyStart[v]; a < adjacencyStart[v + 1]; ++a)
+            {
+                uint32_t t = adjacency[a];
+                if (emitted[t])
+                    continue;
+                uint32_t extra = 0;
+                for (int k = 0; k < 3; ++k)
+                    extra += owner[indices[t * 3 + k]] != meshletIndex ? 1 : 0;
+                float score = extra + CONE_WEIGHT * (1.0f - Vec3::dot(normals[t], axis));
+                if (score < bestAnyScore)
+                {
+                    bestAny = t;
+                    bestAnyScore = score;
+                }
+                if (current.size() + extra <= MAX_VERTICES && score < bestScore)
+                {
+                    best = t;
+                    bestScore = score;
+                }
+            }
+        }
+        if (currentTriangles.size() >= MAX_TRIANGLES)
+            best = NONE;
+        if (best == NONE)
+        {
+            if (!currentTriangles.empty())
+            {
+                add(bound(mesh, normals, current, currentTriangles, normalSum,
+                          static_cast<uint32_t>(reordered.size() - currentTriangles.size() * 3)));
+                current.clear();
+                currentTriangles.clear();
+                normalSum = Vec3();
+                ++meshletIndex;
+            }
+            if (bestAny != NONE)
+                best = bestAny;
+            else
+            {
+                // nothing connected left: the next unused triangle in mesh order
+                while (emitted[seed])
+                    ++seed;
+                best = static_cast<uint32_t>(seed);
+            }
+        }
+
+        emitted[best] = true;
+        currentTriangles.push_back(best);
+        normalSum += normals[best];
+        for (int k = 0; k < 3; ++k)
+        {
+            uint32_t v = indices[best * 3 + k];
+            reordered.push_back(v);
+            --live[v];
+            if (owner[v] != meshletIndex)
+            {
+                owner[v] = meshletIndex;
+                current.push_back(v);
+            }
+        }
+    }
+    if (!currentTriangles.empty())
+        add(bound(mesh, normals, current, currentTriangles, normalSum,
+                  static_cast<uint32_t>(reordered.size() - currentTriangles.size() * 3)));
+
+    mesh.indices.swap(reordered);
+    triangles = triangleTotal;
+    return count;
+}
+
+void Meshlets::add(const Meshlet &meshlet)
+{
+    if (count % GROUP == 0)
+    {
+        // a new group of padding: infinitely negative radius, never visible
+        size_t padded = count + GROUP;
+        centerX.resize(padded, 0.0f);
+        centerY.resize(padded, 0.0f);
+        centerZ.resize(padded, 0.0f);
+        radius.resize(padded, -std::numeric_limits<float>::infinity());
+        axisX.resize(padded, 0.0f);
+        axisY.resize(padded, 0.0f);
+        axisZ.resize(padded, 0.0f);
+        cutoff.resize(padded, 1.0f);
+        firstIndex.resize(padded, 0);
+        indexCount.resize(padded, 0);
+        vertexCount.resize(padded, 0);
+    }
+    size_t i = count++;
+    centerX[i] = meshlet.center.x;
+    centerY[i] = meshlet.center.y;
+    centerZ[i] = meshlet.center.z;
+    radius[i] = meshlet.radius;
+    axisX[i] = meshlet.coneAxis.x;
+    axisY[i] = meshlet.coneAxis.y;
+    axisZ[i] = meshlet.coneAxis.z;
+    cutoff[i] = meshlet.coneCutoff;
+    firstIndex[i] = meshlet.firstIndex;
+    indexCount[i] = meshlet.indexCount;
+    vertexCount[i] = meshlet.vertexCount;
+}
+
+void Meshlets::clear()
+{
+    count = 0;
+    triangles = 0;
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    radius.clear();
+    axisX.clear();
+    axisY.clear();
+    axisZ.clear();
+    cutoff.clear();
+    firstIndex.clear();
+    indexCount.clear();
+    vertexCount.clear();
+}
+
+size_t Meshlets::size() const
+{
+    return count;
+}
+
+Meshlet Meshlets::meshlet(size_t i) const
+{
+    Meshlet meshlet;
+    meshlet.center = Vec3(centerX[i], centerY[i], centerZ[i]);
+    meshlet.radius = radius[i];
+    meshlet.coneAxis = Vec3(axisX[i], axisY[i], axisZ[i]);
+    meshlet.coneCutoff = cutoff[i];
+    meshlet.firstIndex = firstIndex[i];
+    meshlet.indexCount = indexCount[i];
+    meshlet.vertexCount = vertexCount[i];
+    return meshlet;
+}
+
+size_t Meshlets::triangleCount() const
+{
+    return triangles;
+}
+
+size_t Meshlets::cull(const Frustum &frustum, const Vec3 &eye, std::vector<IndexRange> &ranges) const
+{
+    // a meshlet is drawn when its sphere touches every plane and the eye is
+    // not inside the cone's back side:
+    // dot(center - eye, axis) >= cutoff * |center - eye| + radius culls it
+    size_t kept = 0;
+    size_t groups = (count + GROUP - 1) / GROUP;
+#if defined(__AVX2__)
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 eyeX = _mm256_set1_ps(eye.x), eyeY = _mm256_set1_ps(eye.y), eyeZ = _mm256_set1_ps(eye.z);
+    for (size_t g = 0; g < groups; ++g)
+    {
+        size_t i = g * GROUP;
+        __m256 cx = _mm256_loadu_ps(&centerX[i]);
+        __m256 cy = _mm256_loadu_ps(&centerY[i]);
+        __m256 cz = _mm256_loadu_ps(&centerZ[i]);
+        __m256 r = _mm256_loadu_ps(&radius[i]);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p)
+        {
+            const Vec4 &plane = frustum.planes[p];
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)),
+                                                   _mm256_mul_ps(cy, _mm256_set1_ps(plane.y))),
+                                     _mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_GE_OQ));
+        }
+        __m256 dx = _mm256_sub_ps(cx, eyeX), dy = _mm256_sub_ps(cy, eyeY), dz = _mm256_sub_ps(cz, eyeZ);
+        __m256 facing = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, _mm256_loadu_ps(&axisX[i])),
+                                                    _mm256_mul_ps(dy, _mm256_loadu_ps(&axisY[i]))),
+                                      _mm256_mul_ps(dz, _mm256_loadu_ps(&axisZ[i])));
+        __m256 distance = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                                       _mm256_mul_ps(dz, dz)));
+        __m256 back = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&cutoff[i]), distance), r);
+        inside = _mm256_andnot_ps(_mm256_cmp_ps(facing, back, _CMP_GE_OQ), inside);
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(inside));
+        while (mask)
+        {
+            size_t m = i + static_cast<size_t>(__builtin_ctz(mask));
+            emitRange(ranges, firstIndex[m], indexCount[m]);
+            kept += indexCount[m] / 3;
+            mask &= mask - 1;
+        }
+    }
+#elif defined(MESHLETS_SSE2)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 eyeX = _mm_set1_ps(eye.x), eyeY = _mm_set1_ps(eye.y), eyeZ = _mm_set1_ps(eye.z);
+    for (size_t g = 0; g < groups; ++g)
+    {
+        for (size_t half = 0; half < GROUP; half += 4)
+        {
+            size_t i = g * GROUP + half;
+            __m128 cx = _mm_loadu_ps(&centerX[i]);
+            __m128 cy = _mm_loadu_ps(&centerY[i]);
+            __m128 cz = _mm_loadu_ps(&centerZ[i]);
+            __m128 r = _mm_loadu_ps(&radius[i]);
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                const Vec4 &plane = frustum.planes[p];
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+                                      _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+            }
+            __m128 dx = _mm_sub_ps(cx, eyeX), dy = _mm_sub_ps(cy, eyeY), dz = _mm_sub_ps(cz, eyeZ);
+            __m128 facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&axisX[i])),
+                                                  _mm_mul_ps(dy, _mm_loadu_ps(&axisY[i]))),
+                                       _mm_mul_ps(dz, _mm_loadu_ps(&axisZ[i])));
+            __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                                                     _mm_mul_ps(dz, dz)));
+            __m128 back = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&cutoff[i]), distance), r);
+            inside = _mm_andnot_ps(_mm_cmpge_ps(facing, back), inside);
+            unsigned mask = static_cast<unsigned>(_mm_movemask_ps(inside));
+            while (mask)
+            {
+                size_t m = i + static_cast<size_t>(__builtin_ctz(mask));
+                emitRange(ranges, firstIndex[m], indexCount[m]);
+                kept += indexCount[m] / 3;
+                mask &= mask - 1;
+            }
+        }
+    }
+#else
+    for (size_t i = 0; i < groups * GROUP; ++i)
+    {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; ++p)
+        {
+            const Vec4 &plane = frustum.planes[p];
+            inside = centerX[i] * plane.x + centerY[i] * plane.y + centerZ[i] * plane.z + plane.w + radius[i] >= 0.0f;
+        }
+        if (!inside)
+            continue;
+        Vec3 toCenter(centerX[i] - eye.x, centerY[i] - eye.y, centerZ[i] - eye.z);
+        float facing = toCenter.x * axisX[i] + toCenter.y * axisY[i] + toCenter.z * axisZ[i];
+        if (facing >= cutoff[i] * toCenter.length() + radius[i])
+            continue;
+        emitRange(ranges, firstIndex[i], indexCount[i]);
+        kept += indexCount[i] / 3;
+    }
+#endif
+    return kept;
+}
+
+const char *Meshlets::simdPath()
+{
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(MESHLETS_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,165 @@
+#include "Render/MultiDrawBatch.h"
+#include "Core/GLCaps.h"
+#include "Core/GLState.h"
+
+#include <cstring>
+#include <stdexcept>
+
+MultiDrawBatch::MultiDrawBatch(StreamBuffer &stream, size_t maxDraws, size_t maxCommands)
+    : stream(stream), maxDraws(maxDraws), maxCommands(maxCommands ? maxCommands : maxDraws),
+      indirect(indirectSupported()), drawBase(0), calls(0)
+{
+    commands.reserve(this->maxCommands);
+    drawData.reserve(maxDraws);
+
+    // aDrawID source: 0, 1, 2, ... read through baseInstance
+    std::vector<GLint> ids(maxDraws);
+    for (size_t i = 0; i < maxDraws; ++i)
+        ids[i] = static_cast<GLint>(i);
+    glGenBuffers(1, &drawIDBuffer);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, drawIDBuffer);
+    glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLint), ids.data(), GL_STATIC_DRAW);
+
+    // glTexBufferRange would need GL 4.3, so the texture covers the whole
+    // stream and drawIDBase points at this frame's data
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    if (stream.size() / 16 > static_cast<size_t>(maxTexels))
+        throw std::runtime_error("Stream buffer too large for a texture buffer");
+    glGenTextures(1, &drawDataTexture);
+    GLState::bindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, stream.buffer());
+
+    commandAllocation.data = NULL;
+    commandAllocation.buffer = stream.buffer();
+    commandAllocation.offset = 0;
+    commandAllocation.size = 0;
+}
+
+MultiDrawBatch::~MultiDrawBatch()
+{
+    GLState::deleteTextures(1, &drawDataTexture);
+    GLState::deleteBuffers(1, &drawIDBuffer);
+}
+
+bool MultiDrawBatch::indirectSupported()
+{
+    // base instance (4.2) is needed as well, 4.3 has both; the loader only
+    // resolves the entry point for contexts that have it
+    bool available = GLAD_GL_VERSION_4_3
+        || (GLCaps::hasExtension("GL_ARB_multi_draw_indirect") && GLCaps::hasExtension("GL_ARB_base_instance"));
+    return available && glMultiDrawElementsIndirect != NULL;
+}
+
+const VertexFormat &MultiDrawBatch::drawIDFormat()
+{
+    static VertexFormat layout(1);
+    if (layout.elements().empty())
+        layout.addInteger("aDrawID", 1, GL_INT);
+    return layout;
+}
+
+void MultiDrawBatch::clear()
+{
+    commands.clear();
+    drawData.clear();
+}
+
+bool MultiDrawBatch::add(const MeshPool::Range &range, const InstanceData &data)
+{
+    IndexRange whole;
+    whole.first = 0;
+    whole.count = range.indexCount;
+    return add(range, data, &whole, 1);
+}
+
+bool MultiDrawBatch::add(const MeshPool::Range &range, const InstanceData &data, const IndexRange *parts, size_t partCount)
+{
+    if (drawData.size() >= maxDraws || commands.size() + partCount > maxCommands)
+        return false;
+    DrawElementsIndirectCommand command;
+    command.instanceCount = 1;
+    command.baseVertex = range.baseVertex;
+    command.baseInstance = static_cast<GLuint>(drawData.size());
+    for (size_t i = 0; i < partCount; ++i)
+    {
+        command.count = parts[i].count;
+        command.firstIndex = range.firstIndex + parts[i].first;
+        commands.push_back(command);
+    }
+    drawData.push_back(data);
+    return true;
+}
+
+void MultiDrawBatch::upload()
+{
+    if (commands.empty())
+        return;
+    // aligned to whole InstanceData so the offset is an index for texelFetch
+    size_t bytes = drawData.size() * sizeof(InstanceData);
+    StreamBuffer::Allocation data = stream.allocate(bytes, sizeof(InstanceData));
+    std::memcpy(data.data, drawData.data(), bytes);
+    stream.commit(data);
+    drawBase = static_cast<GLint>(data.offset / sizeof(InstanceData));
+    if (indirect)
+    {
+        bytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+        commandAllocation = stream.allocate(bytes, sizeof(GLuint));
+        std::memcpy(commandAllocation.data, commands.data(), bytes);
+        stream.commit(commandAllocation);
+    }
+}
+
+void MultiDrawBatch::draw(Shader &shader, VertexArrayCache &vertexArrays, const MeshPool &pool, unsigned textureUnit)
+{
+    calls = 0;
+    if (commands.empty())
+        return;
+    GLState::bindTexture(textureUnit, GL_TEXTURE_BUFFER, drawDataTexture);
+    shader.setInt("drawData", static_cast<int>(textureUnit));
+    shader.setInt("drawIDBase", drawBase);
+    shader.flush();
+    GLState::bindVertexArray(vertexArrays.get(shader, MeshPool::format(), pool.vertexBuffer(), pool.indexBuffer(),
+                                              &drawIDFormat(), drawIDBuffer));
+    if (indirect)
+    {
+        GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandAllocation.buffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                    reinterpret_cast<const void *>(static_cast<uintptr_t>(commandAllocation.offset)),
+                                    static_cast<GLsizei>(commands.size()), 0);
+        calls = 1;
+        return;
+    }
+    // without base instance aDrawID always reads 0, the uniform carries the index
+    UniformHandle base = shader.uniform("drawIDBase");
+    for (size_t i = 0; i < commands.size(); ++i)
+    {
+        const DrawElementsIndirectCommand &command = commands[i];
+        shader.setInt(base, drawBase + static_cast<int>(command.baseInstance));
+        shader.flush();
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(command.count), GL_UNSIGNED_INT,
+                                 reinterpret_cast<const void *>(static_cast<uintptr_t>(command.firstIndex * sizeof(GLuint))),
+                                 command.baseVertex);
+    }
+    calls = commands.size();
+}
+
+size_t MultiDrawBatch::drawCount() const
+{
+    return drawData.size();
+}
+
+size_t MultiDrawBatch::commandCount() const
+{
+    return commands.size();
+}
+
+size_t MultiDrawBatch::submittedCalls() const
+{
+    return calls;
+}
+
+bool MultiDrawBatch::usesIndirect() const
+{
+    return indirect;
+}
@@ -0,0 +1,671 @@
+#include "Render/OcclusionCuller.h"
+#include "Core/Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+# include <emmintrin.h>
+# define OCCLUSION_SSE2
+#endif
+
+namespace
+{
+    // box corners this close to the eye plane make the box visible; occluder
+    // triangles are clipped to the near plane first, this only catches
+    // projections whose near plane sits at the eye
+    const float MIN_W = 1e-4f;
+
+    struct ClipVertex {
+        float x, y, z, w;
+    };
+
+    ClipVertex toClip(const Mat4 &m, const Vec3 &p)
+    {
+        ClipVertex v;
+        v.x = m.m[0] * p.x + m.m[4] * p.y + m.m[8] * p.z + m.m[12];
+        v.y = m.m[1] * p.x + m.m[5] * p.y + m.m[9] * p.z + m.m[13];
+        v.z = m.m[2] * p.x + m.m[6] * p.y + m.m[10] * p.z + m.m[14];
+        v.w = m.m[3] * p.x + m.m[7] * p.y + m.m[11] * p.z + m.m[15];
+        return v;
+    }
+
+    // proxy lines run this far off the cell centers, in cells
+    const float LINE_JITTER_U = 0.0137f;
+    const float LINE_JITTER_V = 0.0291f;
+
+    struct Triangle {
+        float p[3][3];
+    };
+
+    // where the line along axis through (lineU, lineV) on the two other
+    // axes crosses the triangle
+    bool lineHit(const Triangle &tri, int axis, float lineU, float lineV, float &hit)
+    {
+        int u = (axis + 1) % 3, v = (axis + 2) % 3;
+        float weights[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            const float *b = tri.p[(k + 1) % 3], *c = tri.p[(k + 2) % 3];
+            weights[k] = (c[u] - b[u]) * (lineV - b[v]) - (c[v] - b[v]) * (lineU - b[u]);
+        }
+        float total = weights[0] + weights[1] + weights[2];
+        if (total == 0.0f)
+            return false;
+        bool positive = weights[0] >= 0.0f && weights[1] >= 0.0f && weights[2] >= 0.0f;
+        bool negative = weights[0] <= 0.0f && weights[1] <= 0.0f && weights[2] <= 0.0f;
+        if (!positive && !negative)
+            return false;
+        hit = (weights[0] * tri.p[0][axis] + weights[1] * tri.p[1][axis] + weights[2] * tri.p[2][axis]) / total;
+        return true;
+    }
+
+    float dot3(const float *a, const float *b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    // separating axis test of the triangle against a cell grown by a
+    // thousandth, so rounding can only find more overlaps (Akenine-Moller)
+    bool overlapsCell(const Triangle &tri, const float *center, const float *size)
+    {
+        float v[3][3], e[3][3], half[3];
+        for (int a = 0; a < 3; ++a)
+            half[a] = size[a] * 0.501f;
+        for (int k = 0; k < 3; ++k)
+            for (int a = 0; a < 3; ++a)
+                v[k][a] = tri.p[k][a] - center[a];
+        for (int k = 0; k < 3; ++k)
+            for (int a = 0; a < 3; ++a)
+                e[k][a] = v[(k + 1) % 3][a] - v[k][a];
+
+        // the cell's own axes
+        for (int a = 0; a < 3; ++a)
+            if (std::min(v[0][a], std::min(v[1][a], v[2][a])) > half[a]
+                || std::max(v[0][a], std::max(v[1][a], v[2][a])) < -half[a])
+                return false;
+        // the triangle's plane
+        float normal[3] = { e[0][1] * e[1][2] - e[0][2] * e[1][1], e[0][2] * e[1][0] - e[0][0] * e[1][2],
+                            e[0][0] * e[1][1] - e[0][1] * e[1][0] };
+        float radius = half[0] * std::fabs(normal[0]) + half[1] * std::fabs(normal[1]) + half[2] * std::fabs(normal[2]);
+        if (std::fabs(dot3(normal, v[0])) > radius)
+            return false;
+        // cell axis x triangle edge
+        for (int a = 0; a < 3; ++a)
+            for (int k = 0; k < 3; ++k)
+            {
+                float axis[3] = { 0.0f, 0.0f, 0.0f };
+                int b = (a + 1) % 3, c = (a + 2) % 3;
+                axis[b] = -e[k][c];
+                axis[c] = e[k][b];
+                float p0 = dot3(axis, v[0]), p1 = dot3(axis, v[1]), p2 = dot3(axis, v[2]);
+                float r = half[0] * std::fabs(axis[0]) + half[1] * std::fabs(axis[1]) + half[2] * std::fabs(axis[2]);
+                if (std::min(p0, std::min(p1, p2)) > r || std::max(p0, std::max(p1, p2)) < -r)
+                    return false;
+            }
+        return true;
+    }
+
+    // edge a -> b as A * x + B * y + C, positive on its left
+    struct Edge {
+        float a, b, c;
+    };
+
+    Edge makeEdge(float ax, float ay, float bx, float by)
+    {
+        // a shared edge is set up from the same endpoint in both of its
+        // triangles, so the two are exact negatives and no pixel center on
+        // it is missed by both
+        if (ax > bx || (ax == bx && ay > by))
+        {
+            Edge e = makeEdge(bx, by, ax, ay);
+            e.a = -e.a;
+            e.b = -e.b;
+            e.c = -e.c;
+            return e;
+        }
+        Edge e;
+        e.a = ay - by;
+        e.b = bx - ax;
+        e.c = -(e.a * ax + e.b * ay);
+        return e;
+    }
+}
+
+OcclusionCuller::OcclusionCuller(int width, int height)
+{
+    // whole tiles, so SIMD spans never cross into a neighbour's pixels
+    tilesX = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+    tilesY = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    bufferWidth = tilesX * TILE_WIDTH;
+    bufferHeight = tilesY * TILE_HEIGHT;
+    tileBins.resize(static_cast<size_t>(tilesX) * tilesY);
+
+    int w = bufferWidth, h = bufferHeight;
+    for (;;)
+    {
+        levels.push_back(std::vector<float>(static_cast<size_t>(w) * h, 1.0f));
+        levelWidths.push_back(w);
+        levelHeights.push_back(h);
+        if (w == 1 && h == 1)
+            break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+    frameStats.occluders = frameStats.triangles = frameStats.tested = frameStats.occluded = 0;
+}
+
+uint32_t OcclusionCuller::addProxy(const OBJLoader::MeshData &mesh, int resolution)
+{
+    if (resolution < 1)
+        resolution = 1;
+    const int n = resolution;
+    float low[3], size[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        low[a] = mesh.bounds_min[a];
+        size[a] = (mesh.bounds_max[a] - mesh.bounds_min[a]) / n;
+    }
+    Proxy proxy;
+    // flat along an axis: nothing has an inside
+    if (!(size[0] > 0.0f && size[1] > 0.0f && size[2] > 0.0f))
+    {
+        proxies.push_back(proxy);
+        return static_cast<uint32_t>(proxies.size() - 1);
+    }
+
+    std::vector<Triangle> tris;
+    for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+    {
+        Triangle tri;
+        for (int k = 0; k < 3; ++k)
+            for (int a = 0; a < 3; ++a)
+                tri.p[k][a] = mesh.vertices[mesh.indices[t + k] * OBJLoader::FLOATS_PER_VERTEX + a];
+        tris.push_back(tri);
+    }
+
+    // a cell is solid when it touches no triangle and its center is inside
+    // the mesh looking both ways along all three axes; an open mesh then
+    // only loses cells whose rays leave through a hole
+    size_t cellCount = static_cast<size_t>(n) * n * n;
+    std::vector<unsigned char> votes(cellCount, 0);
+    std::vector<float> hits;
+    for (int a = 0; a < 3; ++a)
+    {
+        int u = (a + 1) % 3, v = (a + 2) % 3;
+        // each triangle listed under the lines its bounds may cross
+        std::vector<std::vector<uint32_t> > lines(static_cast<size_t>(n) * n);
+        for (size_t t = 0; t < tris.size(); ++t)
+        {
+            const Triangle &tri = tris[t];
+            float loU = std::min(tri.p[0][u], std::min(tri.p[1][u], tri.p[2][u]));
+            float hiU = std::max(tri.p[0][u], std::max(tri.p[1][u], tri.p[2][u]));
+            float loV = std::min(tri.p[0][v], std::min(tri.p[1][v], tri.p[2][v]));
+            float hiV = std::max(tri.p[0][v], std::max(tri.p[1][v], tri.p[2][v]));
+            int i0 = std::max(0, static_cast<int>(std::floor((loU - low[u]) / size[u] - 0.5f)));
+            int i1 = std::min(n - 1, static_cast<int>(std::floor((hiU - low[u]) / size[u] - 0.5f)) + 1);
+            int j0 = std::max(0, static_cast<int>(std::floor((loV - low[v]) / size[v] - 0.5f)));
+            int j1 = std::min(n - 1, static_cast<int>(std::floor((hiV - low[v]) / size[v] - 0.5f)) + 1);
+            for (int i = i0; i <= i1; ++i)
+                for (int j = j0; j <= j1; ++j)
+                    lines[static_cast<size_t>(i) * n + j].push_back(static_cast<uint32_t>(t));
+        }
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+            {
+                const std::vector<uint32_t> &line = lines[static_cast<size_t>(i) * n + j];
+                // off the cell center so the line does not run through the
+                // edges and vertices of a grid-aligned mesh
+                float lineU = low[u] + (i + 0.5f + LINE_JITTER_U) * size[u];
+                float lineV = low[v] + (j + 0.5f + LINE_JITTER_V) * size[v];
+                hits.clear();
+                for (size_t t = 0; t < line.size(); ++t)
+                {
+                    float hit;
+                    if (lineHit(tris[line[t]], a, lineU, lineV, hit))
+                        hits.push_back(hit);
+                }
+                std::sort(hits.begin(), hits.end());
+                for (int k = 0; k < n; ++k)
+                {
+                    float center = low[a] + (k + 0.5f) * size[a];
+                    size_t before = std::lower_bound(hits.begin(), hits.end(), center) - hits.begin();
+                    if ((before & 1) == 0 || ((hits.size() - before) & 1) == 0)
+                        continue;
+                    int cell[3];
+                    cell[a] = k;
+                    cell[u] = i;
+                    cell[v] = j;
+                    ++votes[(static_cast<size_t>(cell[0]) * n + cell[1]) * n + cell[2]];
+                }
+            }
+    }
+    std::vector<unsigned char> solid(cellCount, 0);
+    for (size_t c = 0; c < cellCount; ++c)
+        solid[c] = votes[c] == 3;
+    for (size_t t = 0; t < tris.size(); ++t)
+    {
+        int first[3], last[3];
+        for (int a = 0; a < 3; ++a)
+        {
+            float lo = std::min(tris[t].p[0][a], std::min(tris[t].p[1][a], tris[t].p[2][a]));
+            float hi = std::max(tris[t].p[0][a], std::max(tris[t].p[1][a], tris[t].p[2][a]));
+            first[a] = std::max(0, static_cast<int>(std::floor((lo - low[a]) / size[a])) - 1);
+            last[a] = std::min(n - 1, static_cast<int>(std::floor((hi - low[a]) / size[a])) + 1);
+        }
+        for (int x = first[0]; x <= last[0]; ++x)
+            for (int y = first[1]; y <= last[1]; ++y)
+                for (int z = first[2]; z <= last[2]; ++z)
+                {
+                    size_t c = (static_cast<size_t>(x) * n + y) * n + z;
+                    if (!solid[c])
+                        continue;
+                    float center[3] = { low[0] + (x + 0.5f) * size[0], low[1] + (y + 0.5f) * size[1],
+                                        low[2] + (z + 0.5f) * size[2] };
+                    if (overlapsCell(tris[t], center, size))
+                        solid[c] = 0;
+                }
+    }
+
+    // the outside faces of the solid cells, merged into rectangles slice
+    // by slice, facing out
+    std::vector<unsigned char> mask(static_cast<size_t>(n) * n);
+    for (int a = 0; a < 3; ++a)
+    {
+        int u = (a + 1) % 3, v = (a + 2) % 3;
+        for (int side = 0; side < 2; ++side)
+            for (int k = 0; k < n; ++k)
+            {
+                int next = side ? k + 1 : k - 1;
+                for (int i = 0; i < n; ++i)
+                    for (int j = 0; j < n; ++j)
+                    {
+                        int cell[3];
+                        cell[a] = k;
+                        cell[u] = i;
+                        cell[v] = j;
+                        bool here = solid[(static_cast<size_t>(cell[0]) * n + cell[1]) * n + cell[2]] != 0;
+                        cell[a] = next;
+                        bool beyond = next >= 0 && next < n
+                                   && solid[(static_cast<size_t>(cell[0]) * n + cell[1]) * n + cell[2]] != 0;
+                        mask[static_cast<size_t>(j) * n + i] = here && !beyond;
+                    }
+                float plane = low[a] + (k + side) * size[a];
+                for (int j = 0; j < n; ++j)
+                    for (int i = 0; i < n; ++i)
+                    {
+                        if (!mask[static_cast<size_t>(j) * n + i])
+                            continue;
+                        int width = 1, height = 1;
+                        while (i + width < n && mask[static_cast<size_t>(j) * n + i + width])
+                            ++width;
+                        for (bool full = true; full && j + height < n; )
+                        {
+                            for (int w = 0; w < width && full; ++w)
+                                full = mask[static_cast<size_t>(j + height) * n + i + w] != 0;
+                            if (full)
+                                ++height;
+                        }
+                        for (int h = 0; h < height; ++h)
+                            for (int w = 0; w < width; ++w)
+                                mask[static_cast<size_t>(j + h) * n + i + w] = 0;
+
+                        // u x v is a: corners counter-clockwise seen from +a
+                        uint32_t base = static_cast<uint32_t>(proxy.positions.size());
+                        const int corners[4][2] = { { 0, 0 }, { width, 0 }, { width, height }, { 0, height } };
+                        for (int c = 0; c < 4; ++c)
+                        {
+                            float p[3];
+                            p[a] = plane;
+                            p[u] = low[u] + (i + corners[c][0]) * size[u];
+                            p[v] = low[v] + (j + corners[c][1]) * size[v];
+                            proxy.positions.push_back(Vec3(p[0], p[1], p[2]));
+                        }
+                        const uint32_t front[6] = { 0, 1, 2, 0, 2, 3 }, back[6] = { 0, 2, 1, 0, 3, 2 };
+                        for (int q = 0; q < 6; ++q)
+                            proxy.indices.push_back(base + (side ? front[q] : back[q]));
+                    }
+            }
+    }
+    proxies.push_back(proxy);
+    return static_cast<uint32_t>(proxies.size() - 1);
+}
+
+size_t OcclusionCuller::proxyTriangles(uint32_t proxy) const
+{
+    return proxies[proxy].indices.size() / 3;
+}
+
+void OcclusionCuller::beginFrame(const Mat4 &matrix)
+{
+    viewProjection = matrix;
+    triangles.clear();
+    frameStats.occluders = frameStats.triangles = frameStats.tested = frameStats.occluded = 0;
+}
+
+void OcclusionCuller::addOccluder(uint32_t index, const Mat4 &model)
+{
+    const Proxy &proxy = proxies[index];
+    Mat4 mvp = viewProjection * model;
+    std::vector<ClipVertex> clip(proxy.positions.size());
+    for (size_t v = 0; v < proxy.positions.size(); ++v)
+        clip[v] = toClip(mvp, proxy.positions[v]);
+
+    for (size_t i = 0; i + 2 < proxy.indices.size(); i += 3)
+    {
+        // clipped to the near plane (z >= -w) so no depth falls below 0
+        ClipVertex polygon[4];
+        int count = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            const ClipVertex &a = clip[proxy.indices[i + k]], &b = clip[proxy.indices[i + (k + 1) % 3]];
+            float da = a.z + a.w, db = b.z + b.w;
+            if (da >= 0.0f)
+                polygon[count++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+            {
+                float t = da / (da - db);
+                ClipVertex v;
+                v.x = a.x + (b.x - a.x) * t;
+                v.y = a.y + (b.y - a.y) * t;
+                v.z = a.z + (b.z - a.z) * t;
+                v.w = a.w + (b.w - a.w) * t;
+                polygon[count++] = v;
+            }
+        }
+        for (int k = 1; k + 1 < count; ++k)
+        {
+            const ClipVertex *corners[3] = { &polygon[0], &polygon[k], &polygon[k + 1] };
+            ScreenTriangle tri;
+            bool behind = false;
+            for (int c = 0; c < 3; ++c)
+            {
+                const ClipVertex &v = *corners[c];
+                if (v.w < MIN_W)
+                {
+                    behind = true;
+                    break;
+                }
+                float inverse = 1.0f / v.w;
+                tri.x[c] = (v.x * inverse * 0.5f + 0.5f) * bufferWidth;
+                tri.y[c] = (v.y * inverse * 0.5f + 0.5f) * bufferHeight;
+                tri.z[c] = std::max(0.0f, v.z * inverse * 0.5f + 0.5f);
+            }
+            // an occluder may only ever hide less, so dropping is safe
+            if (behind)
+                continue;
+            float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+            if (area <= 0.0f)
+                continue;
+            float minX = std::min(tri.x[0], std::min(tri.x[1], tri.x[2]));
+            float maxX = std::max(tri.x[0], std::max(tri.x[1], tri.x[2]));
+            float minY = std::min(tri.y[0], std::min(tri.y[1], tri.y[2]));
+            float maxY = std::max(tri.y[0], std::max(tri.y[1], tri.y[2]));
+            // pixel centers at +0.5
+            tri.minX = std::max(0, static_cast<int>(std::ceil(minX - 0.5f)));
+            tri.maxX = std::min(bufferWidth - 1, static_cast<int>(std::floor(maxX - 0.5f)));
+            tri.minY = std::max(0, static_cast<int>(std::ceil(minY - 0.5f)));
+            tri.maxY = std::min(bufferHeight - 1, static_cast<int>(std::floor(maxY - 0.5f)));
+            if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+                continue;
+            float nearest = std::min(tri.z[0], std::min(tri.z[1], tri.z[2]));
+            if (nearest > 1.0f)
+                continue;
+            triangles.push_back(tri);
+        }
+    }
+    ++frameStats.occluders;
+}
+
+void OcclusionCuller::finish()
+{
+    for (size_t t = 0; t < tileBins.size(); ++t)
+        tileBins[t].clear();
+    for (size_t i = 0; i < triangles.size(); ++i)
+    {
+        const ScreenTriangle &tri = triangles[i];
+        for (int ty = tri.minY / TILE_HEIGHT; ty <= tri.maxY / TILE_HEIGHT; ++ty)
+            for (int tx = tri.minX / TILE_WIDTH; tx <= tri.maxX / TILE_WIDTH; ++tx)
+                tileBins[static_cast<size_t>(ty) * tilesX + tx].push_back(static_cast<uint32_t>(i));
+    }
+    frameStats.triangles = triangles.size();
+
+    Parallel::forChunks(tileBins.size(), 1, [&](size_t, size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t)
+            rasterizeTile(static_cast<int>(t % tilesX), static_cast<int>(t / tilesX));
+    });
+    buildPyramid();
+}
+
+void OcclusionCuller::rasterizeTile(int tileX, int tileY)
+{
+    std::vector<float> &buffer = levels[0];
+    int tileMinX = tileX * TILE_WIDTH, tileMaxX = tileMinX + TILE_WIDTH - 1;
+    int tileMinY = tileY * TILE_HEIGHT, tileMaxY = tileMinY + TILE_HEIGHT - 1;
+    for (int y = tileMinY; y <= tileMaxY; ++y)
+        std::fill(&buffer[static_cast<size_t>(y) * bufferWidth + tileMinX],
+                  &buffer[static_cast<size_t>(y) * bufferWidth + tileMinX] + TILE_WIDTH, 1.0f);
+
+    const std::vector<uint32_t> &bin = tileBins[static_cast<size_t>(tileY) * tilesX + tileX];
+    for (size_t i = 0; i < bin.size(); ++i)
+    {
+        const ScreenTriangle &tri = triangles[bin[i]];
+        Edge e0 = makeEdge(tri.x[1], tri.y[1], tri.x[2], tri.y[2]);   // weight of vertex 0
+        Edge e1 = makeEdge(tri.x[2], tri.y[2], tri.x[0], tri.y[0]);   // weight of vertex 1
+        Edge e2 = makeEdge(tri.x[0], tri.y[0], tri.x[1], tri.y[1]);   // weight of vertex 2
+        float area = e2.a * tri.x[2] + e2.b * tri.y[2] + e2.c;
+        float inverseArea = 1.0f / area;
+        // depth is affine in screen space: z = zA * x + zB * y + zC
+        float zA = (e0.a * tri.z[0] + e1.a * tri.z[1] + e2.a * tri.z[2]) * inverseArea;
+        float zB = (e0.b * tri.z[0] + e1.b * tri.z[1] + e2.b * tri.z[2]) * inverseArea;
+        float zC = (e0.c * tri.z[0] + e1.c * tri.z[1] + e2.c * tri.z[2]) * inverseArea;
+
+        int minX = std::max(tri.minX, tileMinX), maxX = std::min(tri.maxX, tileMaxX);
+        int minY = std::max(tri.minY, tileMinY), maxY = std::min(tri.maxY, tileMaxY);
+        if (minX > maxX || minY > maxY)
+            continue;
+#if defined(__AVX2__)
+        // spans start on 8 pixel boundaries inside the tile; lanes outside
+        // the triangle's box are masked off
+        int spanX = minX & ~7;
+        const __m256 laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+        const __m256 zero = _mm256_setzero_ps();
+        for (int y = minY; y <= maxY; ++y)
+        {
+            float py = y + 0.5f;
+            float *row = &buffer[static_cast<size_t>(y) * bufferWidth];
+            for (int x = spanX; x <= maxX; x += 8)
+            {
+                __m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), laneOffsets);
+                __m256 w0 = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(e0.a)), _mm256_set1_ps(e0.b * py + e0.c));
+                __m256 w1 = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(e1.a)), _mm256_set1_ps(e1.b * py + e1.c));
+                __m256 w2 = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(e2.a)), _mm256_set1_ps(e2.b * py + e2.c));
+                __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(w0, zero, _CMP_GE_OQ),
+                                                            _mm256_cmp_ps(w1, zero, _CMP_GE_OQ)),
+                                              _mm256_cmp_ps(w2, zero, _CMP_GE_OQ));
+                __m256i lanes = _mm256_add_epi32(_mm256_set1_epi32(x), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+                __m256i inSpan = _mm256_and_si256(_mm256_cmpgt_epi32(lanes, _mm256_set1_epi32(minX - 1)),
+                                                  _mm256_cmpgt_epi32(_mm256_set1_epi32(maxX + 1), lanes));
+                inside = _mm256_and_ps(inside, _mm256_castsi256_ps(inSpan));
+                if (_mm256_movemask_ps(inside) == 0)
+                    continue;
+                __m256 z = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(zA)), _mm256_set1_ps(zB * py + zC));
+                __m256 stored = _mm256_loadu_ps(row + x);
+                __m256 nearer = _mm256_min_ps(stored, z);
+                _mm256_storeu_ps(row + x, _mm256_blendv_ps(stored, nearer, inside));
+            }
+        }
+#elif defined(OCCLUSION_SSE2)
+        int spanX = minX & ~3;
+        const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps();
+        for (int y = minY; y <= maxY; ++y)
+        {
+            float py = y + 0.5f;
+            float *row = &buffer[static_cast<size_t>(y) * bufferWidth];
+            for (int x = spanX; x <= maxX; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+                __m128 w0 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(e0.a)), _mm_set1_ps(e0.b * py + e0.c));
+                __m128 w1 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(e1.a)), _mm_set1_ps(e1.b * py + e1.c));
+                __m128 w2 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(e2.a)), _mm_set1_ps(e2.b * py + e2.c));
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)),
+                                           _mm_cmpge_ps(w2, zero));
+                __m128i lanes = _mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3));
+                __m128i inSpan = _mm_and_si128(_mm_cmpgt_epi32(lanes, _mm_set1_epi32(minX - 1)),
+                                               _mm_cmplt_epi32(lanes, _mm_set1_epi32(maxX + 1)));
+                inside = _mm_and_ps(inside, _mm_castsi128_ps(inSpan));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+                __m128 z = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(zA)), _mm_set1_ps(zB * py + zC));
+                __m128 stored = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(stored, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, stored)));
+            }
+        }
+#else
+        for (int y = minY; y <= maxY; ++y)
+        {
+            float py = y + 0.5f;
+            float *row = &buffer[static_cast<size_t>(y) * bufferWidth];
+            for (int x = minX; x <= maxX; ++x)
+            {
+                float px = x + 0.5f;
+                if (e0.a * px + e0.b * py + e0.c < 0.0f || e1.a * px + e1.b * py + e1.c < 0.0f
+                    || e2.a * px + e2.b * py + e2.c < 0.0f)
+                    continue;
+                float z = zA * px + zB * py + zC;
+                if (z < row[x])
+                    row[x] = z;
+            }
+        }
+#endif
+    }
+}
+
+void OcclusionCuller::buildPyramid()
+{
+    for (size_t level = 1; level < levels.size(); ++level)
+    {
+        const std::vector<float> &source = levels[level - 1];
+        std::vector<float> &target = levels[level];
+        int sourceWidth = levelWidths[level - 1], sourceHeight = levelHeights[level - 1];
+        int w = levelWidths[level], h = levelHeights[level];
+        for (int y = 0; y < h; ++y)
+        {
+            int y0 = y * 2, y1 = std::min(y * 2 + 1, sourceHeight - 1);
+            for (int x = 0; x < w; ++x)
+            {
+                int x0 = x * 2, x1 = std::min(x * 2 + 1, sourceWidth - 1);
+                float farthest = std::max(std::max(source[static_cast<size_t>(y0) * sourceWidth + x0],
+                                                   source[static_cast<size_t>(y0) * sourceWidth + x1]),
+                                          std::max(source[static_cast<size_t>(y1) * sourceWidth + x0],
+                                                   source[static_cast<size_t>(y1) * sourceWidth + x1]));
+                target[static_cast<size_t>(y) * w + x] = farthest;
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isVisible(const AABB &box)
+{
+    ++frameStats.tested;
+    float minX = HUGE_VALF, minY = HUGE_VALF, maxX = -HUGE_VALF, maxY = -HUGE_VALF, nearest = HUGE_VALF;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        Vec3 p((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y,
+               (corner & 4) ? box.max.z : box.min.z);
+        ClipVertex v = toClip(viewProjection, p);
+        // crosses the eye plane: too close to tell
+        if (v.w < MIN_W)
+            return true;
+        float inverse = 1.0f / v.w;
+        float x = (v.x * inverse * 0.5f + 0.5f) * bufferWidth;
+        float y = (v.y * inverse * 0.5f + 0.5f) * bufferHeight;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::min(nearest, v.z * inverse * 0.5f + 0.5f);
+    }
+    if (maxX < 0.0f || maxY < 0.0f || minX >= bufferWidth || minY >= bufferHeight)
+        return true;
+
+    // texels the box covers, then the level where that is at most 2x2
+    int x0 = std::max(0, static_cast<int>(minX)), x1 = std::min(bufferWidth - 1, static_cast<int>(maxX));
+    int y0 = std::max(0, static_cast<int>(minY)), y1 = std::min(bufferHeight - 1, static_cast<int>(maxY));
+    size_t level = 0;
+    while ((x1 - x0 > 1 || y1 - y0 > 1) && level + 1 < levels.size())
+    {
+        x0 >>= 1;
+        x1 >>= 1;
+        y0 >>= 1;
+        y1 >>= 1;
+        ++level;
+    }
+    const std::vector<float> &depths = levels[level];
+    int w = levelWidths[level];
+    float farthest = 0.0f;
+    for (int y = y0; y <= y1; ++y)
+        for (int x = x0; x <= x1; ++x)
+            farthest = std::max(farthest, depths[static_cast<size_t>(y) * w + x]);
+    if (nearest > farthest)
+    {
+        ++frameStats.occluded;
+        return false;
+    }
+    return true;
+}
+
+size_t OcclusionCuller::cull(std::vector<uint32_t> &visible, const std::vector<AABB> &bounds)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < visible.size(); ++i)
+        if (isVisible(bounds[visible[i]]))
+            visible[kept++] = visible[i];
+    visible.resize(kept);
+    return kept;
+}
+
+OcclusionCuller::Stats OcclusionCuller::stats() const
+{
+    return frameStats;
+}
+
+std::string OcclusionCuller::report() const
+{
+    char text[96];
+    std::snprintf(text, sizeof(text), "occlusion: %zu/%zu hidden by %zu occluders",
+                  frameStats.occluded, frameStats.tested, frameStats.occluders);
+    return text;
+}
+
+int OcclusionCuller::width() const
+{
+    return bufferWidth;
+}
+
+int OcclusionCuller::height() const
+{
+    return bufferHeight;
+}
+
+const std::vector<float> &OcclusionCuller::depth() const
+{
+    return levels[0];
+}
+
+size_t OcclusionCuller::levelCount() const
+{
+    return levels.size();
+}
+
+const std::vector<float> &OcclusionCuller::level(size_t index, int &levelWidth, int &levelHeight) const
+{
+    levelWidth = levelWidths[index];
+    levelHeight = levelHeights[index];
+    return levels[index];
+}
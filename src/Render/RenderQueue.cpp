@@ -0,0 +1,150 @@
+#include "Render/RenderQueue.h"
+
+#include <cstring>
+
+namespace
+{
+    const unsigned STATE_BITS = RenderQueue::PROGRAM_BITS + RenderQueue::MATERIAL_BITS + RenderQueue::MESH_BITS;
+    const uint64_t STATE_MASK = (1ull << STATE_BITS) - 1;
+    const uint64_t DEPTH_MASK = (1ull << RenderQueue::DEPTH_BITS) - 1;
+    const unsigned TRANSLUCENT_SHIFT = STATE_BITS + RenderQueue::DEPTH_BITS;
+    const unsigned LAYER_SHIFT = TRANSLUCENT_SHIFT + 1;
+    const unsigned RADIX = 256;
+    const unsigned DIGITS = 8;
+
+    inline uint64_t bits(unsigned value, unsigned count)
+    {
+        return static_cast<uint64_t>(value) & ((1ull << count) - 1);
+    }
+}
+
+RenderQueue::RenderQueue(size_t capacity) : lastPasses(0)
+{
+    keys.reserve(capacity);
+    items.reserve(capacity);
+    keyScratch.reserve(capacity);
+    itemScratch.reserve(capacity);
+}
+
+uint64_t RenderQueue::key(unsigned layer, bool translucent, unsigned program, unsigned material,
+                          unsigned mesh, float depth)
+{
+    uint64_t state = (bits(program, PROGRAM_BITS) << (MATERIAL_BITS + MESH_BITS))
+                   | (bits(material, MATERIAL_BITS) << MESH_BITS) | bits(mesh, MESH_BITS);
+    if (!(depth > 0.0f))
+        depth = 0.0f;
+    if (depth > 1.0f)
+        depth = 1.0f;
+    uint64_t quantized = static_cast<uint64_t>(depth * static_cast<float>(DEPTH_MASK)) & DEPTH_MASK;
+    uint64_t key = bits(layer, LAYER_BITS) << LAYER_SHIFT;
+    if (translucent)
+        return key | (1ull << TRANSLUCENT_SHIFT) | ((DEPTH_MASK - quantized) << STATE_BITS) | state;
+    return key | (state << DEPTH_BITS) | quantized;
+}
+
+uint64_t RenderQueue::state(uint64_t key)
+{
+    return translucent(key) ? key & STATE_MASK : (key >> DEPTH_BITS) & STATE_MASK;
+}
+
+unsigned RenderQueue::layer(uint64_t key)
+{
+    return static_cast<unsigned>(key >> LAYER_SHIFT);
+}
+
+bool RenderQueue::translucent(uint64_t key)
+{
+    return (key >> TRANSLUCENT_SHIFT) & 1;
+}
+
+unsigned RenderQueue::program(uint64_t key)
+{
+    return static_cast<unsigned>(state(key) >> (MATERIAL_BITS + MESH_BITS));
+}
+
+unsigned RenderQueue::material(uint64_t key)
+{
+    return static_cast<unsigned>((state(key) >> MESH_BITS) & ((1u << MATERIAL_BITS) - 1));
+}
+
+unsigned RenderQueue::mesh(uint64_t key)
+{
+    return static_cast<unsigned>(state(key) & ((1u << MESH_BITS) - 1));
+}
+
+void RenderQueue::clear()
+{
+    keys.clear();
+    items.clear();
+}
+
+void RenderQueue::push(uint64_t key, uint32_t item)
+{
+    keys.push_back(key);
+    items.push_back(item);
+}
+
+void RenderQueue::sort()
+{
+    size_t count = keys.size();
+    lastPasses = 0;
+    if (count < 2)
+        return;
+    keyScratch.resize(count);
+    itemScratch.resize(count);
+
+    // one read for the histograms of all eight bytes
+    size_t histograms[DIGITS][RADIX];
+    std::memset(histograms, 0, sizeof(histograms));
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t key = keys[i];
+        for (unsigned d = 0; d < DIGITS; ++d)
+            ++histograms[d][(key >> (d * 8)) & (RADIX - 1)];
+    }
+
+    for (unsigned d = 0; d < DIGITS; ++d)
+    {
+        size_t *histogram = histograms[d];
+        unsigned shift = d * 8;
+        // every key has the same byte here: the pass would not move anything
+        if (histogram[(keys[0] >> shift) & (RADIX - 1)] == count)
+            continue;
+        size_t offset = 0;
+        for (unsigned b = 0; b < RADIX; ++b)
+        {
+            size_t n = histogram[b];
+            histogram[b] = offset;
+            offset += n;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            size_t slot = histogram[(keys[i] >> shift) & (RADIX - 1)]++;
+            keyScratch[slot] = keys[i];
+            itemScratch[slot] = items[i];
+        }
+        keys.swap(keyScratch);
+        items.swap(itemScratch);
+        ++lastPasses;
+    }
+}
+
+size_t RenderQueue::size() const
+{
+    return keys.size();
+}
+
+uint64_t RenderQueue::keyAt(size_t index) const
+{
+    return keys[index];
+}
+
+uint32_t RenderQueue::itemAt(size_t index) const
+{
+    return items[index];
+}
+
+unsigned RenderQueue::passes() const
+{
+    return lastPasses;
+}
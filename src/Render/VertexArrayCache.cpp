@@ -0,0 +1,98 @@
+#include "Render/VertexArrayCache.h"
+#include "Core/GLState.h"
+#include "Core/Hash.h"
+
+#include <iostream>
+
+VertexArrayCache::VertexArrayCache() : buildCount(0)
+{
+}
+
+VertexArrayCache::~VertexArrayCache()
+{
+    clear();
+}
+
+GLuint VertexArrayCache::get(const Shader &shader, const VertexFormat &format, GLuint vertexBuffer, GLuint indexBuffer,
+                             const VertexFormat *instanceFormat, GLuint instanceBuffer, GLintptr instanceOffset)
+{
+    uint64_t fields[7] = { format.hash(), shader.attributeSignature(), vertexBuffer, indexBuffer,
+                           instanceFormat ? instanceFormat->hash() : 0, instanceBuffer,
+                           static_cast<uint64_t>(instanceOffset) };
+    uint64_t key = Hash::fnv1a64(fields, sizeof(fields));
+    std::unordered_map<uint64_t, Entry>::iterator it = entries.find(key);
+    if (it != entries.end())
+        return it->second.vao;
+
+    Entry entry = { build(shader, format, vertexBuffer, indexBuffer, instanceFormat, instanceBuffer, instanceOffset),
+                    vertexBuffer, indexBuffer, instanceBuffer };
+    entries[key] = entry;
+    ++buildCount;
+    return entry.vao;
+}
+
+GLuint VertexArrayCache::build(const Shader &shader, const VertexFormat &format, GLuint vertexBuffer, GLuint indexBuffer,
+                               const VertexFormat *instanceFormat, GLuint instanceBuffer,
+                               GLintptr instanceOffset) const
+{
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    GLState::bindVertexArray(vao);
+    if (indexBuffer)
+        GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+    const std::vector<ShaderAttribute> &attributes = shader.attributes();
+    for (size_t i = 0; i < attributes.size(); ++i)
+    {
+        GLuint location = static_cast<GLuint>(attributes[i].location);
+        const VertexFormat::Element *element = format.find(attributes[i].name);
+        if (element)
+        {
+            GLState::bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+            format.setPointer(*element, location);
+            continue;
+        }
+        element = instanceFormat ? instanceFormat->find(attributes[i].name) : NULL;
+        if (element)
+        {
+            GLState::bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+            instanceFormat->setPointer(*element, location, instanceOffset);
+            continue;
+        }
+        // left disabled, the input reads the constant (0, 0, 0, 1)
+        std::cout << "WARNING::VERTEX_ARRAY::MISSING_ATTRIBUTE " << attributes[i].name << std::endl;
+    }
+    return vao;
+}
+
+void VertexArrayCache::forgetBuffer(GLuint buffer)
+{
+    for (std::unordered_map<uint64_t, Entry>::iterator it = entries.begin(); it != entries.end();)
+    {
+        if (it->second.vertexBuffer == buffer || it->second.indexBuffer == buffer
+            || it->second.instanceBuffer == buffer)
+        {
+            GLState::deleteVertexArrays(1, &it->second.vao);
+            it = entries.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+void VertexArrayCache::clear()
+{
+    for (std::unordered_map<uint64_t, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+        GLState::deleteVertexArrays(1, &it->second.vao);
+    entries.clear();
+}
+
+size_t VertexArrayCache::size() const
+{
+    return entries.size();
+}
+
+size_t VertexArrayCache::builds() const
+{
+    return buildCount;
+}
@@ -0,0 +1,123 @@
+#include "Render/VertexFormat.h"
+#include "Core/Hash.h"
+
+#include <stdexcept>
+
+VertexFormat::VertexFormat(GLuint divisor) : size(0), instanceDivisor(divisor), key(Hash::FNV64_OFFSET)
+{
+    key = Hash::fnv1a64(&instanceDivisor, sizeof(instanceDivisor), key);
+}
+
+VertexFormat &VertexFormat::add(const std::string &name, GLint components, GLenum type, bool normalized)
+{
+    return append(name, components, type, normalized, false, 1);
+}
+
+VertexFormat &VertexFormat::addInteger(const std::string &name, GLint components, GLenum type)
+{
+    return append(name, components, type, false, true, 1);
+}
+
+VertexFormat &VertexFormat::addMatrix(const std::string &name, GLint columns, GLint rows)
+{
+    return append(name, rows, GL_FLOAT, false, false, columns);
+}
+
+VertexFormat &VertexFormat::pad(GLuint bytes)
+{
+    size += bytes;
+    key = Hash::fnv1a64(&size, sizeof(size), key);
+    return *this;
+}
+
+VertexFormat &VertexFormat::append(const std::string &name, GLint components, GLenum type, bool normalized, bool integer,
+                                   GLint columns)
+{
+    if (components < 1 || components > 4)
+        throw std::runtime_error("Vertex element " + name + " must have 1 to 4 components");
+    if (type == GL_INT_2_10_10_10_REV || type == GL_UNSIGNED_INT_2_10_10_10_REV)
+        components = 4;
+    Element element = { name, components, type, normalized, integer, columns, size };
+    list.push_back(element);
+    size += typeSize(type, components) * columns;
+
+    uint32_t fields[6] = { static_cast<uint32_t>(components), type, normalized, integer,
+                           static_cast<uint32_t>(columns), element.offset };
+    key = Hash::fnv1a64(name, key);
+    key = Hash::fnv1a64(fields, sizeof(fields), key);
+    return *this;
+}
+
+const std::vector<VertexFormat::Element> &VertexFormat::elements() const
+{
+    return list;
+}
+
+const VertexFormat::Element *VertexFormat::find(const std::string &name) const
+{
+    for (size_t i = 0; i < list.size(); ++i)
+        if (list[i].name == name)
+            return &list[i];
+    return NULL;
+}
+
+GLsizei VertexFormat::stride() const
+{
+    return static_cast<GLsizei>(size);
+}
+
+GLuint VertexFormat::divisor() const
+{
+    return instanceDivisor;
+}
+
+uint64_t VertexFormat::hash() const
+{
+    // the stride is only known once every element is in
+    return Hash::fnv1a64(&size, sizeof(size), key);
+}
+
+void VertexFormat::setPointer(const Element &element, GLuint location, GLintptr baseOffset) const
+{
+    GLuint columnSize = typeSize(element.type, element.components);
+    for (GLint column = 0; column < element.columns; ++column)
+    {
+        const void *offset = reinterpret_cast<const void *>(
+            static_cast<uintptr_t>(baseOffset + element.offset + column * columnSize));
+        if (element.integer)
+            glVertexAttribIPointer(location + column, element.components, element.type, stride(), offset);
+        else
+            glVertexAttribPointer(location + column, element.components, element.type,
+                                  element.normalized ? GL_TRUE : GL_FALSE, stride(), offset);
+        glEnableVertexAttribArray(location + column);
+        if (instanceDivisor)
+            glVertexAttribDivisor(location + column, instanceDivisor);
+    }
+}
+
+GLuint VertexFormat::typeSize(GLenum type, GLint components)
+{
+    switch (type)
+    {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return components;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_HALF_FLOAT:
+            return 2 * components;
+        case GL_INT:
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT:
+        case GL_FIXED:
+            return 4 * components;
+        case GL_DOUBLE:
+            return 8 * components;
+        case GL_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_10F_11F_11F_REV:
+            return 4;
+        default:
+            throw std::runtime_error("Unsupported vertex element type");
+    }
+}
@@ -0,0 +1,131 @@
+#include "Shader/ComputeShader.h"
+#include "Shader/Shader.h"
+#include "Core/GLCaps.h"
+#include "Core/GLState.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+ComputeShader::ComputeShader(const char *path, const std::string &defines)
+    : sourcePath(path), program(0)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+        return;
+    }
+    std::stringstream stream;
+    stream << file.rdbuf();
+    std::string source = Shader::injectDefines(stream.str(), defines);
+    const char *code = source.c_str();
+
+    int success;
+    char infoLog[512];
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 1, &code, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cout << infoLog << std::endl;
+        std::cerr << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED" << std::endl;
+        glDeleteShader(shader);
+        return;
+    }
+    program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDetachShader(program, shader);
+    glDeleteShader(shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cout << infoLog << std::endl;
+        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED" << std::endl;
+        GLState::deleteProgram(program);
+        program = 0;
+        return;
+    }
+    uniformTable.reflect(program);
+}
+
+ComputeShader::~ComputeShader()
+{
+    if (program)
+        GLState::deleteProgram(program);
+}
+
+bool ComputeShader::supported()
+{
+    // the loader only resolves the entry points for contexts that have them
+    bool available = GLAD_GL_VERSION_4_3
+        || (GLCaps::hasExtension("GL_ARB_compute_shader")
+            && GLCaps::hasExtension("GL_ARB_shader_storage_buffer_object"));
+    return available && glDispatchCompute != NULL;
+}
+
+bool ComputeShader::isFailed() const
+{
+    return program == 0;
+}
+
+const std::string &ComputeShader::path() const
+{
+    return sourcePath;
+}
+
+GLuint ComputeShader::id() const
+{
+    return program;
+}
+
+void ComputeShader::use() const
+{
+    GLState::useProgram(program);
+    flush();
+}
+
+UniformHandle ComputeShader::uniform(const UniformName &name) const
+{
+    return uniformTable.uniform(program, name);
+}
+
+GLint ComputeShader::location(const UniformName &name) const
+{
+    return uniformTable.location(uniform(name));
+}
+
+void ComputeShader::setInt(UniformHandle handle, int value) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::INT, &value, 1);
+}
+
+void ComputeShader::setUint(UniformHandle handle, GLuint value) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::UINT, &value, 1);
+}
+
+void ComputeShader::setVec4(UniformHandle handle, float x, float y, float z, float w) const
+{
+    const float value[4] = { x, y, z, w };
+    uniformTable.stage(handle, UniformTable::Kind::VEC4, value, 1);
+}
+
+void ComputeShader::setIVec4Array(UniformHandle handle, const int *values, int count) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::IVEC4, values, count);
+}
+
+void ComputeShader::flush() const
+{
+    uniformTable.flush();
+}
+
+void ComputeShader::dispatch(GLuint groupsX, GLuint groupsY, GLuint groupsZ) const
+{
+    glDispatchCompute(groupsX, groupsY, groupsZ);
+}
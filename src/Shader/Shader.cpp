@@ -1,8 +1,54 @@
 #include "Shader/Shader.h"
+#include "Core/GLCaps.h"
+#include "Core/GLState.h"
 
-Shader::Shader(const char *vertexPath, const char *fragmentPath)
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+std::string Shader::binaryCacheDirectory = ".scop_cache";
+
+namespace
 {
+    const char BINARY_MAGIC[4] = { 'S', 'C', 'P', 'B' };
+    const uint32_t BINARY_VERSION = 1;
+
+    // header of a cached program binary, followed by length bytes
+    struct BinaryHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    std::string glString(GLenum name)
+    {
+        const GLubyte *str = glGetString(name);
+        return str ? reinterpret_cast<const char*>(str) : "";
+    }
+}
+
+Shader::Shader(const char *vertexPath, const char *fragmentPath, bool async, const std::string &defines)
+    : vertPath(vertexPath), fragPath(fragmentPath), defineText(defines)
+{
+    ID = 0;
+    status = Status::FAILED;
+    blocksValid = true;
+    signature = 0;
+    pendingVertex = pendingFragment = pendingProgram = 0;
     // 1. retrieve the vertex/fragment source code from filePath
+    readSources();
+    // 2. compile shaders
+    beginBuild();
+    if (!async)
+        finishBuild();
+}
+
+bool Shader::readSources()
+{
     std::string vertexCode;
     std::string fragmentCode;
     std::ifstream vShaderFile;
@@ -13,8 +59,8 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath)
     try 
     {
         // open files
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
+        vShaderFile.open(vertPath.c_str());
+        fShaderFile.open(fragPath.c_str());
         std::stringstream vShaderStream, fShaderStream;
         // read file's buffer contents into streams
         vShaderStream << vShaderFile.rdbuf();
@@ -29,83 +75,570 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath)
     catch(std::ifstream::failure e)
     {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+        return false;
+    }
+    vertSource = injectDefines(vertexCode, defineText);
+    fragSource = injectDefines(fragmentCode, defineText);
+    return true;
+}
+
+bool Shader::reload()
+{
+    // a file caught half written keeps the current program
+    if (!readSources())
+        return false;
+    beginBuild();
+    return true;
+}
+
+const std::string &Shader::vertexPath() const
+{
+    return vertPath;
+}
+
+const std::string &Shader::fragmentPath() const
+{
+    return fragPath;
+}
+
+std::string Shader::injectDefines(const std::string &source, const std::string &defines)
+{
+    if (defines.empty())
+        return source;
+    // #version must stay the first directive, so the defines go right after it
+    size_t version = source.find("#version");
+    size_t insert = 0;
+    if (version != std::string::npos)
+    {
+        insert = source.find('\n', version);
+        insert = insert == std::string::npos ? source.size() : insert + 1;
     }
-    vertSource = vertexCode;
-    fragSource = fragmentCode;
-    const char* vShaderCode = vertexCode.c_str();
-    const char* fShaderCode = fragmentCode.c_str();
+    std::string result = source.substr(0, insert);
+    if (insert > 0 && result[insert - 1] != '\n')
+        result += '\n';
+    result += defines;
+    if (defines[defines.size() - 1] != '\n')
+        result += '\n';
+    result += source.substr(insert);
+    return result;
+}
+
+bool Shader::parallelCompileSupported()
+{
+    static int supported = -1;
+    if (supported < 0)
+        supported = (GLCaps::hasExtension("GL_KHR_parallel_shader_compile")
+                     || GLCaps::hasExtension("GL_ARB_parallel_shader_compile")) ? 1 : 0;
+    return supported == 1;
+}
+
+void Shader::beginBuild()
+{
+    discardPending();
+    // a program linked by an earlier run skips compilation entirely
+    GLuint cached = loadProgramBinary();
+    if (cached)
+    {
+        pendingProgram = cached;
+        status = Status::PENDING;
+        finishBuild();
+        return;
+    }
+
+    const char* vShaderCode = vertSource.c_str();
+    const char* fShaderCode = fragSource.c_str();
+    // compile and link are only issued here; their status is queried in
+    // finishBuild(), so drivers with parallel compilation work in the background
+    pendingVertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(pendingVertex, 1, &vShaderCode, NULL);
+    glCompileShader(pendingVertex);
+
+    pendingFragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(pendingFragment, 1, &fShaderCode, NULL);
+    glCompileShader(pendingFragment);
+
+    // shader Program
+    pendingProgram = glCreateProgram();
+    glAttachShader(pendingProgram, pendingVertex);
+    glAttachShader(pendingProgram, pendingFragment);
+    if (binaryCacheSupported())
+        glProgramParameteri(pendingProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(pendingProgram);
+    status = Status::PENDING;
+}
+
+bool Shader::finishBuild()
+{
+    if (status != Status::PENDING)
+        return status == Status::READY;
     try
     {
-        // 2. compile shaders
-        unsigned int vertex, fragment;
         int success;
         char infoLog[512];
-        
-        // vertex Shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
+
         // print compile errors if any
-        glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-        if(!success)
+        if (pendingVertex)
         {
-            glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-            std::cout << infoLog << std::endl;
-            throw(std::runtime_error("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n"));
-        };
-        
-        // similiar for Fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        // print compile errors if any
-        glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-        if(!success)
+            glGetShaderiv(pendingVertex, GL_COMPILE_STATUS, &success);
+            if(!success)
+            {
+                glGetShaderInfoLog(pendingVertex, 512, NULL, infoLog);
+                std::cout << infoLog << std::endl;
+                throw(std::runtime_error("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n"));
+            }
+        }
+        if (pendingFragment)
         {
-            glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-            std::cout << infoLog << std::endl;
-            throw(std::runtime_error("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n"));
-        };
-
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
+            glGetShaderiv(pendingFragment, GL_COMPILE_STATUS, &success);
+            if(!success)
+            {
+                glGetShaderInfoLog(pendingFragment, 512, NULL, infoLog);
+                std::cout << infoLog << std::endl;
+                throw(std::runtime_error("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n"));
+            }
+        }
         // print linking errors if any
-        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        glGetProgramiv(pendingProgram, GL_LINK_STATUS, &success);
         if(!success)
         {
-            glGetProgramInfoLog(ID, 512, NULL, infoLog);
+            glGetProgramInfoLog(pendingProgram, 512, NULL, infoLog);
             std::cout << infoLog << std::endl;
             throw(std::runtime_error("ERROR::SHADER::PROGRAM::LINKING_FAILED\n"));
         }
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
     }
     catch(const std::exception& e)
     {
         std::cerr << e.what() << '\n';
+        // an already working program (if any) is kept
+        discardPending();
+        status = ID ? Status::READY : Status::FAILED;
+        return false;
     }
-    
+
     // delete the shaders as they're linked into our program now and no longer necessary
+    bool fromSource = pendingVertex != 0;
+    if (pendingVertex)
+    {
+        glDetachShader(pendingProgram, pendingVertex);
+        glDeleteShader(pendingVertex);
+    }
+    if (pendingFragment)
+    {
+        glDetachShader(pendingProgram, pendingFragment);
+        glDeleteShader(pendingFragment);
+    }
+    if (ID)
+        GLState::deleteProgram(ID);
+    ID = pendingProgram;
+    pendingVertex = pendingFragment = pendingProgram = 0;
+    status = Status::READY;
+    if (fromSource)
+        saveProgramBinary();
+    uniformTable.reflect(ID);
+    bindUniformBlocks();
+    reflectAttributes();
+    return true;
+}
+
+void Shader::discardPending()
+{
+    if (pendingVertex)
+        glDeleteShader(pendingVertex);
+    if (pendingFragment)
+        glDeleteShader(pendingFragment);
+    if (pendingProgram)
+        GLState::deleteProgram(pendingProgram);
+    pendingVertex = pendingFragment = pendingProgram = 0;
+}
+
+bool Shader::isReady()
+{
+    if (status == Status::PENDING)
+    {
+        // without parallel compilation the build completes on this first poll
+        if (parallelCompileSupported())
+        {
+            GLint done = GL_FALSE;
+            glGetProgramiv(pendingProgram, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done)
+                return ID != 0;
+        }
+        finishBuild();
+    }
+    return status == Status::READY;
+}
+
+bool Shader::isPending() const
+{
+    return status == Status::PENDING;
+}
+
+bool Shader::isFailed() const
+{
+    return status == Status::FAILED;
+}
+
+bool Shader::binaryCacheSupported()
+{
+    static int supported = -1;
+    if (supported < 0)
+    {
+        GLint formats = 0;
+        if (GLAD_GL_VERSION_4_1 || GLCaps::hasExtension("GL_ARB_get_program_binary"))
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = formats > 0 ? 1 : 0;
+    }
+    return supported == 1;
+}
+
+uint64_t Shader::binaryCacheKey() const
+{
+    // sizes are hashed too so moving text between the stages changes the key
+    uint64_t sizes[2] = { vertSource.size(), fragSource.size() };
+    uint64_t key = Hash::fnv1a64(sizes, sizeof(sizes));
+    key = Hash::fnv1a64(vertSource, key);
+    key = Hash::fnv1a64(fragSource, key);
+    key = Hash::fnv1a64(glString(GL_VENDOR), key);
+    key = Hash::fnv1a64(glString(GL_RENDERER), key);
+    // GL_VERSION carries the driver version
+    key = Hash::fnv1a64(glString(GL_VERSION), key);
+    return key;
+}
+
+std::string Shader::binaryCachePath(uint64_t key)
+{
+    return binaryCacheDirectory + "/" + Hash::toHex(key) + ".progbin";
+}
+
+GLuint Shader::loadProgramBinary() const
+{
+    if (!binaryCacheSupported())
+        return 0;
+    uint64_t key = binaryCacheKey();
+    std::string path = binaryCachePath(key);
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return 0;
+
+    BinaryHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.magic, BINARY_MAGIC, 4) != 0
+        || header.version != BINARY_VERSION || header.key != key)
+        return 0;
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), header.length))
+        return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(header.length));
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        // the driver rejected it (e.g. after an update): rebuild from source
+        GLState::deleteProgram(program);
+        std::remove(path.c_str());
+        return 0;
+    }
+    return program;
+}
+
+void Shader::saveProgramBinary() const
+{
+    if (!binaryCacheSupported())
+        return;
+    GLint length = 0;
+    glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(ID, length, NULL, &format, binary.data());
+
+    if (mkdir(binaryCacheDirectory.c_str(), 0755) != 0 && errno != EEXIST)
+        return;
+    BinaryHeader header;
+    std::memcpy(header.magic, BINARY_MAGIC, 4);
+    header.version = BINARY_VERSION;
+    header.key = binaryCacheKey();
+    header.format = format;
+    header.length = static_cast<uint32_t>(length);
+
+    std::string path = binaryCachePath(header.key);
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), length);
+        if (!file)
+            return;
+    }
+    std::rename(tmpPath.c_str(), path.c_str());
+}
+
+std::vector<UniformBlockLayout> &Shader::blockLayouts()
+{
+    static std::vector<UniformBlockLayout> layouts;
+    return layouts;
+}
+
+void Shader::defineUniformBlock(const UniformBlockLayout &layout)
+{
+    std::vector<UniformBlockLayout> &layouts = blockLayouts();
+    for (size_t i = 0; i < layouts.size(); ++i)
+        if (layouts[i].name == layout.name)
+        {
+            layouts[i] = layout;
+            return;
+        }
+    layouts.push_back(layout);
+}
+
+bool Shader::uniformBlocksValid() const
+{
+    return blocksValid;
+}
+
+void Shader::bindUniformBlocks()
+{
+    blocksValid = true;
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+    std::vector<char> buffer(maxLength > 0 ? maxLength : 1);
+    const std::vector<UniformBlockLayout> &layouts = blockLayouts();
+
+    for (GLint i = 0; i < count; ++i)
+    {
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(ID, static_cast<GLuint>(i), static_cast<GLsizei>(buffer.size()), &length, buffer.data());
+        std::string name(buffer.data(), length);
+        const UniformBlockLayout *layout = NULL;
+        for (size_t l = 0; l < layouts.size(); ++l)
+            if (layouts[l].name == name)
+                layout = &layouts[l];
+        if (!layout)
+        {
+            std::cout << "ERROR::SHADER::UNIFORM_BLOCK::UNDEFINED " << name << std::endl;
+            blocksValid = false;
+            continue;
+        }
+
+        // std140 fixes the offsets; a mismatch means the C++ struct is stale
+        GLint dataSize = 0;
+        glGetActiveUniformBlockiv(ID, static_cast<GLuint>(i), GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+        if (dataSize > layout->size)
+        {
+            std::cout << "ERROR::SHADER::UNIFORM_BLOCK::SIZE_MISMATCH " << name << " "
+                      << dataSize << " > " << layout->size << std::endl;
+            blocksValid = false;
+        }
+        for (size_t m = 0; m < layout->members.size(); ++m)
+        {
+            const char *member = layout->members[m].name;
+            GLuint index = GL_INVALID_INDEX;
+            glGetUniformIndices(ID, 1, &member, &index);
+            // members the program does not use may be optimized out
+            if (index == GL_INVALID_INDEX)
+                continue;
+            GLint offset = -1;
+            glGetActiveUniformsiv(ID, 1, &index, GL_UNIFORM_OFFSET, &offset);
+            if (offset != layout->members[m].offset)
+            {
+                std::cout << "ERROR::SHADER::UNIFORM_BLOCK::OFFSET_MISMATCH " << name << "." << member << " "
+                          << offset << " != " << layout->members[m].offset << std::endl;
+                blocksValid = false;
+            }
+        }
+        glUniformBlockBinding(ID, static_cast<GLuint>(i), layout->binding);
+    }
+}
+
+void Shader::reflectAttributes()
+{
+    activeAttributes.clear();
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    std::vector<char> buffer(maxLength > 0 ? maxLength : 1);
+    for (GLint i = 0; i < count; ++i)
+    {
+        GLsizei length = 0;
+        ShaderAttribute attribute;
+        glGetActiveAttrib(ID, static_cast<GLuint>(i), static_cast<GLsizei>(buffer.size()), &length,
+                          &attribute.size, &attribute.type, buffer.data());
+        attribute.name.assign(buffer.data(), length);
+        attribute.location = glGetAttribLocation(ID, attribute.name.c_str());
+        // built-ins such as gl_VertexID have no location
+        if (attribute.location >= 0)
+            activeAttributes.push_back(attribute);
+    }
+    std::sort(activeAttributes.begin(), activeAttributes.end(),
+              [](const ShaderAttribute &a, const ShaderAttribute &b) { return a.location < b.location; });
+
+    signature = Hash::FNV64_OFFSET;
+    for (size_t i = 0; i < activeAttributes.size(); ++i)
+    {
+        const ShaderAttribute &attribute = activeAttributes[i];
+        GLint fields[3] = { attribute.location, static_cast<GLint>(attribute.type), attribute.size };
+        signature = Hash::fnv1a64(attribute.name, signature);
+        signature = Hash::fnv1a64(fields, sizeof(fields), signature);
+    }
+}
 
+const std::vector<ShaderAttribute> &Shader::attributes() const
+{
+    return activeAttributes;
+}
+
+uint64_t Shader::attributeSignature() const
+{
+    return signature;
 }
 
 void Shader::use() 
 {
-    glUseProgram(ID);
+    GLState::useProgram(ID);
+    flush();
+}
+
+UniformHandle Shader::uniform(const UniformName &name) const
+{
+    return uniformTable.uniform(ID, name);
+}
+
+GLint Shader::location(const UniformName &name) const
+{
+    return uniformTable.location(uniform(name));
+}
+
+void Shader::flush() const
+{
+    uniformTable.flush();
+}
+
+size_t Shader::uploadedUniforms() const
+{
+    return uniformTable.uploadedUniforms();
+}
+
+size_t Shader::skippedUniforms() const
+{
+    return uniformTable.skippedUniforms();
+}
+
+void Shader::resetUniformStats() const
+{
+    uniformTable.resetStats();
 }
 
 void Shader::setBool(const std::string &name, bool value) const
 {         
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+    setInt(uniform(name.c_str()), (int)value); 
 }
 void Shader::setInt(const std::string &name, int value) const
 { 
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+    setInt(uniform(name.c_str()), value); 
 }
 void Shader::setFloat(const std::string &name, float value) const
 { 
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
-} 
\ No newline at end of file
+    setFloat(uniform(name.c_str()), value); 
+}
+void Shader::setVec2(const std::string &name, float x, float y) const
+{
+    setVec2(uniform(name.c_str()), x, y);
+}
+void Shader::setVec3(const std::string &name, float x, float y, float z) const
+{
+    setVec3(uniform(name.c_str()), x, y, z);
+}
+void Shader::setVec4(const std::string &name, float x, float y, float z, float w) const
+{
+    setVec4(uniform(name.c_str()), x, y, z, w);
+}
+void Shader::setMat3(const std::string &name, const float *value) const
+{
+    setMat3(uniform(name.c_str()), value);
+}
+void Shader::setMat4(const std::string &name, const float *value) const
+{
+    setMat4(uniform(name.c_str()), value);
+}
+
+// handles index the table directly, no lookup on the hot path
+void Shader::setBool(UniformHandle handle, bool value) const
+{
+    setInt(handle, (int)value);
+}
+void Shader::setInt(UniformHandle handle, int value) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::INT, &value, 1);
+}
+void Shader::setFloat(UniformHandle handle, float value) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::FLOAT, &value, 1);
+}
+void Shader::setVec2(UniformHandle handle, float x, float y) const
+{
+    const float value[2] = { x, y };
+    uniformTable.stage(handle, UniformTable::Kind::VEC2, value, 1);
+}
+void Shader::setVec2(UniformHandle handle, const float *value) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::VEC2, value, 1);
+}
+void Shader::setVec3(UniformHandle handle, float x, float y, float z) const
+{
+    const float value[3] = { x, y, z };
+    uniformTable.stage(handle, UniformTable::Kind::VEC3, value, 1);
+}
+void Shader::setVec3(UniformHandle handle, const float *value) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::VEC3, value, 1);
+}
+void Shader::setVec4(UniformHandle handle, float x, float y, float z, float w) const
+{
+    const float value[4] = { x, y, z, w };
+    uniformTable.stage(handle, UniformTable::Kind::VEC4, value, 1);
+}
+void Shader::setVec4(UniformHandle handle, const float *value) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::VEC4, value, 1);
+}
+void Shader::setMat3(UniformHandle handle, const float *value) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::MAT3, value, 1);
+}
+void Shader::setMat4(UniformHandle handle, const float *value) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::MAT4, value, 1);
+}
+
+void Shader::setIntArray(UniformHandle handle, const int *values, int count) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::INT, values, count);
+}
+void Shader::setIVec2Array(UniformHandle handle, const int *values, int count) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::IVEC2, values, count);
+}
+void Shader::setFloatArray(UniformHandle handle, const float *values, int count) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::FLOAT, values, count);
+}
+void Shader::setVec2Array(UniformHandle handle, const float *values, int count) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::VEC2, values, count);
+}
+void Shader::setVec3Array(UniformHandle handle, const float *values, int count) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::VEC3, values, count);
+}
+void Shader::setVec4Array(UniformHandle handle, const float *values, int count) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::VEC4, values, count);
+}
+void Shader::setMat4Array(UniformHandle handle, const float *values, int count) const
+{
+    uniformTable.stage(handle, UniformTable::Kind::MAT4, values, count);
+}
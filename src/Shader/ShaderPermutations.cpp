@@ -0,0 +1,126 @@
+#include "Shader/ShaderPermutations.h"
+#include "Core/GLState.h"
+
+#include <algorithm>
+
+namespace
+{
+    // define names, in feature bit order
+    const char *FEATURE_NAMES[ShaderPermutations::FEATURE_COUNT] = {
+        "TEXTURED", "VERTEX_COLOR", "LIT", "WIREFRAME", "INSTANCED", "MULTI_DRAW",
+        "TEXTURE_ARRAY"
+    };
+}
+
+ShaderPermutations::ShaderPermutations(const std::string &vertexPath, const std::string &fragmentPath, bool async)
+    : vertPath(vertexPath), fragPath(fragmentPath), async(async), fallback(NULL), switches(0)
+{
+}
+
+ShaderPermutations::~ShaderPermutations()
+{
+    clear();
+}
+
+void ShaderPermutations::clear()
+{
+    for (std::unordered_map<uint32_t, Shader *>::iterator it = variants.begin(); it != variants.end(); ++it)
+    {
+        GLState::deleteProgram(it->second->ID);
+        delete it->second;
+    }
+    variants.clear();
+    queue.clear();
+}
+
+std::string ShaderPermutations::defines(uint32_t features)
+{
+    std::string result;
+    for (int bit = 0; bit < FEATURE_COUNT; ++bit)
+        if (features & (1u << bit))
+            result += std::string("#define ") + FEATURE_NAMES[bit] + "\n";
+    return result;
+}
+
+Shader &ShaderPermutations::get(uint32_t features)
+{
+    std::unordered_map<uint32_t, Shader *>::iterator it = variants.find(features);
+    if (it != variants.end())
+        return *it->second;
+    Shader *shader = new Shader(vertPath.c_str(), fragPath.c_str(), async, defines(features));
+    variants[features] = shader;
+    return *shader;
+}
+
+bool ShaderPermutations::has(uint32_t features) const
+{
+    return variants.find(features) != variants.end();
+}
+
+size_t ShaderPermutations::variantCount() const
+{
+    return variants.size();
+}
+
+size_t ShaderPermutations::reload()
+{
+    size_t count = 0;
+    for (std::unordered_map<uint32_t, Shader *>::iterator it = variants.begin(); it != variants.end(); ++it)
+        if (it->second->reload())
+            ++count;
+    return count;
+}
+
+const std::string &ShaderPermutations::vertexPath() const
+{
+    return vertPath;
+}
+
+const std::string &ShaderPermutations::fragmentPath() const
+{
+    return fragPath;
+}
+
+void ShaderPermutations::setFallback(Shader *shader)
+{
+    fallback = shader;
+}
+
+void ShaderPermutations::submit(uint32_t features, const std::function<void(Shader &)> &draw)
+{
+    // compile starts now, so async variants get the whole frame to finish
+    get(features);
+    Draw entry = { features, draw };
+    queue.push_back(entry);
+}
+
+void ShaderPermutations::flush()
+{
+    // stable so draws of one variant keep their submission order
+    std::stable_sort(queue.begin(), queue.end(), [](const Draw &a, const Draw &b) {
+        return a.features < b.features;
+    });
+    switches = 0;
+    Shader *bound = NULL;
+    for (size_t i = 0; i < queue.size(); ++i)
+    {
+        Shader *shader = &get(queue[i].features);
+        if (!shader->isReady())
+            shader = fallback;
+        if (!shader)
+            continue;
+        if (shader != bound)
+        {
+            shader->use();
+            bound = shader;
+            ++switches;
+        }
+        queue[i].draw(*shader);
+    }
+    queue.clear();
+}
+
+size_t ShaderPermutations::programSwitches() const
+{
+    return switches;
+}
@@ -0,0 +1,245 @@
+#include "Shader/ShaderWatcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+# include <poll.h>
+# include <sys/inotify.h>
+#endif
+
+namespace
+{
+    // how long the worker sleeps between checks of the stop flag / mtimes
+    const int WAKE_INTERVAL_MS = 100;
+    const int POLL_INTERVAL_MS = 500;
+}
+
+ShaderWatcher::ShaderWatcher(const std::vector<std::string> &directories)
+    : directories(directories), inotifyFd(-1), stop(false)
+{
+#ifdef __linux__
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd >= 0)
+    {
+        for (size_t i = 0; i < directories.size(); ++i)
+        {
+            // the directory is watched, not the files: editors often save by
+            // writing a new file and renaming it over the old one
+            int wd = inotify_add_watch(inotifyFd, directories[i].c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (wd >= 0)
+                watchDirectory[wd] = directories[i];
+        }
+        if (watchDirectory.empty())
+        {
+            close(inotifyFd);
+            inotifyFd = -1;
+        }
+    }
+#endif
+    if (inotifyFd >= 0)
+        worker = std::thread(&ShaderWatcher::inotifyLoop, this);
+    else
+        worker = std::thread(&ShaderWatcher::pollLoop, this);
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+    stop = true;
+    if (worker.joinable())
+        worker.join();
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+}
+
+std::vector<std::string> ShaderWatcher::defaultDirectories()
+{
+    std::vector<std::string> result;
+    result.push_back("shaders/vertex");
+    result.push_back("shaders/fragment");
+    return result;
+}
+
+void ShaderWatcher::watch(Shader &shader)
+{
+    if (std::find(shaders.begin(), shaders.end(), &shader) == shaders.end())
+        shaders.push_back(&shader);
+}
+
+void ShaderWatcher::watch(ShaderPermutations &set)
+{
+    if (std::find(permutations.begin(), permutations.end(), &set) == permutations.end())
+        permutations.push_back(&set);
+}
+
+void ShaderWatcher::unwatch(Shader &shader)
+{
+    shaders.erase(std::remove(shaders.begin(), shaders.end(), &shader), shaders.end());
+    reloading.erase(std::remove(reloading.begin(), reloading.end(), &shader), reloading.end());
+}
+
+void ShaderWatcher::unwatch(ShaderPermutations &set)
+{
+    permutations.erase(std::remove(permutations.begin(), permutations.end(), &set), permutations.end());
+}
+
+bool ShaderWatcher::usesInotify() const
+{
+    return inotifyFd >= 0;
+}
+
+std::vector<std::string> ShaderWatcher::takeChanges()
+{
+    std::vector<std::string> result;
+    std::lock_guard<std::mutex> lock(mutex);
+    result.swap(changes);
+    return result;
+}
+
+size_t ShaderWatcher::update()
+{
+    // standalone shaders are polled here; permutation variants are polled
+    // by ShaderPermutations::flush()
+    for (size_t i = 0; i < reloading.size();)
+    {
+        reloading[i]->isReady();
+        if (reloading[i]->isPending())
+            ++i;
+        else
+            reloading.erase(reloading.begin() + i);
+    }
+
+    std::vector<std::string> changed = takeChanges();
+    if (changed.empty())
+        return 0;
+
+    size_t started = 0;
+    for (size_t i = 0; i < shaders.size(); ++i)
+    {
+        Shader *shader = shaders[i];
+        std::string vertex = canonicalPath(shader->vertexPath());
+        std::string fragment = canonicalPath(shader->fragmentPath());
+        for (size_t c = 0; c < changed.size(); ++c)
+        {
+            if (changed[c] != vertex && changed[c] != fragment)
+                continue;
+            if (shader->reload())
+            {
+                ++started;
+                if (std::find(reloading.begin(), reloading.end(), shader) == reloading.end())
+                    reloading.push_back(shader);
+            }
+            break;
+        }
+    }
+    for (size_t i = 0; i < permutations.size(); ++i)
+    {
+        std::string vertex = canonicalPath(permutations[i]->vertexPath());
+        std::string fragment = canonicalPath(permutations[i]->fragmentPath());
+        if (std::find(changed.begin(), changed.end(), vertex) != changed.end()
+            || std::find(changed.begin(), changed.end(), fragment) != changed.end())
+            started += permutations[i]->reload();
+    }
+    return started;
+}
+
+std::string ShaderWatcher::canonicalPath(const std::string &path)
+{
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved))
+        return resolved;
+    return path;
+}
+
+bool ShaderWatcher::isShaderFile(const std::string &name)
+{
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos)
+        return false;
+    std::string extension = name.substr(dot);
+    return extension == ".vert" || extension == ".frag";
+}
+
+void ShaderWatcher::pushChange(const std::string &path)
+{
+    std::string canonical = canonicalPath(path);
+    std::lock_guard<std::mutex> lock(mutex);
+    // an editor save is often several events for the same file
+    if (std::find(changes.begin(), changes.end(), canonical) == changes.end())
+        changes.push_back(canonical);
+}
+
+void ShaderWatcher::inotifyLoop()
+{
+#ifdef __linux__
+    // aligned as required for struct inotify_event
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (!stop)
+    {
+        struct pollfd descriptor = { inotifyFd, POLLIN, 0 };
+        if (poll(&descriptor, 1, WAKE_INTERVAL_MS) <= 0)
+            continue;
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0)
+            continue;
+        for (char *cursor = buffer; cursor < buffer + length;)
+        {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(cursor);
+            cursor += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0 || !isShaderFile(event->name))
+                continue;
+            std::map<int, std::string>::const_iterator dir = watchDirectory.find(event->wd);
+            if (dir != watchDirectory.end())
+                pushChange(dir->second + "/" + event->name);
+        }
+    }
+#endif
+}
+
+void ShaderWatcher::pollLoop()
+{
+    std::map<std::string, time_t> mtimes;
+    scan(mtimes, false);
+    int elapsed = 0;
+    while (!stop)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(WAKE_INTERVAL_MS));
+        elapsed += WAKE_INTERVAL_MS;
+        if (elapsed < POLL_INTERVAL_MS)
+            continue;
+        elapsed = 0;
+        scan(mtimes, true);
+    }
+}
+
+void ShaderWatcher::scan(std::map<std::string, time_t> &mtimes, bool report)
+{
+    for (size_t i = 0; i < directories.size(); ++i)
+    {
+        DIR *dir = opendir(directories[i].c_str());
+        if (!dir)
+            continue;
+        while (struct dirent *entry = readdir(dir))
+        {
+            if (!isShaderFile(entry->d_name))
+                continue;
+            std::string path = directories[i] + "/" + entry->d_name;
+            struct stat info;
+            if (stat(path.c_str(), &info) != 0)
+                continue;
+            std::map<std::string, time_t>::iterator known = mtimes.find(path);
+            if (known == mtimes.end() || known->second != info.st_mtime)
+            {
+                if (report)
+                    pushChange(path);
+                mtimes[path] = info.st_mtime;
+            }
+        }
+        closedir(dir);
+    }
+}
@@ -0,0 +1,87 @@
+#include "Shader/UniformBuffer.h"
+#include "Core/GLState.h"
+
+#include <cstring>
+
+UniformBuffer::UniformBuffer(GLuint binding, size_t blockSize, size_t count, StreamBuffer *stream)
+    : binding(binding), blockSize(blockSize), entryCount(count), stream(stream), uploadedFrame(0), id(0),
+      dirty(true)
+{
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment <= 0)
+        alignment = 256;
+    entryStride = (blockSize + alignment - 1) / alignment * alignment;
+
+    staging.assign(entryStride * entryCount, 0);
+    current.data = NULL;
+    current.buffer = 0;
+    current.offset = 0;
+    current.size = static_cast<GLsizeiptr>(staging.size());
+    if (stream)
+        return;
+    glGenBuffers(1, &id);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, id);
+    glBufferData(GL_UNIFORM_BUFFER, current.size, NULL, GL_DYNAMIC_DRAW);
+    current.buffer = id;
+}
+
+UniformBuffer::~UniformBuffer()
+{
+    if (id)
+        GLState::deleteBuffers(1, &id);
+}
+
+void *UniformBuffer::entry(size_t index)
+{
+    dirty = true;
+    return &staging[index * entryStride];
+}
+
+void UniformBuffer::write(size_t index, const void *data)
+{
+    std::memcpy(entry(index), data, blockSize);
+}
+
+void UniformBuffer::upload()
+{
+    if (stream)
+    {
+        // last frame's allocation is recycled once the stream laps it
+        if (!dirty && uploadedFrame == stream->frame())
+            return;
+        current = stream->allocate(staging.size(), entryStride);
+        std::memcpy(current.data, staging.data(), staging.size());
+        stream->commit(current);
+        uploadedFrame = stream->frame();
+        dirty = false;
+        return;
+    }
+    if (!dirty)
+        return;
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, id);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, static_cast<GLsizeiptr>(staging.size()), staging.data());
+    dirty = false;
+}
+
+void UniformBuffer::bind(size_t index)
+{
+    // redundant binds are filtered by GLState
+    GLintptr offset = current.offset + static_cast<GLintptr>(index * entryStride);
+    GLState::bindBufferRange(GL_UNIFORM_BUFFER, binding, current.buffer, offset, static_cast<GLsizeiptr>(blockSize));
+}
+
+GLuint UniformBuffer::buffer() const
+{
+    return current.buffer;
+}
+
+size_t UniformBuffer::stride() const
+{
+    return entryStride;
+}
+
+size_t UniformBuffer::count() const
+{
+    return entryCount;
+}
@@ -0,0 +1,198 @@
+#include "Shader/UniformTable.h"
+
+#include <cstring>
+
+namespace
+{
+    // 32-bit words per element of each UniformTable::Kind
+    const size_t KIND_WORDS[] = { 0, 1, 1, 2, 3, 4, 9, 16, 2, 1, 4 };
+}
+
+UniformTable::UniformTable() : uploadCount(0), skipCount(0)
+{
+}
+
+void UniformTable::reflect(GLuint program)
+{
+    // entries from a previous link keep their index, so handles stay valid;
+    // their location is re-resolved and staged values are uploaded again
+    dirty.clear();
+    for (size_t i = 0; i < uniforms.size(); ++i)
+    {
+        Uniform &u = uniforms[i];
+        u.location = glGetUniformLocation(program, u.name.c_str());
+        u.dirty = u.location >= 0 && u.kind != Kind::NONE;
+        if (u.dirty)
+            dirty.push_back(static_cast<int>(i));
+    }
+
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> buffer(maxLength > 0 ? maxLength : 1);
+
+    for (GLint i = 0; i < count; ++i)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, static_cast<GLuint>(i), static_cast<GLsizei>(buffer.size()), &length, &size, &type, buffer.data());
+        std::string name(buffer.data(), length);
+        // block members have no location of their own
+        GLint location = glGetUniformLocation(program, name.c_str());
+        if (location < 0)
+            continue;
+        // arrays are reported as "name[0]", register them under "name" too
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+        {
+            std::string base = name.substr(0, name.size() - 3);
+            registerUniform(base, location, type, size);
+        }
+        registerUniform(name, location, type, size);
+    }
+}
+
+void UniformTable::registerUniform(const std::string &name, GLint location, GLenum type, GLint size)
+{
+    uint32_t hash = Hash::fnv1a32(name.c_str());
+    int index = find(name.c_str(), hash);
+    if (index < 0)
+        index = add(name, hash, location, type, size);
+    uniforms[index].type = type;
+    uniforms[index].size = size;
+}
+
+int UniformTable::find(const char *name, uint32_t hash) const
+{
+    if (slots.empty())
+        return -1;
+    size_t mask = slots.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+    {
+        int index = slots[slot];
+        if (index < 0)
+            return -1;
+        if (uniforms[index].hash == hash && uniforms[index].name == name)
+            return index;
+    }
+}
+
+int UniformTable::add(const std::string &name, uint32_t hash, GLint location, GLenum type, GLint size) const
+{
+    if (slots.empty() || (uniforms.size() + 1) * 2 > slots.size())
+    {
+        // grow and reinsert
+        std::vector<int> grown(slots.empty() ? 16 : slots.size() * 2, -1);
+        size_t mask = grown.size() - 1;
+        for (size_t i = 0; i < uniforms.size(); ++i)
+        {
+            size_t slot = uniforms[i].hash & mask;
+            while (grown[slot] >= 0)
+                slot = (slot + 1) & mask;
+            grown[slot] = static_cast<int>(i);
+        }
+        slots.swap(grown);
+    }
+
+    Uniform entry;
+    entry.name = name;
+    entry.hash = hash;
+    entry.location = location;
+    entry.type = type;
+    entry.size = size;
+    entry.kind = Kind::NONE;
+    entry.count = 0;
+    entry.dirty = false;
+    uniforms.push_back(entry);
+
+    size_t mask = slots.size() - 1;
+    size_t slot = hash & mask;
+    while (slots[slot] >= 0)
+        slot = (slot + 1) & mask;
+    slots[slot] = static_cast<int>(uniforms.size() - 1);
+    return static_cast<int>(uniforms.size() - 1);
+}
+
+UniformHandle UniformTable::uniform(GLuint program, const UniformName &name) const
+{
+    int index = find(name.name, name.hash);
+    if (index < 0)
+    {
+        // e.g. "lights[2]" or struct members: ask the driver once, remember the answer
+        GLint location = program ? glGetUniformLocation(program, name.name) : -1;
+        index = add(name.name, name.hash, location, GL_NONE, 1);
+    }
+    return UniformHandle(index);
+}
+
+GLint UniformTable::location(UniformHandle handle) const
+{
+    return handle.valid() ? uniforms[handle.index].location : -1;
+}
+
+void UniformTable::stage(UniformHandle handle, Kind kind, const void *data, GLsizei count) const
+{
+    if (!handle.valid())
+        return;
+    Uniform &u = uniforms[handle.index];
+    size_t words = KIND_WORDS[static_cast<int>(kind)] * static_cast<size_t>(count);
+    if (u.kind == kind && u.count == count
+        && std::memcmp(u.shadow.data(), data, words * sizeof(uint32_t)) == 0)
+    {
+        ++skipCount;
+        return;
+    }
+    u.kind = kind;
+    u.count = count;
+    u.shadow.resize(words);
+    std::memcpy(u.shadow.data(), data, words * sizeof(uint32_t));
+    if (!u.dirty && u.location >= 0)
+    {
+        u.dirty = true;
+        dirty.push_back(handle.index);
+    }
+}
+
+void UniformTable::flush() const
+{
+    for (size_t i = 0; i < dirty.size(); ++i)
+    {
+        Uniform &u = uniforms[dirty[i]];
+        const GLint *ints = reinterpret_cast<const GLint*>(u.shadow.data());
+        const GLuint *uints = reinterpret_cast<const GLuint*>(u.shadow.data());
+        const GLfloat *floats = reinterpret_cast<const GLfloat*>(u.shadow.data());
+        switch (u.kind)
+        {
+            case Kind::INT:   glUniform1iv(u.location, u.count, ints); break;
+            case Kind::FLOAT: glUniform1fv(u.location, u.count, floats); break;
+            case Kind::VEC2:  glUniform2fv(u.location, u.count, floats); break;
+            case Kind::VEC3:  glUniform3fv(u.location, u.count, floats); break;
+            case Kind::VEC4:  glUniform4fv(u.location, u.count, floats); break;
+            case Kind::MAT3:  glUniformMatrix3fv(u.location, u.count, GL_FALSE, floats); break;
+            case Kind::MAT4:  glUniformMatrix4fv(u.location, u.count, GL_FALSE, floats); break;
+            case Kind::IVEC2: glUniform2iv(u.location, u.count, ints); break;
+            case Kind::UINT:  glUniform1uiv(u.location, u.count, uints); break;
+            case Kind::IVEC4: glUniform4iv(u.location, u.count, ints); break;
+            default: break;
+        }
+        u.dirty = false;
+        ++uploadCount;
+    }
+    dirty.clear();
+}
+
+size_t UniformTable::uploadedUniforms() const
+{
+    return uploadCount;
+}
+
+size_t UniformTable::skippedUniforms() const
+{
+    return skipCount;
+}
+
+void UniformTable::resetStats() const
+{
+    uploadCount = 0;
+    skipCount = 0;
+}
@@ -0,0 +1,274 @@
+#include "Texture/ScopTex.h"
+#include "Texture/TextureCompressor.h"
+#include "Core/GLState.h"
+#include "Core/Hash.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::string ScopTex::cacheDirectory = ".scop_cache";
+
+namespace
+{
+    const char SCOPTEX_MAGIC[4] = { 'S', 'C', 'P', 'T' };
+    const uint32_t SCOPTEX_VERSION = 1;
+    const uint64_t PAYLOAD_ALIGNMENT = 16;
+
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    bool isValidFormat(uint32_t format)
+    {
+        return format >= static_cast<uint32_t>(ScopTex::Format::RGBA8)
+            && format <= static_cast<uint32_t>(ScopTex::Format::BC3);
+    }
+
+    bool isCompressed(ScopTex::Format format)
+    {
+        return format == ScopTex::Format::BC1 || format == ScopTex::Format::BC3;
+    }
+}
+
+ScopTex::Mapping::Mapping() : base(NULL), length(0)
+{
+}
+
+ScopTex::Mapping::~Mapping()
+{
+    close();
+}
+
+bool ScopTex::Mapping::open(const std::string &path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+    {
+        ::close(fd);
+        return false;
+    }
+    void *addr = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+    base = addr;
+    length = static_cast<size_t>(st.st_size);
+
+    // validate everything upload() will touch
+    const Header &head = header();
+    bool valid = std::memcmp(head.magic, SCOPTEX_MAGIC, 4) == 0
+              && head.version == SCOPTEX_VERSION
+              && isValidFormat(head.format)
+              && head.mipCount > 0
+              && sizeof(Header) + head.mipCount * sizeof(MipEntry) <= length;
+    for (uint32_t i = 0; valid && i < head.mipCount; ++i)
+    {
+        const MipEntry &entry = mip(i);
+        valid = entry.offset <= length
+             && entry.size <= length - entry.offset
+             && entry.size == levelSize(format(), static_cast<int>(entry.width), static_cast<int>(entry.height));
+    }
+    if (!valid)
+        close();
+    return valid;
+}
+
+void ScopTex::Mapping::close()
+{
+    if (base)
+        munmap(base, length);
+    base = NULL;
+    length = 0;
+}
+
+bool ScopTex::Mapping::isOpen() const
+{
+    return base != NULL;
+}
+
+const ScopTex::Header &ScopTex::Mapping::header() const
+{
+    return *static_cast<const Header*>(base);
+}
+
+ScopTex::Format ScopTex::Mapping::format() const
+{
+    return static_cast<Format>(header().format);
+}
+
+const ScopTex::MipEntry &ScopTex::Mapping::mip(uint32_t level) const
+{
+    const uint8_t *entries = static_cast<const uint8_t*>(base) + sizeof(Header);
+    return *reinterpret_cast<const MipEntry*>(entries + level * sizeof(MipEntry));
+}
+
+const uint8_t *ScopTex::Mapping::mipData(uint32_t level) const
+{
+    return static_cast<const uint8_t*>(base) + mip(level).offset;
+}
+
+bool ScopTex::Mapping::matchesSource(const std::string &filename) const
+{
+    uint64_t size;
+    int64_t mtime;
+    if (!isOpen() || !sourceStat(filename, size, mtime))
+        return false;
+    return header().sourceSize == size && header().sourceMtime == mtime;
+}
+
+bool ScopTex::ensureCacheDirectory()
+{
+    if (mkdir(cacheDirectory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        std::cerr << "ERROR::TEXTURE::CACHE_DIRECTORY_NOT_CREATED " << cacheDirectory << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string ScopTex::cachePathForSource(const std::string &filename)
+{
+    return cacheDirectory + "/" + Hash::toHex(Hash::fnv1a64(filename)) + ".scoptex";
+}
+
+std::string ScopTex::cachePathForHash(uint64_t hash)
+{
+    return cacheDirectory + "/" + Hash::toHex(hash) + ".scoptex";
+}
+
+size_t ScopTex::levelSize(Format format, int width, int height)
+{
+    switch (format)
+    {
+        case Format::BC1:
+            return TextureCompressor::levelSize(TextureCompressor::Format::BC1, width, height);
+        case Format::BC3:
+            return TextureCompressor::levelSize(TextureCompressor::Format::BC3, width, height);
+        default:
+            return static_cast<size_t>(width) * static_cast<size_t>(height) * 4;
+    }
+}
+
+bool ScopTex::sourceStat(const std::string &filename, uint64_t &size, int64_t &mtime)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return false;
+    size = static_cast<uint64_t>(st.st_size);
+    mtime = static_cast<int64_t>(st.st_mtime);
+    return true;
+}
+
+bool ScopTex::write(const std::string &path, Format format, int width, int height,
+                    const std::vector<Level> &mips, const std::string &sourceFile)
+{
+    if (mips.empty() || !ensureCacheDirectory())
+        return false;
+
+    Header head;
+    std::memcpy(head.magic, SCOPTEX_MAGIC, 4);
+    head.version = SCOPTEX_VERSION;
+    head.format = static_cast<uint32_t>(format);
+    head.width = static_cast<uint32_t>(width);
+    head.height = static_cast<uint32_t>(height);
+    head.mipCount = static_cast<uint32_t>(mips.size());
+    head.sourceSize = 0;
+    head.sourceMtime = 0;
+    sourceStat(sourceFile, head.sourceSize, head.sourceMtime);
+
+    std::vector<MipEntry> entries(mips.size());
+    uint64_t offset = alignUp(sizeof(Header) + mips.size() * sizeof(MipEntry), PAYLOAD_ALIGNMENT);
+    for (size_t i = 0; i < mips.size(); ++i)
+    {
+        entries[i].offset = offset;
+        entries[i].size = mips[i].size;
+        entries[i].width = static_cast<uint32_t>(mips[i].width);
+        entries[i].height = static_cast<uint32_t>(mips[i].height);
+        offset = alignUp(offset + mips[i].size, PAYLOAD_ALIGNMENT);
+    }
+
+    // written under a temporary name so a crash never leaves a truncated container
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            std::cerr << "ERROR::TEXTURE::SCOPTEX_NOT_WRITTEN " << path << std::endl;
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&head), sizeof(Header));
+        file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MipEntry));
+        static const char zeros[PAYLOAD_ALIGNMENT] = { 0 };
+        for (size_t i = 0; i < mips.size(); ++i)
+        {
+            uint64_t pos = static_cast<uint64_t>(file.tellp());
+            file.write(zeros, static_cast<std::streamsize>(entries[i].offset - pos));
+            file.write(static_cast<const char*>(mips[i].data), static_cast<std::streamsize>(mips[i].size));
+        }
+        if (!file)
+        {
+            std::cerr << "ERROR::TEXTURE::SCOPTEX_NOT_WRITTEN " << path << std::endl;
+            return false;
+        }
+    }
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+bool ScopTex::upload(const Mapping &mapping, GLuint textureID)
+{
+    Format format = mapping.format();
+    if (isCompressed(format) && !TextureCompressor::isSupported())
+        return false;
+
+    uint32_t mipCount = mapping.header().mipCount;
+    GLState::bindTexture(GL_TEXTURE_2D, textureID);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(mipCount) - 1);
+
+    for (uint32_t level = 0; level < mipCount; ++level)
+    {
+        const MipEntry &entry = mapping.mip(level);
+        GLsizei w = static_cast<GLsizei>(entry.width);
+        GLsizei h = static_cast<GLsizei>(entry.height);
+        switch (format)
+        {
+            case Format::BC1:
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, w, h, 0,
+                                       static_cast<GLsizei>(entry.size), mapping.mipData(level));
+                break;
+            case Format::BC3:
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, w, h, 0,
+                                       static_cast<GLsizei>(entry.size), mapping.mipData(level));
+                break;
+            case Format::BGRA8:
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, w, h, 0,
+                             GL_BGRA, GL_UNSIGNED_BYTE, mapping.mipData(level));
+                break;
+            default:
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, w, h, 0,
+                             GL_RGBA, GL_UNSIGNED_BYTE, mapping.mipData(level));
+                break;
+        }
+    }
+    return true;
+}
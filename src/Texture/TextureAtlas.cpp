@@ -0,0 +1,323 @@
+#include "Texture/TextureAtlas.h"
+#include "BPMLoader.h"
+#include "Core/GLState.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    int alignUp(int value, int alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // largest power of two not above value (at least 1)
+    int floorPow2(int value)
+    {
+        int result = 1;
+        while (result * 2 <= value)
+            result *= 2;
+        return result;
+    }
+
+    int log2i(int value)
+    {
+        int result = 0;
+        while ((1 << (result + 1)) <= value)
+            ++result;
+        return result;
+    }
+}
+
+SkylinePacker::SkylinePacker(int width, int height) : width(width), height(height)
+{
+    Segment first = { 0, 0, width };
+    skyline.push_back(first);
+}
+
+int SkylinePacker::fit(size_t index, int rectWidth, int rectHeight) const
+{
+    int x = skyline[index].x;
+    if (x + rectWidth > width)
+        return -1;
+    int y = 0;
+    int remaining = rectWidth;
+    for (size_t i = index; remaining > 0; ++i)
+    {
+        if (i >= skyline.size())
+            return -1;
+        y = std::max(y, skyline[i].y);
+        if (y + rectHeight > height)
+            return -1;
+        remaining -= skyline[i].width;
+    }
+    return y;
+}
+
+bool SkylinePacker::insert(int rectWidth, int rectHeight, Rect &out)
+{
+    size_t bestIndex = skyline.size();
+    int bestTop = height + 1;
+    int bestX = width + 1;
+    for (size_t i = 0; i < skyline.size(); ++i)
+    {
+        int y = fit(i, rectWidth, rectHeight);
+        if (y < 0)
+            continue;
+        // bottom-left: lowest top edge first, leftmost on ties
+        if (y + rectHeight < bestTop || (y + rectHeight == bestTop && skyline[i].x < bestX))
+        {
+            bestIndex = i;
+            bestTop = y + rectHeight;
+            bestX = skyline[i].x;
+        }
+    }
+    if (bestIndex == skyline.size())
+        return false;
+
+    out.x = bestX;
+    out.y = bestTop - rectHeight;
+    out.width = rectWidth;
+    out.height = rectHeight;
+
+    Segment placed = { bestX, bestTop, rectWidth };
+    skyline.insert(skyline.begin() + bestIndex, placed);
+    // shrink or drop the segments now covered by the new one
+    for (size_t i = bestIndex + 1; i < skyline.size();)
+    {
+        int placedEnd = placed.x + placed.width;
+        if (skyline[i].x >= placedEnd)
+            break;
+        int shrink = placedEnd - skyline[i].x;
+        if (skyline[i].width <= shrink)
+        {
+            skyline.erase(skyline.begin() + i);
+            continue;
+        }
+        skyline[i].x += shrink;
+        skyline[i].width -= shrink;
+        break;
+    }
+    // merge neighbours at the same height
+    for (size_t i = 0; i + 1 < skyline.size();)
+    {
+        if (skyline[i].y == skyline[i + 1].y)
+        {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        }
+        else
+            ++i;
+    }
+    return true;
+}
+
+TextureAtlas::TextureAtlas(int maxSize, int padding)
+    : maxSize(maxSize), padding(padding), atlasWidth(0), atlasHeight(0)
+{
+}
+
+int TextureAtlas::add(const std::vector<uint8_t> &rgba, int width, int height)
+{
+    if (rgba.size() != static_cast<size_t>(width) * height * 4)
+        throw std::runtime_error("Atlas image size does not match its dimensions");
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.rgba = rgba;
+    image.rect.x = image.rect.y = image.rect.width = image.rect.height = 0;
+    images.push_back(image);
+    return static_cast<int>(images.size()) - 1;
+}
+
+int TextureAtlas::addBMP(const std::string &filename)
+{
+    int width, height;
+    std::vector<uint8_t> rgba = BMPLoader::loadBMP(filename, width, height);
+    return add(rgba, width, height);
+}
+
+bool TextureAtlas::pack(int packWidth, int packHeight, const std::vector<size_t> &order)
+{
+    // cells start on a grid as coarse as the gutter so mips stay separated
+    int grid = floorPow2(padding);
+    SkylinePacker packer(packWidth, packHeight);
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        Image &image = images[order[i]];
+        int cellWidth = alignUp(image.width + 2 * padding, grid);
+        int cellHeight = alignUp(image.height + 2 * padding, grid);
+        if (!packer.insert(cellWidth, cellHeight, image.rect))
+            return false;
+    }
+    return true;
+}
+
+std::vector<uint8_t> TextureAtlas::compose() const
+{
+    std::vector<uint8_t> atlas(static_cast<size_t>(atlasWidth) * atlasHeight * 4, 0);
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        const Image &image = images[i];
+        // image plus gutter, gutter texels replicate the nearest edge
+        for (int y = -padding; y < image.height + padding; ++y)
+        {
+            int srcY = std::min(std::max(y, 0), image.height - 1);
+            int dstY = image.rect.y + padding + y;
+            for (int x = -padding; x < image.width + padding; ++x)
+            {
+                int srcX = std::min(std::max(x, 0), image.width - 1);
+                int dstX = image.rect.x + padding + x;
+                std::memcpy(&atlas[(static_cast<size_t>(dstY) * atlasWidth + dstX) * 4],
+                            &image.rgba[(static_cast<size_t>(srcY) * image.width + srcX) * 4], 4);
+            }
+        }
+    }
+    return atlas;
+}
+
+bool TextureAtlas::build(GLuint textureID, bool mipmaps)
+{
+    if (images.empty())
+        return false;
+
+    std::vector<size_t> order(images.size());
+    size_t area = 0;
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        order[i] = i;
+        area += static_cast<size_t>(images[i].width + 2 * padding) * (images[i].height + 2 * padding);
+    }
+    // tallest first packs tightest with a skyline
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        if (images[a].height != images[b].height)
+            return images[a].height > images[b].height;
+        return images[a].width > images[b].width;
+    });
+
+    atlasWidth = atlasHeight = 64;
+    while (static_cast<size_t>(atlasWidth) * atlasHeight < area)
+    {
+        if (atlasWidth <= atlasHeight)
+            atlasWidth *= 2;
+        else
+            atlasHeight *= 2;
+    }
+    // the images alone need more area than the largest atlas holds
+    if (atlasWidth > maxSize || atlasHeight > maxSize)
+        return false;
+    while (!pack(atlasWidth, atlasHeight, order))
+    {
+        if (atlasWidth <= atlasHeight)
+            atlasWidth *= 2;
+        else
+            atlasHeight *= 2;
+        if (atlasWidth > maxSize || atlasHeight > maxSize)
+            return false;
+    }
+
+    regions.resize(images.size());
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        const Image &image = images[i];
+        regions[i].u0 = static_cast<float>(image.rect.x + padding) / atlasWidth;
+        regions[i].v0 = static_cast<float>(image.rect.y + padding) / atlasHeight;
+        regions[i].u1 = static_cast<float>(image.rect.x + padding + image.width) / atlasWidth;
+        regions[i].v1 = static_cast<float>(image.rect.y + padding + image.height) / atlasHeight;
+    }
+
+    std::vector<uint8_t> atlas = compose();
+    GLState::bindTexture(GL_TEXTURE_2D, textureID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    // beyond this level a texel of the gutter no longer separates neighbours
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mipmaps ? log2i(floorPow2(padding)) : 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasWidth, atlasHeight, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, atlas.data());
+    if (mipmaps)
+        glGenerateMipmap(GL_TEXTURE_2D);
+    return true;
+}
+
+const TextureAtlas::Region &TextureAtlas::region(int index) const
+{
+    return regions.at(static_cast<size_t>(index));
+}
+
+size_t TextureAtlas::imageCount() const
+{
+    return images.size();
+}
+
+int TextureAtlas::width() const
+{
+    return atlasWidth;
+}
+
+int TextureAtlas::height() const
+{
+    return atlasHeight;
+}
+
+void TextureAtlas::remapUVs(int index, float *vertices, size_t vertexCount,
+                            size_t strideFloats, size_t uvOffsetFloats) const
+{
+    const Region &r = region(index);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        float *uv = vertices + i * strideFloats + uvOffsetFloats;
+        uv[0] = r.u0 + uv[0] * (r.u1 - r.u0);
+        uv[1] = r.v0 + uv[1] * (r.v1 - r.v0);
+    }
+}
+
+TextureArrayBuilder::TextureArrayBuilder() : width(0), height(0)
+{
+}
+
+int TextureArrayBuilder::add(const std::vector<uint8_t> &rgba, int layerWidth, int layerHeight)
+{
+    if (texels.empty())
+    {
+        width = layerWidth;
+        height = layerHeight;
+    }
+    else if (layerWidth != width || layerHeight != height)
+        throw std::runtime_error("Texture array layers must all have the same size");
+    if (rgba.size() != static_cast<size_t>(layerWidth) * layerHeight * 4)
+        throw std::runtime_error("Texture array layer size does not match its dimensions");
+    texels.insert(texels.end(), rgba.begin(), rgba.end());
+    return layerCount() - 1;
+}
+
+int TextureArrayBuilder::addBMP(const std::string &filename)
+{
+    int layerWidth, layerHeight;
+    std::vector<uint8_t> rgba = BMPLoader::loadBMP(filename, layerWidth, layerHeight);
+    return add(rgba, layerWidth, layerHeight);
+}
+
+void TextureArrayBuilder::build(GLuint textureID, bool mipmaps)
+{
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layerCount(), 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+    if (mipmaps)
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+}
+
+int TextureArrayBuilder::layerCount() const
+{
+    if (width == 0 || height == 0)
+        return 0;
+    return static_cast<int>(texels.size() / (static_cast<size_t>(width) * height * 4));
+}
@@ -0,0 +1,431 @@
+#include "Texture/TextureCompressor.h"
+#include "Core/GLCaps.h"
+#include "Core/GLState.h"
+#include "Core/Hash.h"
+#include "Core/Parallel.h"
+#include "Texture/ScopTex.h"
+#include "BPMLoader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+namespace
+{
+    uint16_t pack565(int r, int g, int b)
+    {
+        return static_cast<uint16_t>((((r * 31 + 127) / 255) << 11)
+                                   | (((g * 63 + 127) / 255) << 5)
+                                   | ((b * 31 + 127) / 255));
+    }
+
+    void unpack565(uint16_t c, int out[3])
+    {
+        int r = (c >> 11) & 31;
+        int g = (c >> 5) & 63;
+        int b = c & 31;
+        out[0] = (r << 3) | (r >> 2);
+        out[1] = (g << 2) | (g >> 4);
+        out[2] = (b << 3) | (b >> 2);
+    }
+
+    int clampByte(float v)
+    {
+        if (v < 0.0f)
+            return 0;
+        if (v > 255.0f)
+            return 255;
+        return static_cast<int>(v + 0.5f);
+    }
+
+    // per-channel min/max over the 16 texels of a block
+    void blockBounds(const uint8_t *rgba, uint8_t mins[4], uint8_t maxs[4])
+    {
+#if defined(__SSE2__)
+        const __m128i *src = reinterpret_cast<const __m128i*>(rgba);
+        __m128i r0 = _mm_loadu_si128(src + 0);
+        __m128i r1 = _mm_loadu_si128(src + 1);
+        __m128i r2 = _mm_loadu_si128(src + 2);
+        __m128i r3 = _mm_loadu_si128(src + 3);
+        __m128i mn = _mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3));
+        __m128i mx = _mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3));
+        // fold the four texels of each register into one
+        mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+        mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+        mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+        mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+        uint32_t packedMin = static_cast<uint32_t>(_mm_cvtsi128_si32(mn));
+        uint32_t packedMax = static_cast<uint32_t>(_mm_cvtsi128_si32(mx));
+        std::memcpy(mins, &packedMin, 4);
+        std::memcpy(maxs, &packedMax, 4);
+#else
+        for (int c = 0; c < 4; ++c)
+        {
+            mins[c] = 255;
+            maxs[c] = 0;
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                uint8_t v = rgba[i * 4 + c];
+                if (v < mins[c])
+                    mins[c] = v;
+                if (v > maxs[c])
+                    maxs[c] = v;
+            }
+        }
+#endif
+    }
+
+    // range fit: endpoints are the extremes of the texels projected on the
+    // principal axis of the block's color distribution
+    void fitColorEndpoints(const uint8_t *rgba, const uint8_t mins[4], const uint8_t maxs[4],
+                           int e0[3], int e1[3])
+    {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 3; ++c)
+                mean[c] += rgba[i * 4 + c];
+        for (int c = 0; c < 3; ++c)
+            mean[c] /= 16.0f;
+
+        float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; ++i)
+        {
+            float r = rgba[i * 4 + 0] - mean[0];
+            float g = rgba[i * 4 + 1] - mean[1];
+            float b = rgba[i * 4 + 2] - mean[2];
+            cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+            cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+        }
+
+        // power iteration seeded with the bounding box diagonal
+        float axis[3] = {
+            static_cast<float>(maxs[0] - mins[0]),
+            static_cast<float>(maxs[1] - mins[1]),
+            static_cast<float>(maxs[2] - mins[2])
+        };
+        for (int iter = 0; iter < 4; ++iter)
+        {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float len = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+            if (len <= 0.0f)
+                break;
+            axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+        }
+        float len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        if (len2 <= 0.0f)
+        {
+            for (int c = 0; c < 3; ++c)
+                e0[c] = e1[c] = clampByte(mean[c]);
+            return;
+        }
+
+        float minProj = 1e30f, maxProj = -1e30f;
+        for (int i = 0; i < 16; ++i)
+        {
+            float d = (rgba[i * 4 + 0] - mean[0]) * axis[0]
+                    + (rgba[i * 4 + 1] - mean[1]) * axis[1]
+                    + (rgba[i * 4 + 2] - mean[2]) * axis[2];
+            minProj = std::min(minProj, d);
+            maxProj = std::max(maxProj, d);
+        }
+        // inset by 1/16 of the range to reduce quantization error at the ends
+        float inset = (maxProj - minProj) / 16.0f;
+        maxProj = (maxProj - inset) / len2;
+        minProj = (minProj + inset) / len2;
+        for (int c = 0; c < 3; ++c)
+        {
+            e0[c] = clampByte(mean[c] + axis[c] * maxProj);
+            e1[c] = clampByte(mean[c] + axis[c] * minProj);
+        }
+    }
+
+    void writeLE16(uint8_t *out, uint16_t v)
+    {
+        out[0] = static_cast<uint8_t>(v & 0xFF);
+        out[1] = static_cast<uint8_t>(v >> 8);
+    }
+}
+
+void TextureCompressor::encodeBC1Block(const uint8_t *rgba, uint8_t *out)
+{
+    uint8_t mins[4], maxs[4];
+    blockBounds(rgba, mins, maxs);
+
+    int e0[3], e1[3];
+    if (mins[0] == maxs[0] && mins[1] == maxs[1] && mins[2] == maxs[2])
+    {
+        for (int c = 0; c < 3; ++c)
+            e0[c] = e1[c] = maxs[c];
+    }
+    else
+        fitColorEndpoints(rgba, mins, maxs, e0, e1);
+
+    uint16_t c0 = pack565(e0[0], e0[1], e0[2]);
+    uint16_t c1 = pack565(e1[0], e1[1], e1[2]);
+    // c0 > c1 selects the four color mode
+    if (c0 < c1)
+        std::swap(c0, c1);
+    writeLE16(out, c0);
+    writeLE16(out + 2, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        int palette[4][3];
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0, bestDist = 1 << 30;
+            for (int p = 0; p < 4; ++p)
+            {
+                int dr = rgba[i * 4 + 0] - palette[p][0];
+                int dg = rgba[i * 4 + 1] - palette[p][1];
+                int db = rgba[i * 4 + 2] - palette[p][2];
+                int dist = dr * dr + dg * dg + db * db;
+                if (dist < bestDist)
+                {
+                    bestDist = dist;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (2 * i);
+        }
+    }
+    for (int b = 0; b < 4; ++b)
+        out[4 + b] = static_cast<uint8_t>(indices >> (8 * b));
+}
+
+void TextureCompressor::encodeBC3Block(const uint8_t *rgba, uint8_t *out)
+{
+    uint8_t mins[4], maxs[4];
+    blockBounds(rgba, mins, maxs);
+
+    // a0 > a1 selects the eight alpha mode
+    int a0 = maxs[3];
+    int a1 = mins[3];
+    out[0] = static_cast<uint8_t>(a0);
+    out[1] = static_cast<uint8_t>(a1);
+
+    uint64_t indices = 0;
+    if (a0 != a1)
+    {
+        int palette[8];
+        palette[0] = a0;
+        palette[1] = a1;
+        for (int p = 2; p < 8; ++p)
+            palette[p] = ((8 - p) * a0 + (p - 1) * a1) / 7;
+        for (int i = 0; i < 16; ++i)
+        {
+            int a = rgba[i * 4 + 3];
+            int best = 0, bestDist = 1 << 30;
+            for (int p = 0; p < 8; ++p)
+            {
+                int dist = std::abs(a - palette[p]);
+                if (dist < bestDist)
+                {
+                    bestDist = dist;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint64_t>(best) << (3 * i);
+        }
+    }
+    for (int b = 0; b < 6; ++b)
+        out[2 + b] = static_cast<uint8_t>(indices >> (8 * b));
+
+    encodeBC1Block(rgba, out + 8);
+}
+
+size_t TextureCompressor::blockBytes(Format format)
+{
+    return format == Format::BC1 ? 8 : 16;
+}
+
+size_t TextureCompressor::levelSize(Format format, int width, int height)
+{
+    size_t blocksX = static_cast<size_t>(std::max(1, (width + 3) / 4));
+    size_t blocksY = static_cast<size_t>(std::max(1, (height + 3) / 4));
+    return blocksX * blocksY * blockBytes(format);
+}
+
+GLenum TextureCompressor::glFormat(Format format)
+{
+    return format == Format::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+                                 : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+TextureCompressor::Format TextureCompressor::chooseFormat(const std::vector<uint8_t> &rgba)
+{
+    for (size_t i = 3; i < rgba.size(); i += 4)
+        if (rgba[i] != 255)
+            return Format::BC3;
+    return Format::BC1;
+}
+
+void TextureCompressor::encodeLevel(const std::vector<uint8_t> &rgba, int width, int height,
+                                    Format format, std::vector<uint8_t> &out)
+{
+    int blocksX = std::max(1, (width + 3) / 4);
+    int blocksY = std::max(1, (height + 3) / 4);
+    size_t stride = blockBytes(format);
+    out.resize(levelSize(format, width, height));
+
+    // one row of blocks per work item, edge texels are clamped into partial blocks
+    Parallel::forChunks(static_cast<size_t>(blocksY), 8,
+        [&](size_t, size_t begin, size_t end) {
+            uint8_t block[64];
+            for (size_t by = begin; by < end; ++by)
+            {
+                for (int bx = 0; bx < blocksX; ++bx)
+                {
+                    for (int py = 0; py < 4; ++py)
+                    {
+                        int y = std::min(static_cast<int>(by) * 4 + py, height - 1);
+                        for (int px = 0; px < 4; ++px)
+                        {
+                            int x = std::min(bx * 4 + px, width - 1);
+                            std::memcpy(block + (py * 4 + px) * 4,
+                                        &rgba[(static_cast<size_t>(y) * width + x) * 4], 4);
+                        }
+                    }
+                    uint8_t *dst = &out[(by * blocksX + bx) * stride];
+                    if (format == Format::BC1)
+                        encodeBC1Block(block, dst);
+                    else
+                        encodeBC3Block(block, dst);
+                }
+            }
+        });
+}
+
+std::vector<uint8_t> TextureCompressor::downsample(const std::vector<uint8_t> &rgba, int width, int height,
+                                                   int &outWidth, int &outHeight)
+{
+    outWidth = std::max(1, width / 2);
+    outHeight = std::max(1, height / 2);
+    std::vector<uint8_t> out(static_cast<size_t>(outWidth) * outHeight * 4);
+    for (int y = 0; y < outHeight; ++y)
+    {
+        int y0 = std::min(y * 2, height - 1);
+        int y1 = std::min(y * 2 + 1, height - 1);
+        for (int x = 0; x < outWidth; ++x)
+        {
+            int x0 = std::min(x * 2, width - 1);
+            int x1 = std::min(x * 2 + 1, width - 1);
+            for (int c = 0; c < 4; ++c)
+            {
+                int sum = rgba[(static_cast<size_t>(y0) * width + x0) * 4 + c]
+                        + rgba[(static_cast<size_t>(y0) * width + x1) * 4 + c]
+                        + rgba[(static_cast<size_t>(y1) * width + x0) * 4 + c]
+                        + rgba[(static_cast<size_t>(y1) * width + x1) * 4 + c];
+                out[(static_cast<size_t>(y) * outWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+    return out;
+}
+
+TextureCompressor::CompressedImage TextureCompressor::compress(const std::vector<uint8_t> &rgba,
+                                                               int width, int height,
+                                                               Format format, bool generateMips)
+{
+    CompressedImage image;
+    image.format = format;
+    image.width = width;
+    image.height = height;
+
+    std::vector<uint8_t> level = rgba;
+    int w = width, h = height;
+    while (true)
+    {
+        MipLevel mip;
+        mip.width = w;
+        mip.height = h;
+        encodeLevel(level, w, h, format, mip.data);
+        image.mips.push_back(mip);
+        if (!generateMips || (w == 1 && h == 1))
+            break;
+        int nw, nh;
+        level = downsample(level, w, h, nw, nh);
+        w = nw;
+        h = nh;
+    }
+    return image;
+}
+
+bool TextureCompressor::isSupported()
+{
+    return GLCaps::hasExtension("GL_EXT_texture_compression_s3tc");
+}
+
+void TextureCompressor::upload(const CompressedImage &image, GLuint textureID)
+{
+    GLState::bindTexture(GL_TEXTURE_2D, textureID);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    image.mips.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.mips.size()) - 1);
+
+    for (size_t level = 0; level < image.mips.size(); ++level)
+    {
+        const MipLevel &mip = image.mips[level];
+        glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), glFormat(image.format),
+                               mip.width, mip.height, 0,
+                               static_cast<GLsizei>(mip.data.size()), mip.data.data());
+    }
+}
+
+void TextureCompressor::writeCache(const std::string &path, const CompressedImage &image,
+                                   const std::string &sourceFile)
+{
+    std::vector<ScopTex::Level> levels(image.mips.size());
+    for (size_t i = 0; i < image.mips.size(); ++i)
+    {
+        levels[i].width = image.mips[i].width;
+        levels[i].height = image.mips[i].height;
+        levels[i].data = image.mips[i].data.data();
+        levels[i].size = image.mips[i].data.size();
+    }
+    ScopTex::Format format = image.format == Format::BC1 ? ScopTex::Format::BC1 : ScopTex::Format::BC3;
+    ScopTex::write(path, format, image.width, image.height, levels, sourceFile);
+}
+
+void TextureCompressor::loadBMPTexture(const std::string &filename, GLuint textureID)
+{
+    if (!isSupported())
+    {
+        BMPLoader::loadBMPTexture(filename, textureID);
+        return;
+    }
+
+    std::string path = ScopTex::cachePathForHash(Hash::hashFile(filename));
+    ScopTex::Mapping mapping;
+    if (mapping.open(path) && ScopTex::upload(mapping, textureID))
+        return;
+
+    int width, height;
+    std::vector<uint8_t> rgba = BMPLoader::loadBMP(filename, width, height);
+    CompressedImage image = compress(rgba, width, height, chooseFormat(rgba));
+    writeCache(path, image, filename);
+    upload(image, textureID);
+}
@@ -0,0 +1,377 @@
+#include "Texture/TextureManager.h"
+#include "Texture/TextureCompressor.h"
+#include "Texture/TextureStreamer.h"
+#include "Core/GLState.h"
+#include "Core/Hash.h"
+#include "BPMLoader.h"
+
+#include <algorithm>
+
+namespace
+{
+    // textures are never shrunk below this size to meet the budget
+    const int MIN_DROPPED_SIZE = 16;
+    // mip levels looked at; 16 covers 32768 texels
+    const int MAX_TEXTURE_LEVELS = 16;
+    const uint32_t NO_ENTRY = 0xFFFFFFFFu;
+}
+
+TextureHandle::TextureHandle() : manager(NULL), entry(NO_ENTRY)
+{
+}
+
+TextureHandle::TextureHandle(TextureManager *manager, uint32_t entry) : manager(manager), entry(entry)
+{
+    manager->retain(entry);
+}
+
+TextureHandle::TextureHandle(const TextureHandle &other) : manager(other.manager), entry(other.entry)
+{
+    if (manager)
+        manager->retain(entry);
+}
+
+TextureHandle &TextureHandle::operator=(const TextureHandle &other)
+{
+    if (other.manager)
+        other.manager->retain(other.entry);
+    reset();
+    manager = other.manager;
+    entry = other.entry;
+    return *this;
+}
+
+TextureHandle::~TextureHandle()
+{
+    reset();
+}
+
+void TextureHandle::reset()
+{
+    if (manager)
+        manager->release(entry);
+    manager = NULL;
+    entry = NO_ENTRY;
+}
+
+bool TextureHandle::valid() const
+{
+    return manager != NULL;
+}
+
+GLuint TextureHandle::id() const
+{
+    return manager ? manager->entries[entry].id : 0;
+}
+
+void TextureHandle::bind(unsigned unit) const
+{
+    GLState::bindTexture(unit, GL_TEXTURE_2D, id());
+    if (manager)
+        manager->touch(entry);
+}
+
+TextureManager::TextureManager(size_t budgetBytes, bool compress)
+    : budgetBytes(budgetBytes), usedBytes(0), compress(compress), streamer(NULL), frame(0)
+{
+}
+
+TextureManager::~TextureManager()
+{
+    for (size_t i = 0; i < entries.size(); ++i)
+        if (entries[i].alive)
+        {
+            if (streamer)
+                streamer->cancel(entries[i].id);
+            GLState::deleteTextures(1, &entries[i].id);
+        }
+}
+
+TextureHandle TextureManager::load(const std::string &filename)
+{
+    std::unordered_map<std::string, uint32_t>::iterator path = byPath.find(filename);
+    if (path != byPath.end())
+        return TextureHandle(this, path->second);
+
+    // same pixels under another name share the texture
+    uint64_t contentHash = Hash::hashFile(filename);
+    std::unordered_map<uint64_t, uint32_t>::iterator hash = byHash.find(contentHash);
+    if (hash != byHash.end())
+    {
+        byPath[filename] = hash->second;
+        return TextureHandle(this, hash->second);
+    }
+
+    GLuint id;
+    glGenTextures(1, &id);
+    try
+    {
+        upload(filename, id);
+    }
+    catch (...)
+    {
+        GLState::deleteTextures(1, &id);
+        throw;
+    }
+
+    uint32_t index;
+    if (!freeEntries.empty())
+    {
+        index = freeEntries.back();
+        freeEntries.pop_back();
+    }
+    else
+    {
+        index = static_cast<uint32_t>(entries.size());
+        entries.push_back(Entry());
+    }
+    Entry &entry = entries[index];
+    entry.id = id;
+    entry.path = filename;
+    entry.contentHash = contentHash;
+    entry.refs = 0;
+    entry.lastUsed = frame;
+    entry.droppedLevels = 0;
+    entry.bytes = textureBytes(id);
+    entry.alive = true;
+    usedBytes += entry.bytes;
+    byPath[filename] = index;
+    byHash[contentHash] = index;
+
+    // the handle is taken before eviction so the new texture is never the victim
+    TextureHandle handle(this, index);
+    enforceBudget();
+    return handle;
+}
+
+void TextureManager::setStreamer(TextureStreamer *streamer)
+{
+    this->streamer = streamer;
+}
+
+void TextureManager::beginFrame()
+{
+    ++frame;
+    enforceBudget();
+}
+
+void TextureManager::setBudget(size_t bytes)
+{
+    budgetBytes = bytes;
+    enforceBudget();
+}
+
+size_t TextureManager::budget() const
+{
+    return budgetBytes;
+}
+
+size_t TextureManager::usage() const
+{
+    return usedBytes;
+}
+
+size_t TextureManager::textureCount() const
+{
+    return entries.size() - freeEntries.size();
+}
+
+void TextureManager::retain(uint32_t entry)
+{
+    ++entries[entry].refs;
+}
+
+void TextureManager::release(uint32_t entry)
+{
+    // unreferenced textures stay cached until the budget needs the room
+    --entries[entry].refs;
+}
+
+void TextureManager::touch(uint32_t entry)
+{
+    entries[entry].lastUsed = frame;
+}
+
+void TextureManager::enforceBudget()
+{
+    while (usedBytes > budgetBytes)
+    {
+        uint32_t unreferenced = NO_ENTRY;
+        uint32_t referenced = NO_ENTRY;
+        for (uint32_t i = 0; i < entries.size(); ++i)
+        {
+            const Entry &entry = entries[i];
+            if (!entry.alive)
+                continue;
+            uint32_t &oldest = entry.refs == 0 ? unreferenced : referenced;
+            if (oldest == NO_ENTRY || entry.lastUsed < entries[oldest].lastUsed)
+                oldest = i;
+        }
+        if (unreferenced != NO_ENTRY)
+        {
+            evict(unreferenced);
+            continue;
+        }
+        if (referenced == NO_ENTRY)
+            break;
+        // the oldest texture that can still shrink; stop when none can
+        std::vector<uint32_t> candidates;
+        for (uint32_t i = 0; i < entries.size(); ++i)
+            if (entries[i].alive)
+                candidates.push_back(i);
+        std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+            return entries[a].lastUsed < entries[b].lastUsed;
+        });
+        bool dropped = false;
+        for (size_t c = 0; c < candidates.size() && !dropped; ++c)
+            dropped = dropLevel(candidates[c]);
+        if (!dropped)
+            break;
+    }
+}
+
+void TextureManager::evict(uint32_t index)
+{
+    Entry &entry = entries[index];
+    if (streamer)
+        streamer->cancel(entry.id);
+    GLState::deleteTextures(1, &entry.id);
+    usedBytes -= entry.bytes;
+    byHash.erase(entry.contentHash);
+    for (std::unordered_map<std::string, uint32_t>::iterator it = byPath.begin(); it != byPath.end();)
+    {
+        if (it->second == index)
+            it = byPath.erase(it);
+        else
+            ++it;
+    }
+    entry.alive = false;
+    entry.path.clear();
+    freeEntries.push_back(index);
+}
+
+bool TextureManager::dropLevel(uint32_t index)
+{
+    Entry &entry = entries[index];
+    // its mips do not exist until every row has arrived
+    if (streamer && streamer->pending(entry.id))
+        return false;
+    GLState::bindTexture(GL_TEXTURE_2D, entry.id);
+    GLint width = 0, height = 0, format = 0, compressed = GL_FALSE, maxLevel = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+    if (width <= MIN_DROPPED_SIZE || height <= MIN_DROPPED_SIZE)
+        return false;
+    int levels = 1;
+    while (levels <= maxLevel && levels < MAX_TEXTURE_LEVELS)
+    {
+        GLint w = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, levels, GL_TEXTURE_WIDTH, &w);
+        if (w == 0)
+            break;
+        ++levels;
+    }
+
+    // the GPU's own mips move up a level: nothing is read from disk or
+    // encoded again. A texture without mips gets just level 1 from the
+    // driver; compressed ones always come with their chain
+    int keep = levels - 1;
+    if (levels == 1)
+    {
+        if (compressed)
+            return false;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        keep = 1;
+    }
+
+    // read back before anything is respecified; this waits for the GPU,
+    // but only on data a quarter of the texture's size
+    std::vector<std::vector<uint8_t> > data(keep);
+    std::vector<GLint> widths(keep), heights(keep);
+    for (int level = 0; level < keep; ++level)
+    {
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level + 1, GL_TEXTURE_WIDTH, &widths[level]);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level + 1, GL_TEXTURE_HEIGHT, &heights[level]);
+        if (compressed)
+        {
+            GLint size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level + 1, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            data[level].resize(static_cast<size_t>(size));
+            glGetCompressedTexImage(GL_TEXTURE_2D, level + 1, data[level].data());
+        }
+        else
+        {
+            data[level].resize(static_cast<size_t>(widths[level]) * heights[level] * 4);
+            glGetTexImage(GL_TEXTURE_2D, level + 1, GL_RGBA, GL_UNSIGNED_BYTE, data[level].data());
+        }
+    }
+
+    // same texture name, so outstanding handles stay valid; its filtering
+    // and the rest of its chain are kept
+    for (int level = 0; level < keep; ++level)
+    {
+        if (compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, format, widths[level], heights[level], 0,
+                                   static_cast<GLsizei>(data[level].size()), data[level].data());
+        else
+            glTexImage2D(GL_TEXTURE_2D, level, format, widths[level], heights[level], 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, data[level].data());
+    }
+    // the levels past the new chain are freed
+    for (GLint level = keep; level < MAX_TEXTURE_LEVELS; ++level)
+    {
+        GLint w = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &w);
+        if (w == 0)
+            break;
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, keep - 1);
+
+    ++entry.droppedLevels;
+    usedBytes -= entry.bytes;
+    entry.bytes = textureBytes(entry.id);
+    usedBytes += entry.bytes;
+    return true;
+}
+
+void TextureManager::upload(const std::string &filename, GLuint textureID)
+{
+    if (compress)
+        TextureCompressor::loadBMPTexture(filename, textureID);
+    else if (streamer)
+        streamer->queueBMP(filename, textureID);
+    else
+        BMPLoader::loadBMPTexture(filename, textureID);
+}
+
+size_t TextureManager::textureBytes(GLuint textureID)
+{
+    GLState::bindTexture(GL_TEXTURE_2D, textureID);
+    GLint maxLevel = 0;
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+
+    size_t bytes = 0;
+    for (GLint level = 0; level <= maxLevel && level < MAX_TEXTURE_LEVELS; ++level)
+    {
+        GLint width = 0, height = 0, compressed = GL_FALSE;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+        if (width == 0 || height == 0)
+            break;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed)
+        {
+            GLint size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            bytes += static_cast<size_t>(size);
+        }
+        else
+            bytes += static_cast<size_t>(width) * static_cast<size_t>(height) * 4;
+    }
+    return bytes;
+}
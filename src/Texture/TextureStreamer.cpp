@@ -0,0 +1,241 @@
+#include "Texture/TextureStreamer.h"
+#include "Core/GLCaps.h"
+#include "Core/GLState.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+    double elapsedMs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+TextureStreamer::TextureStreamer(size_t slotSize, unsigned slotCount)
+    : slotSize(slotSize), persistent(false), nextSlot(0), averageTileMs(0.0), frameBytes(0)
+{
+    persistent = (GLAD_GL_VERSION_4_4 || GLCaps::hasExtension("GL_ARB_buffer_storage")) && glBufferStorage != NULL;
+    const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    slots.resize(slotCount);
+    for (unsigned i = 0; i < slotCount; ++i)
+    {
+        Slot &slot = slots[i];
+        slot.mapped = NULL;
+        slot.fence = 0;
+        glGenBuffers(1, &slot.pbo);
+        GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+        if (persistent)
+        {
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slotSize, NULL, mapFlags);
+            slot.mapped = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotSize, mapFlags));
+        }
+        else
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, slotSize, NULL, GL_STREAM_DRAW);
+    }
+    GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    for (size_t i = 0; i < jobs.size(); ++i)
+        delete jobs[i];
+    for (size_t i = 0; i < slots.size(); ++i)
+    {
+        if (slots[i].fence)
+            glDeleteSync(slots[i].fence);
+        if (slots[i].mapped)
+        {
+            GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, slots[i].pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        GLState::deleteBuffers(1, &slots[i].pbo);
+    }
+    GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::queueBMP(const std::string &filename, GLuint textureID)
+{
+    Job *job = new Job();
+    job->filename = filename;
+    job->texture = textureID;
+    job->nextRow = 0;
+    job->file.open(filename, std::ios::binary);
+    try
+    {
+        if (!job->file)
+            throw std::runtime_error("Could not open BMP file: " + filename);
+        job->info = BMPLoader::readBMPInfo(job->file, filename);
+        if (static_cast<size_t>(job->info.width) * 4 > slotSize)
+            throw std::runtime_error("BMP row does not fit a streaming slot: " + filename);
+    }
+    catch (...)
+    {
+        delete job;
+        throw;
+    }
+
+    GLState::bindTexture(GL_TEXTURE_2D, textureID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, job->info.width, job->info.height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    jobs.push_back(job);
+}
+
+bool TextureStreamer::acquireSlot(Slot &slot)
+{
+    if (!slot.fence)
+        return true;
+    // never block the frame, a busy slot means the ring is saturated
+    GLenum status = glClientWaitSync(slot.fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+        return false;
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+    return true;
+}
+
+bool TextureStreamer::uploadTile(Job &job, Slot &slot, int rows)
+{
+    const BMPLoader::BMPInfo &info = job.info;
+    size_t rowBytes = static_cast<size_t>(info.width) * 4;
+    size_t tileBytes = rowBytes * rows;
+
+    GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+    uint8_t *dst = slot.mapped;
+    if (!dst)
+    {
+        // the fence already guarantees the GPU is done with this slot
+        dst = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, tileBytes,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+        if (!dst)
+        {
+            std::cerr << "ERROR::TEXTURE::STREAM_BUFFER_NOT_MAPPED " << job.filename << std::endl;
+            return false;
+        }
+    }
+    bool read = true;
+    try
+    {
+        BMPLoader::readBMPRegion(job.file, info, 0, job.nextRow, info.width, rows, dst, rowBytes);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "ERROR::TEXTURE::STREAM_FAILED " << e.what() << std::endl;
+        read = false;
+    }
+    if (!slot.mapped)
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    if (!read)
+        return false;
+
+    GLState::bindTexture(GL_TEXTURE_2D, job.texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, job.nextRow, info.width, rows,
+                    GL_RGBA, GL_UNSIGNED_BYTE, static_cast<const void*>(0));
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    job.nextRow += rows;
+    frameBytes += tileBytes;
+    return true;
+}
+
+void TextureStreamer::update(double budgetMs)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    frameBytes = 0;
+
+    while (!jobs.empty())
+    {
+        // stop before a tile that would likely overrun the budget
+        if (elapsedMs(start) + averageTileMs > budgetMs)
+            break;
+        Slot &slot = slots[nextSlot];
+        if (!acquireSlot(slot))
+            break;
+
+        Job &job = *jobs.front();
+        size_t rowBytes = static_cast<size_t>(job.info.width) * 4;
+        int rows = std::min(job.info.height - job.nextRow, static_cast<int>(slotSize / rowBytes));
+
+        std::chrono::steady_clock::time_point tileStart = std::chrono::steady_clock::now();
+        if (!uploadTile(job, slot, rows))
+        {
+            // the rows already uploaded stay, the rest of the texture is
+            // given up instead of failing again every frame
+            failedTextures.push_back(job.texture);
+            delete jobs.front();
+            jobs.pop_front();
+            continue;
+        }
+        double tileMs = elapsedMs(tileStart);
+        averageTileMs = averageTileMs == 0.0 ? tileMs : averageTileMs * 0.9 + tileMs * 0.1;
+        nextSlot = (nextSlot + 1) % slots.size();
+
+        if (job.nextRow >= job.info.height)
+        {
+            delete jobs.front();
+            jobs.pop_front();
+        }
+    }
+    // a bound unpack buffer would turn later client-memory uploads into offsets
+    GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+bool TextureStreamer::idle() const
+{
+    return jobs.empty();
+}
+
+bool TextureStreamer::pending(GLuint textureID) const
+{
+    for (size_t i = 0; i < jobs.size(); ++i)
+        if (jobs[i]->texture == textureID)
+            return true;
+    return false;
+}
+
+bool TextureStreamer::failed(GLuint textureID) const
+{
+    return std::find(failedTextures.begin(), failedTextures.end(), textureID) != failedTextures.end();
+}
+
+void TextureStreamer::cancel(GLuint textureID)
+{
+    failedTextures.erase(std::remove(failedTextures.begin(), failedTextures.end(), textureID),
+                         failedTextures.end());
+    for (std::deque<Job*>::iterator it = jobs.begin(); it != jobs.end();)
+    {
+        if ((*it)->texture == textureID)
+        {
+            delete *it;
+            it = jobs.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+bool TextureStreamer::isPersistent() const
+{
+    return persistent;
+}
+
+size_t TextureStreamer::pendingBytes() const
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < jobs.size(); ++i)
+        bytes += static_cast<size_t>(jobs[i]->info.width) * 4 * (jobs[i]->info.height - jobs[i]->nextRow);
+    return bytes;
+}
+
+size_t TextureStreamer::lastFrameBytes() const
+{
+    return frameBytes;
+}
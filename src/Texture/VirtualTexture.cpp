@@ -0,0 +1,487 @@
+#include "Texture/VirtualTexture.h"
+#include "Core/GLState.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+namespace
+{
+    // pages requested per frame are capped so the queue follows the camera
+    const size_t MAX_REQUESTS_PER_FRAME = 256;
+
+    constexpr UniformName VT_INDIRECTION("vtIndirection");
+    constexpr UniformName VT_PHYSICAL("vtPhysical");
+    constexpr UniformName VT_VIRTUAL_SIZE("vtVirtualSize");
+    constexpr UniformName VT_MAX_LEVEL("vtMaxLevel");
+    constexpr UniformName VT_LEVEL_PAGES("vtLevelPages");
+    constexpr UniformName VT_LEVEL_ROW("vtLevelRow");
+    constexpr UniformName VT_FEEDBACK_BIAS("vtFeedbackBias");
+
+    int divideUp(int value, int divisor)
+    {
+        return (value + divisor - 1) / divisor;
+    }
+
+    int clampInt(int value, int low, int high)
+    {
+        return value < low ? low : (value > high ? high : value);
+    }
+}
+
+VirtualTexture::VirtualTexture(const std::string &filename, int physicalPagesX, int physicalPagesY,
+                               int feedbackDivisor)
+    : filename(filename), levels(0), totalPages(0), pinnedPage(0),
+      physicalPagesX(physicalPagesX), physicalPagesY(physicalPagesY), feedbackDivisor(feedbackDivisor),
+      indirectionDirty(true), frame(1),
+      feedbackFbo(0), feedbackColor(0), feedbackDepth(0), readbackIndex(0),
+      feedbackWidth(0), feedbackHeight(0), stopWorker(false)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+        throw std::runtime_error("Could not open BMP file: " + filename);
+    info = BMPLoader::readBMPInfo(file, filename);
+
+    // mip levels down to the one that fits in a single page
+    int row = 0;
+    for (int level = 0; level < MAX_LEVELS; ++level)
+    {
+        levelPagesX[level] = std::max(1, divideUp(info.width, PAGE_SIZE << level));
+        levelPagesY[level] = std::max(1, divideUp(info.height, PAGE_SIZE << level));
+        levelBase[level] = totalPages;
+        levelRow[level] = row;
+        totalPages += static_cast<uint32_t>(levelPagesX[level] * levelPagesY[level]);
+        row += levelPagesY[level];
+        levels = level + 1;
+        if (levelPagesX[level] == 1 && levelPagesY[level] == 1)
+            break;
+    }
+    for (int level = levels; level < MAX_LEVELS; ++level)
+    {
+        levelPagesX[level] = levelPagesY[level] = 1;
+        levelBase[level] = totalPages;
+        levelRow[level] = row;
+    }
+
+    int slotCount = physicalPagesX * physicalPagesY;
+    pageState.assign(totalPages, PAGE_ABSENT);
+    pageSlot.assign(totalPages, -1);
+    pageLastSeen.assign(totalPages, 0);
+    slotPage.assign(slotCount, -1);
+    slotLastUsed.assign(slotCount, 0);
+    indirection.assign(static_cast<size_t>(levelPagesX[0]) * row * 4, 0);
+
+    glGenTextures(1, &physicalTexture);
+    GLState::bindTexture(GL_TEXTURE_2D, physicalTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, physicalPagesX * SLOT_SIZE, physicalPagesY * SLOT_SIZE, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    glGenTextures(1, &indirectionTexture);
+    GLState::bindTexture(GL_TEXTURE_2D, indirectionTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, levelPagesX[0], row, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, indirection.data());
+
+    glGenBuffers(2, readbackPbo);
+    readbackPending[0] = readbackPending[1] = false;
+
+    // the single page of the coarsest level is always resident
+    pinnedPage = pageId(levels - 1, 0, 0);
+    std::vector<uint32_t> pinned(1, pinnedPage);
+    requestPages(pinned);
+
+    worker = std::thread(&VirtualTexture::workerLoop, this);
+}
+
+VirtualTexture::~VirtualTexture()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopWorker = true;
+    }
+    wakeWorker.notify_all();
+    worker.join();
+
+    GLState::deleteTextures(1, &physicalTexture);
+    GLState::deleteTextures(1, &indirectionTexture);
+    GLState::deleteBuffers(2, readbackPbo);
+    if (feedbackFbo)
+    {
+        glDeleteFramebuffers(1, &feedbackFbo);
+        GLState::deleteTextures(1, &feedbackColor);
+        glDeleteRenderbuffers(1, &feedbackDepth);
+    }
+}
+
+uint32_t VirtualTexture::pageId(int level, int x, int y) const
+{
+    return levelBase[level] + static_cast<uint32_t>(y * levelPagesX[level] + x);
+}
+
+void VirtualTexture::pageCoords(uint32_t id, int &level, int &x, int &y) const
+{
+    level = 0;
+    while (level + 1 < levels && id >= levelBase[level + 1])
+        ++level;
+    int local = static_cast<int>(id - levelBase[level]);
+    x = local % levelPagesX[level];
+    y = local / levelPagesX[level];
+}
+
+void VirtualTexture::beginFeedback(int screenWidth, int screenHeight)
+{
+    int fbWidth = std::max(1, screenWidth / feedbackDivisor);
+    int fbHeight = std::max(1, screenHeight / feedbackDivisor);
+    if (fbWidth != feedbackWidth || fbHeight != feedbackHeight)
+    {
+        if (!feedbackFbo)
+        {
+            glGenFramebuffers(1, &feedbackFbo);
+            glGenTextures(1, &feedbackColor);
+            glGenRenderbuffers(1, &feedbackDepth);
+        }
+        feedbackWidth = fbWidth;
+        feedbackHeight = fbHeight;
+        GLState::bindTexture(GL_TEXTURE_2D, feedbackColor);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, fbWidth, fbHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, fbWidth, fbHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackColor, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+
+        size_t bytes = static_cast<size_t>(fbWidth) * fbHeight * 4;
+        for (int i = 0; i < 2; ++i)
+        {
+            GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, readbackPbo[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+            readbackPending[i] = false;
+        }
+        GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFbo);
+    glViewport(0, 0, feedbackWidth, feedbackHeight);
+    // alpha 0 marks texels that request no page
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void VirtualTexture::endFeedback()
+{
+    size_t count = static_cast<size_t>(feedbackWidth) * feedbackHeight;
+
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, readbackPbo[readbackIndex]);
+    glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, static_cast<void*>(0));
+    readbackPending[readbackIndex] = true;
+
+    // the other buffer holds last frame's feedback, which is complete by now
+    int previous = 1 - readbackIndex;
+    if (readbackPending[previous])
+    {
+        GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, readbackPbo[previous]);
+        const uint8_t *pixels = static_cast<const uint8_t*>(
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count * 4, GL_MAP_READ_BIT));
+        if (pixels)
+        {
+            processFeedback(pixels, count);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        readbackPending[previous] = false;
+    }
+    readbackIndex = previous;
+    GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    ++frame;
+}
+
+void VirtualTexture::processFeedback(const uint8_t *pixels, size_t count)
+{
+    std::vector<uint32_t> missing;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint8_t *p = pixels + i * 4;
+        if (p[3] == 0)
+            continue;
+        int level = p[3] - 1;
+        int x = p[0] | ((p[2] & 0x0F) << 8);
+        int y = p[1] | ((p[2] >> 4) << 8);
+        if (level >= levels || x >= levelPagesX[level] || y >= levelPagesY[level])
+            continue;
+        uint32_t id = pageId(level, x, y);
+        if (pageLastSeen[id] == frame)
+            continue;
+        pageLastSeen[id] = frame;
+        if (pageState[id] == PAGE_RESIDENT)
+            slotLastUsed[pageSlot[id]] = frame;
+        else
+            missing.push_back(id);
+    }
+    requestPages(missing);
+}
+
+void VirtualTexture::requestPages(const std::vector<uint32_t> &pages)
+{
+    // coarse pages first: they give the quickest usable fallback
+    std::vector<uint32_t> ordered(pages);
+    std::sort(ordered.begin(), ordered.end(), std::greater<uint32_t>());
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // requests not started yet are replaced by this frame's
+        for (size_t i = 0; i < requests.size(); ++i)
+            if (requests[i] != pinnedPage)
+                pageState[requests[i]] = PAGE_ABSENT;
+        std::deque<uint32_t> kept;
+        for (size_t i = 0; i < requests.size(); ++i)
+            if (requests[i] == pinnedPage)
+                kept.push_back(requests[i]);
+        requests.swap(kept);
+
+        for (size_t i = 0; i < ordered.size() && requests.size() < MAX_REQUESTS_PER_FRAME; ++i)
+        {
+            if (pageState[ordered[i]] != PAGE_ABSENT)
+                continue;
+            pageState[ordered[i]] = PAGE_QUEUED;
+            requests.push_back(ordered[i]);
+        }
+    }
+    wakeWorker.notify_one();
+}
+
+int VirtualTexture::allocateSlot()
+{
+    int victim = -1;
+    for (size_t slot = 0; slot < slotPage.size(); ++slot)
+    {
+        if (slotPage[slot] < 0)
+            return static_cast<int>(slot);
+        if (static_cast<uint32_t>(slotPage[slot]) == pinnedPage)
+            continue;
+        // pages seen in the last two frames are still on screen
+        if (slotLastUsed[slot] + 1 >= frame)
+            continue;
+        if (victim < 0 || slotLastUsed[slot] < slotLastUsed[victim])
+            victim = static_cast<int>(slot);
+    }
+    if (victim >= 0)
+    {
+        uint32_t evicted = static_cast<uint32_t>(slotPage[victim]);
+        pageState[evicted] = PAGE_ABSENT;
+        pageSlot[evicted] = -1;
+        slotPage[victim] = -1;
+        indirectionDirty = true;
+    }
+    return victim;
+}
+
+void VirtualTexture::update(int maxUploads)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < completed.size(); ++i)
+        {
+            uploadQueue.push_back(LoadedPage());
+            uploadQueue.back().id = completed[i].id;
+            uploadQueue.back().texels.swap(completed[i].texels);
+        }
+        completed.clear();
+    }
+
+    for (int uploads = 0; uploads < maxUploads && !uploadQueue.empty(); ++uploads)
+    {
+        LoadedPage &page = uploadQueue.front();
+        int slot = allocateSlot();
+        if (slot < 0)
+        {
+            // cache full of visible pages, the page will be requested again
+            pageState[page.id] = PAGE_ABSENT;
+            uploadQueue.pop_front();
+            continue;
+        }
+        GLState::bindTexture(GL_TEXTURE_2D, physicalTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % physicalPagesX) * SLOT_SIZE, (slot / physicalPagesX) * SLOT_SIZE,
+                        SLOT_SIZE, SLOT_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, page.texels.data());
+        pageState[page.id] = PAGE_RESIDENT;
+        pageSlot[page.id] = slot;
+        slotPage[slot] = static_cast<int>(page.id);
+        slotLastUsed[slot] = frame;
+        indirectionDirty = true;
+        uploadQueue.pop_front();
+    }
+
+    if (indirectionDirty)
+        rebuildIndirection();
+}
+
+void VirtualTexture::rebuildIndirection()
+{
+    int rowWidth = levelPagesX[0];
+    // coarse to fine, a missing page inherits its parent's entry
+    for (int level = levels - 1; level >= 0; --level)
+    {
+        for (int y = 0; y < levelPagesY[level]; ++y)
+        {
+            for (int x = 0; x < levelPagesX[level]; ++x)
+            {
+                uint8_t *entry = &indirection[(static_cast<size_t>(levelRow[level] + y) * rowWidth + x) * 4];
+                uint32_t id = pageId(level, x, y);
+                if (pageState[id] == PAGE_RESIDENT)
+                {
+                    int slot = pageSlot[id];
+                    entry[0] = static_cast<uint8_t>(slot % physicalPagesX);
+                    entry[1] = static_cast<uint8_t>(slot / physicalPagesX);
+                    entry[2] = static_cast<uint8_t>(level);
+                    entry[3] = 255;
+                }
+                else if (level + 1 < levels)
+                {
+                    const uint8_t *parent = &indirection[(static_cast<size_t>(levelRow[level + 1] + y / 2)
+                                                          * rowWidth + x / 2) * 4];
+                    std::memcpy(entry, parent, 4);
+                }
+                else
+                    std::memset(entry, 0, 4);
+            }
+        }
+    }
+    GLState::bindTexture(GL_TEXTURE_2D, indirectionTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, rowWidth, static_cast<GLsizei>(indirection.size() / 4 / rowWidth),
+                    GL_RGBA, GL_UNSIGNED_BYTE, indirection.data());
+    indirectionDirty = false;
+}
+
+void VirtualTexture::decodePage(std::ifstream &file, uint32_t id, std::vector<uint8_t> &texels) const
+{
+    int level, pageX, pageY;
+    pageCoords(id, level, pageX, pageY);
+    int scale = 1 << level;
+    texels.resize(static_cast<size_t>(SLOT_SIZE) * SLOT_SIZE * 4);
+
+    // texel coordinates at this level of the slot's first row/column (border included)
+    int firstX = pageX * PAGE_SIZE - PAGE_BORDER;
+    int firstY = pageY * PAGE_SIZE - PAGE_BORDER;
+    int srcX0 = clampInt(firstX * scale, 0, info.width - 1);
+    int srcX1 = clampInt((firstX + SLOT_SIZE - 1) * scale, 0, info.width - 1);
+    int span = srcX1 - srcX0 + 1;
+    std::vector<uint8_t> row(static_cast<size_t>(span) * 4);
+
+    // coarser levels are point sampled, so only every scale-th row is read
+    for (int r = 0; r < SLOT_SIZE; ++r)
+    {
+        int srcY = clampInt((firstY + r) * scale, 0, info.height - 1);
+        BMPLoader::readBMPRegion(file, info, srcX0, srcY, span, 1, row.data(), row.size());
+        uint8_t *dst = &texels[static_cast<size_t>(r) * SLOT_SIZE * 4];
+        for (int c = 0; c < SLOT_SIZE; ++c)
+        {
+            int srcX = clampInt((firstX + c) * scale, 0, info.width - 1);
+            std::memcpy(dst + c * 4, &row[static_cast<size_t>(srcX - srcX0) * 4], 4);
+        }
+    }
+}
+
+void VirtualTexture::workerLoop()
+{
+    std::ifstream file(filename, std::ios::binary);
+    while (true)
+    {
+        uint32_t id;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeWorker.wait(lock, [this]() { return stopWorker || !requests.empty(); });
+            if (stopWorker)
+                return;
+            id = requests.front();
+            requests.pop_front();
+        }
+
+        LoadedPage page;
+        page.id = id;
+        try
+        {
+            decodePage(file, id, page.texels);
+        }
+        catch (const std::exception &)
+        {
+            // a failed read leaves the page absent, the stream is reset for the next one
+            file.clear();
+            page.texels.clear();
+        }
+        if (page.texels.empty())
+            continue;
+        std::lock_guard<std::mutex> lock(mutex);
+        completed.push_back(LoadedPage());
+        completed.back().id = page.id;
+        completed.back().texels.swap(page.texels);
+    }
+}
+
+void VirtualTexture::setUniforms(const Shader &shader, int indirectionUnit, int physicalUnit) const
+{
+    GLint pages[MAX_LEVELS * 2];
+    for (int level = 0; level < MAX_LEVELS; ++level)
+    {
+        pages[level * 2 + 0] = levelPagesX[level];
+        pages[level * 2 + 1] = levelPagesY[level];
+    }
+    shader.setInt(shader.uniform(VT_INDIRECTION), indirectionUnit);
+    shader.setInt(shader.uniform(VT_PHYSICAL), physicalUnit);
+    shader.setVec2(shader.uniform(VT_VIRTUAL_SIZE), static_cast<float>(info.width), static_cast<float>(info.height));
+    shader.setInt(shader.uniform(VT_MAX_LEVEL), levels - 1);
+    shader.setIVec2Array(shader.uniform(VT_LEVEL_PAGES), pages, MAX_LEVELS);
+    shader.setIntArray(shader.uniform(VT_LEVEL_ROW), levelRow, MAX_LEVELS);
+    // derivatives in the feedback pass are feedbackDivisor times too large
+    shader.setFloat(shader.uniform(VT_FEEDBACK_BIAS), -std::log2(static_cast<float>(feedbackDivisor)));
+}
+
+void VirtualTexture::bindTextures(int indirectionUnit, int physicalUnit) const
+{
+    GLState::bindTexture(indirectionUnit, GL_TEXTURE_2D, indirectionTexture);
+    GLState::bindTexture(physicalUnit, GL_TEXTURE_2D, physicalTexture);
+}
+
+int VirtualTexture::width() const
+{
+    return info.width;
+}
+
+int VirtualTexture::height() const
+{
+    return info.height;
+}
+
+int VirtualTexture::levelCount() const
+{
+    return levels;
+}
+
+size_t VirtualTexture::residentPages() const
+{
+    size_t count = 0;
+    for (size_t slot = 0; slot < slotPage.size(); ++slot)
+        if (slotPage[slot] >= 0)
+            ++count;
+    return count;
+}
+
+size_t VirtualTexture::pendingPages() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return requests.size() + completed.size() + uploadQueue.size();
+}
@@ -1,9 +1,42 @@
 #include "glad.h"
 #include "glfw3.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
 
+#include "Core/GLState.h"
+#include "Core/Parallel.h"
+#include "Core/StreamBuffer.h"
+#include "BPMLoader.h"
+#include "OBJLoader.h"
 #include "Shader/Shader.h"
+#include "Shader/ShaderPermutations.h"
+#include "Shader/ShaderWatcher.h"
+#include "Shader/UniformBlocks.h"
+#include "Shader/UniformBuffer.h"
+#include "Render/BVH.h"
+#include "Render/FrustumCuller.h"
+#include "Render/GpuCuller.h"
+#include "Render/InstanceBuffer.h"
+#include "Render/Mesh.h"
+#include "Render/Meshlets.h"
+#include "Render/MeshPool.h"
+#include "Render/MeshSimplifier.h"
+#include "Render/MultiDrawBatch.h"
+#include "Render/OcclusionCuller.h"
+#include "Render/RenderQueue.h"
+#include "Render/VertexArrayCache.h"
+#include "Render/VertexFormat.h"
+#include "Texture/TextureAtlas.h"
+#include "Texture/TextureManager.h"
+#include "Texture/TextureStreamer.h"
+#include "Texture/VirtualTexture.h"
 
 #define SCREEN_WIDTH 1280
 #define SCREEN_HEIGHT 720
@@ -19,38 +52,264 @@ void processInput(GLFWwindow *window)
         glfwSetWindowShouldClose(window, true);
 }
 
-int main(void)
+struct Options {
+    int instances;      // 0: the colored triangle
+    bool scatter;       // random placement instead of a grid
+    bool multidraw;     // mixed models through MeshPool / MultiDrawBatch
+    bool occlusion;     // software occlusion culling after the frustum test
+    bool gpuCull;       // --multidraw scene culled and compacted by a compute pass
+    bool meshlets;      // --multidraw objects drawn as their visible meshlets
+    bool lod;           // --multidraw objects drawn at the level of detail their distance allows
+    bool compress;      // textures uploaded as BC1/BC3 through TextureCompressor, cached on disk
+    const char *virtualTexture; // BMP paged in through a VirtualTexture, drawn on a ground plane
+    const char *model;
+};
+
+// models of the --multidraw scene, all in one MeshPool
+static const char *MULTIDRAW_MODELS[] = {
+    "res/obj/teapot.obj", "res/obj/teapot2.obj", "res/obj/42.obj"
+};
+static const int MULTIDRAW_MODEL_COUNT = 3;
+static const int MULTIDRAW_MATERIALS = 2;
+// texture of the scene, loaded through the TextureManager
+static const char *WALL_TEXTURE = "res/textures/wall.bmp";
+// texture unit of MultiDrawBatch's per-draw data
+static const unsigned DRAW_DATA_UNIT = 0;
+// texture unit of TEXTURED draws' texture1
+static const unsigned TEXTURE_UNIT = 1;
+// texture unit of the --multidraw materials' texture array
+static const unsigned MATERIAL_TEXTURE_UNIT = 2;
+// --virtual-texture: units of the indirection and physical page textures,
+// and the half size of the ground plane the texture covers once
+static const int VT_INDIRECTION_UNIT = 3;
+static const int VT_PHYSICAL_UNIT = 4;
+static const float VT_PLANE_SIZE = 16.0f;
+// StreamBuffer room for the uniform blocks and alignment padding
+static const size_t STREAM_BASE_BYTES = 64 * 1024;
+// --occlusion: the nearest visible objects are rasterized as occluders
+static const size_t MAX_OCCLUDERS = 32;
+// --meshlets: index ranges an object may draw as; more are drawn whole
+static const size_t MAX_MESHLET_RANGES = 24;
+// --lod: a level is drawn while its error covers at most this many pixels,
+// and only taken from a finer level once it is this much under
+static const float LOD_PIXEL_ERROR = 1.0f;
+static const float LOD_HYSTERESIS = 0.25f;
+
+static bool parseOptions(int argc, char **argv, Options &options)
 {
-    GLFWwindow* window;
+    options.instances = 0;
+    options.scatter = false;
+    options.multidraw = false;
+    options.occlusion = false;
+    options.gpuCull = false;
+    options.meshlets = false;
+    options.lod = false;
+    options.compress = false;
+    options.virtualTexture = NULL;
+    options.model = "res/obj/teapot.obj";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+            options.instances = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--scatter") == 0)
+            options.scatter = true;
+        else if (std::strcmp(argv[i], "--multidraw") == 0)
+            options.multidraw = true;
+        else if (std::strcmp(argv[i], "--occlusion") == 0)
+            options.occlusion = true;
+        else if (std::strcmp(argv[i], "--gpu-cull") == 0)
+            options.multidraw = options.gpuCull = true;
+        else if (std::strcmp(argv[i], "--meshlets") == 0)
+            options.multidraw = options.meshlets = true;
+        else if (std::strcmp(argv[i], "--lod") == 0)
+            options.multidraw = options.lod = true;
+        else if (std::strcmp(argv[i], "--compress") == 0)
+            options.compress = true;
+        else if (std::strcmp(argv[i], "--virtual-texture") == 0 && i + 1 < argc)
+            options.virtualTexture = argv[++i];
+        else if (std::strcmp(argv[i], "--model") == 0 && i + 1 < argc)
+            options.model = argv[++i];
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--instances N] [--scatter] [--multidraw] [--occlusion] [--gpu-cull] [--meshlets] [--lod] [--compress] [--virtual-texture file.bmp] [--model file.obj]" << std::endl;
+            return false;
+        }
+    }
+    if (options.instances < 0)
+        options.instances = 0;
+    return true;
+}
 
-    /* Initialize the library */
-    if (!glfwInit())
-        return -1;
+// Objects spinning in place, spaced for the largest model
+struct InstanceField {
+    std::vector<Vec3> positions;
+    std::vector<float> phases;
+    std::vector<Vec4> colors;
+    float extent;       // side of the square they cover
+};
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+static InstanceField layoutInstances(int count, bool scatter, const Vec3 &size)
+{
+    InstanceField field;
+    float spacing = std::max(size.x, size.z) * 1.3f;
+    int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count))));
+    field.extent = side * spacing;
+    std::srand(42);
+    for (int i = 0; i < count; ++i)
+    {
+        Vec3 position;
+        if (scatter)
+            position = Vec3((std::rand() / (float)RAND_MAX - 0.5f) * field.extent,
+                            (std::rand() / (float)RAND_MAX - 0.5f) * field.extent * 0.25f,
+                            (std::rand() / (float)RAND_MAX - 0.5f) * field.extent);
+        else
+            position = Vec3((i % side - side * 0.5f + 0.5f) * spacing, 0.0f,
+                            (i / side - side * 0.5f + 0.5f) * spacing);
+        field.positions.push_back(position);
+        field.phases.push_back(std::rand() / (float)RAND_MAX * 6.2831853f);
+        field.colors.push_back(Vec4(0.4f + 0.6f * (std::rand() / (float)RAND_MAX),
+                                    0.4f + 0.6f * (std::rand() / (float)RAND_MAX),
+                                    0.4f + 0.6f * (std::rand() / (float)RAND_MAX), 1.0f));
+    }
+    return field;
+}
 
-    /* Create a windowed mode window and its OpenGL context */
-    window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Hello World", NULL, NULL);
-    if (!window)
+static const float CAMERA_FOVY = 1.0471976f;
+static const Vec4 PICKED_COLOR(1.0f, 0.2f, 0.2f, 1.0f);
+
+// ray from the eye through the cursor, for a lookAt camera towards target
+static Ray cursorRay(GLFWwindow *window, const Vec3 &eye, const Vec3 &target)
+{
+    double x, y;
+    int width, height;
+    glfwGetCursorPos(window, &x, &y);
+    glfwGetWindowSize(window, &width, &height);
+    float ndcX = width > 0 ? static_cast<float>(2.0 * x / width - 1.0) : 0.0f;
+    float ndcY = height > 0 ? static_cast<float>(1.0 - 2.0 * y / height) : 0.0f;
+    float aspect = height > 0 ? (float)width / height : 1.0f;
+    float halfHeight = std::tan(CAMERA_FOVY * 0.5f);
+
+    Vec3 forward = (target - eye).normalized();
+    Vec3 side = Vec3::cross(forward, Vec3(0.0f, 1.0f, 0.0f)).normalized();
+    Vec3 up = Vec3::cross(side, forward);
+    Ray ray;
+    ray.origin = eye;
+    ray.direction = forward + side * (ndcX * halfHeight * aspect) + up * (ndcY * halfHeight);
+    return ray;
+}
+
+// object under the ray: the scene BVH over object bounds narrows it down,
+// then the ray is moved into each candidate's model space and tested
+// against that model's triangles. -1 when nothing is hit.
+static int pickObject(const Ray &ray, const BVH &scene, const InstanceField &field, float time,
+                      const std::vector<MeshBVH> &models, const std::vector<Vec3> &centers)
+{
+    float t;
+    uint32_t object;
+    bool hit = scene.raycast(ray, t, object, [&](uint32_t n, const Ray &world, float) {
+        size_t m = n % models.size();
+        // inverse of translate(position) * rotateY(angle) * translate(-center)
+        Mat4 rotation = Mat4::rotateY(-(time + field.phases[n]));
+        Ray local;
+        local.origin = centers[m] + rotation.transformPoint(world.origin - field.positions[n]);
+        local.direction = rotation.transformPoint(world.direction);
+        float distance;
+        uint32_t triangle;
+        return models[m].raycast(local, distance, triangle) ? distance : HUGE_VALF;
+    });
+    return hit ? static_cast<int>(object) : -1;
+}
+
+// the coarsest level of range whose error projects to at most
+// LOD_PIXEL_ERROR pixels, pixelsPerUnit being the screen size of a unit at
+// the object's distance. Coarser than current only once it is
+// LOD_HYSTERESIS under that, so objects near a switch do not flicker.
+static unsigned selectLod(const MeshPool::Range &range, float pixelsPerUnit, unsigned current)
+{
+    unsigned fine = 0, coarse = 0;
+    for (unsigned l = 1; l < range.lodCount; ++l)
     {
-        glfwTerminate();
-        return -1;
+        float pixels = range.lods[l].error * pixelsPerUnit;
+        if (pixels <= LOD_PIXEL_ERROR)
+            fine = l;
+        if (pixels <= LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS))
+            coarse = l;
     }
+    if (current > fine)
+        return fine;
+    return coarse > current ? coarse : current;
+}
 
-    /* Make the window's context current */
-    glfwMakeContextCurrent(window);
-    
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+// models without texcoords get the front view of their bounds, so the
+// material textures have something to map
+static void projectTexCoords(OBJLoader::MeshData &data)
+{
+    const size_t stride = OBJLoader::FLOATS_PER_VERTEX;
+    for (size_t v = 0; v < data.vertices.size(); v += stride)
+        if (data.vertices[v + 6] != 0.0f || data.vertices[v + 7] != 0.0f)
+            return;
+    float width = std::max(data.bounds_max[0] - data.bounds_min[0], 1e-6f);
+    float height = std::max(data.bounds_max[1] - data.bounds_min[1], 1e-6f);
+    for (size_t v = 0; v < data.vertices.size(); v += stride)
     {
-        glfwTerminate();
-        return (-1);
+        data.vertices[v + 6] = (data.vertices[v] - data.bounds_min[0]) / width;
+        data.vertices[v + 7] = (data.vertices[v + 1] - data.bounds_min[1]) / height;
     }
-    glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback); 
-    
-    Shader shader("shaders/vertex/vertex.vert", "shaders/fragment/fragment.frag");
+}
+
+// a GL_TEXTURE_2D_ARRAY with a layer per --multidraw material: the wall,
+// then grey copies of it for the material base colors to tint
+static GLuint buildMaterialTextures()
+{
+    int width, height;
+    std::vector<uint8_t> wall = BMPLoader::loadBMP(WALL_TEXTURE, width, height);
+    TextureArrayBuilder layers;
+    for (int m = 0; m < MULTIDRAW_MATERIALS; ++m)
+    {
+        std::vector<uint8_t> texels = wall;
+        for (size_t t = 0; m > 0 && t < texels.size(); t += 4)
+        {
+            uint8_t grey = static_cast<uint8_t>((texels[t] * 77 + texels[t + 1] * 150 + texels[t + 2] * 29) >> 8);
+            texels[t] = texels[t + 1] = texels[t + 2] = grey;
+        }
+        layers.add(texels, width, height);
+    }
+    GLuint texture;
+    glGenTextures(1, &texture);
+    layers.build(texture);
+    return texture;
+}
+
+// everything owning GL objects lives here, so it is released while the
+// context still exists
+static void run(GLFWwindow *window, const Options &options)
+{
+    // blocks are bound by name after every link, so define them first
+    UniformBlocks::define();
+    // every per-frame upload: frame block, instances, multi-draw data
+    size_t commandsPerObject = options.meshlets ? MAX_MESHLET_RANGES : 1;
+    size_t perObject = 2 * sizeof(InstanceData) + commandsPerObject * sizeof(DrawElementsIndirectCommand);
+    StreamBuffer stream(STREAM_BASE_BYTES + static_cast<size_t>(options.instances) * perObject);
+    UniformBuffer frameUniforms(FRAME_BINDING, sizeof(FrameBlock), 1, &stream);
+    UniformBuffer materialUniforms(MATERIAL_BINDING, sizeof(MaterialBlock), MULTIDRAW_MATERIALS);
+    for (int m = 0; m < MULTIDRAW_MATERIALS; ++m)
+    {
+        MaterialBlock &material = materialUniforms.as<MaterialBlock>(m);
+        material.baseColor = m == 0 ? Vec4(1.0f, 1.0f, 1.0f, 1.0f) : Vec4(1.0f, 0.8f, 0.5f, 1.0f);
+        material.shininess = 32.0f;
+        material.flags = 0;
+    }
+    materialUniforms.upload();
+
+    // the real shader compiles in the background; the fallback is trivial
+    // and drawn until it is ready, so the window never freezes on startup
+    ShaderPermutations shaders("shaders/vertex/vertex.vert", "shaders/fragment/fragment.frag");
+    Shader fallback("shaders/vertex/vertex.vert", "shaders/fragment/fallback.frag");
+    shaders.setFallback(&fallback);
+    // edited shader files are rebuilt in the background while drawing
+    ShaderWatcher watcher;
+    watcher.watch(shaders);
+    watcher.watch(fallback);
 
     // float vertices[] = {
     //     0.5f,  0.5f, 0.0f,  // top right
@@ -63,54 +322,291 @@ int main(void)
     //     1, 2, 3    // second triangle
     // };
     float vertices[] = {
-        // positions         // colors
-        0.5f, -0.5f, 0.0f,  1.0f, 0.0f, 0.0f,   // bottom right
-        -0.5f, -0.5f, 0.0f,  0.0f, 1.0f, 0.0f,   // bottom left
-        0.0f,  0.5f, 0.0f,  0.0f, 0.0f, 1.0f    // top 
+        // positions         // colors           // texture coords
+        0.5f, -0.5f, 0.0f,  1.0f, 0.0f, 0.0f,   1.0f, 0.0f,   // bottom right
+        -0.5f, -0.5f, 0.0f,  0.0f, 1.0f, 0.0f,   0.0f, 0.0f,   // bottom left
+        0.0f,  0.5f, 0.0f,  0.0f, 0.0f, 1.0f,   0.5f, 1.0f    // top 
     };
     //unsigned int EBO;
 
     unsigned int VBO; // vertex buffer object
-    unsigned int VAO; // vertex array object 
-    glGenVertexArrays(1, &VAO); // generate vertex array object
     glGenBuffers(1, &VBO); // generate vertex buffer object
     //glGenBuffers(1, &EBO); // generate element buffer object 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO); // bind to GL_ARRAY_BUFFER 
+    GLState::bindBuffer(GL_ARRAY_BUFFER, VBO); // bind to GL_ARRAY_BUFFER 
     //glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO); // bind to GL_ELEMENT_ARRAY_BUFFER
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW); // copy vertex data to vertex buffer
     //glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW); 
 
-    unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    // textures are shared by path and content and kept under the VRAM
+    // budget; their texels stream in over the first frames, or with
+    // --compress are encoded (or read from the disk cache) in load()
+    TextureStreamer streamer;
+    TextureManager textures(256u * 1024u * 1024u, options.compress);
+    textures.setStreamer(&streamer);
+    TextureHandle wall = textures.load(WALL_TEXTURE);
 
+    // attributes are wired by name from each program's reflection, one
+    // cached vertex array object per format and attribute signature
+    VertexFormat format;
+    format.add("aPos", 3, GL_FLOAT).add("aColor", 3, GL_FLOAT).add("aTexCoord", 2, GL_FLOAT);
+    VertexArrayCache vertexArrays;
 
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // color attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3* sizeof(float)));
-    glEnableVertexAttribArray(1); 
-    
-    // glBindBuffer(GL_ARRAY_BUFFER, 0); // unbind VBO
-    // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0); // unbind EBO
-    glBindVertexArray(0); // unbind VAO
+    // --instances: one glDrawElementsInstanced for every copy of the model
+    Mesh *model = NULL;
+    InstanceBuffer *instances = NULL;
+    // --multidraw: one glMultiDrawElementsIndirect per run of the queue
+    MeshPool *pool = NULL;
+    std::vector<MultiDrawBatch *> batches;
+    // a layer per material, selected by each draw's data: bound once a
+    // frame instead of a glBindTexture per material
+    GLuint materialTextures = 0;
+    // the objects of a frame in draw order, see RenderQueue
+    RenderQueue queue(static_cast<size_t>(options.instances));
+    size_t queueRuns = 0;
+    InstanceField field;
+    Vec3 modelCenter;
+    Vec3 size;
+    // picking: object n shows model n % pickModels.size()
+    std::vector<MeshBVH> pickModels;
+    std::vector<Vec3> pickCenters;
+    // occluder proxy of each model, same indices as pickModels
+    OcclusionCuller occlusion;
+    std::vector<uint32_t> occluders;
+    // --meshlets: clusters of each pool mesh, the indices reordered to match
+    std::vector<Meshlets> meshlets;
+    std::vector<std::vector<IndexRange> > objectRanges;
+    // --virtual-texture: a plane whose texture is paged in as the feedback
+    // pass asks for it, in place of the triangle
+    VirtualTexture *virtualTexture = NULL;
+    Shader *vtShader = NULL;
+    Shader *vtFeedback = NULL;
+    GLuint vtPlane = 0;
+    VertexFormat vtFormat;
+    // --lod: level each object was drawn at, kept for the hysteresis
+    std::vector<unsigned char> objectLods;
+    size_t lodObjects[MeshPool::MAX_LODS] = {};
+    // drawn and full triangles of the visible objects, with meshlets or lod
+    size_t drawnTriangles = 0, fullTriangles = 0;
+    if (options.instances > 0 && options.multidraw)
+    {
+        pool = new MeshPool();
+        std::vector<OBJLoader::MeshData> models;
+        std::vector<const OBJLoader::MeshData *> simplify;
+        for (int m = 0; m < MULTIDRAW_MODEL_COUNT; ++m)
+        {
+            models.push_back(OBJLoader::loadOBJ(MULTIDRAW_MODELS[m]));
+            projectTexCoords(models.back());
+        }
+        for (int m = 0; m < MULTIDRAW_MODEL_COUNT; ++m)
+        {
+            if (options.meshlets)
+            {
+                meshlets.push_back(Meshlets());
+                meshlets.back().build(models[m]);
+            }
+            simplify.push_back(&models[m]);
+        }
+        // one model per core
+        std::vector<std::vector<MeshLod> > chains;
+        if (options.lod)
+            chains = MeshSimplifier::buildChains(simplify);
+        for (int m = 0; m < MULTIDRAW_MODEL_COUNT; ++m)
+        {
+            const OBJLoader::MeshData &data = models[m];
+            uint32_t mesh = pool->add(data);
+            for (size_t l = 0; options.lod && l < chains[m].size(); ++l)
+                pool->addLod(mesh, chains[m][l].indices, chains[m][l].error);
+            const MeshPool::Range &range = pool->range(mesh);
+            size = Vec3::max(size, range.boundsMax - range.boundsMin);
+            pickModels.push_back(MeshBVH(data));
+            occlusion.addProxy(data);
+            pickCenters.push_back((range.boundsMin + range.boundsMax) * 0.5f);
+        }
+        pool->upload();
+        materialTextures = buildMaterialTextures();
+        for (int m = 0; m < MULTIDRAW_MATERIALS; ++m)
+            batches.push_back(new MultiDrawBatch(stream, options.instances, options.instances * commandsPerObject));
+        field = layoutInstances(options.instances, options.scatter, size);
+        objectLods.assign(field.positions.size(), 0);
+        GLState::setDepthTest(true);
+    }
+    else if (options.instances > 0)
+    {
+        OBJLoader::MeshData data = OBJLoader::loadOBJ(options.model);
+        model = new Mesh(data);
+        instances = new InstanceBuffer(stream, options.instances);
+        size = model->boundsMax() - model->boundsMin();
+        field = layoutInstances(options.instances, options.scatter, size);
+        modelCenter = (model->boundsMin() + model->boundsMax()) * 0.5f;
+        pickModels.push_back(MeshBVH(data));
+        pickCenters.push_back(modelCenter);
+        occlusion.addProxy(data);
+        GLState::setDepthTest(true);
+    }
+    else if (options.virtualTexture)
+    {
+        virtualTexture = new VirtualTexture(options.virtualTexture);
+        vtShader = new Shader("shaders/vertex/virtual_texture.vert", "shaders/fragment/virtual_texture.frag");
+        vtFeedback = new Shader("shaders/vertex/virtual_texture.vert", "shaders/fragment/vt_feedback.frag");
+        watcher.watch(*vtShader);
+        watcher.watch(*vtFeedback);
+        // y = 0, drawn as a strip
+        float plane[] = {
+            -VT_PLANE_SIZE, 0.0f,  VT_PLANE_SIZE,   0.0f, 0.0f,
+             VT_PLANE_SIZE, 0.0f,  VT_PLANE_SIZE,   1.0f, 0.0f,
+            -VT_PLANE_SIZE, 0.0f, -VT_PLANE_SIZE,   0.0f, 1.0f,
+             VT_PLANE_SIZE, 0.0f, -VT_PLANE_SIZE,   1.0f, 1.0f
+        };
+        glGenBuffers(1, &vtPlane);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, vtPlane);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(plane), plane, GL_STATIC_DRAW);
+        vtFormat.add("aPos", 3, GL_FLOAT).add("aTexCoord", 2, GL_FLOAT);
+        GLState::setDepthTest(true);
+    }
+
+    // objects spin about Y around their center: bounds that hold every angle
+    FrustumCuller culler;
+    std::vector<uint32_t> visible;
+    float spin = std::sqrt(size.x * size.x + size.z * size.z) * 0.5f;
+    Vec3 spinExtents(spin, size.y * 0.5f, spin);
+    std::vector<AABB> objectBounds;
+    for (size_t n = 0; n < field.positions.size(); ++n)
+    {
+        culler.add(field.positions[n], size.length() * 0.5f, spinExtents);
+        objectBounds.push_back(AABB(field.positions[n] - spinExtents, field.positions[n] + spinExtents));
+    }
+    // the objects never leave their bounds, so the tree is never refit
+    BVH scene;
+    scene.build(objectBounds);
+
+    // --gpu-cull: the objects live on the GPU, falling back to the CPU
+    // culler and batches when compute shaders are missing
+    GpuCuller *gpu = NULL;
+    if (pool && options.gpuCull && GpuCuller::supported())
+    {
+        gpu = new GpuCuller(*pool, MULTIDRAW_MATERIALS);
+        if (!gpu->isReady())
+        {
+            delete gpu;
+            gpu = NULL;
+        }
+    }
+    if (options.gpuCull && !pool)
+        std::cerr << "--gpu-cull needs --instances N, nothing to cull" << std::endl;
+    else if (options.gpuCull && !GpuCuller::supported())
+        std::cerr << "GPU culling needs GL 4.3 compute shaders, culling on the CPU" << std::endl;
+    else if (options.gpuCull && !gpu)
+        std::cerr << "GPU culling shaders failed to build, culling on the CPU" << std::endl;
+    if (gpu)
+    {
+        for (size_t n = 0; n < field.positions.size(); ++n)
+        {
+            uint32_t m = static_cast<uint32_t>(n % MULTIDRAW_MODEL_COUNT);
+            GpuObject object;
+            object.position = Vec4(field.positions[n], field.phases[n]);
+            object.extents = Vec4(spinExtents, size.length() * 0.5f);
+            object.color = field.colors[n];
+            object.color.w = static_cast<float>(n % MULTIDRAW_MATERIALS);
+            object.center[0] = pickCenters[m].x;
+            object.center[1] = pickCenters[m].y;
+            object.center[2] = pickCenters[m].z;
+            object.command = 0;
+            gpu->add(object, m, static_cast<uint32_t>(n % MULTIDRAW_MATERIALS));
+        }
+        gpu->upload();
+        // never culled on the CPU: every object may serve as an occluder
+        for (size_t n = 0; n < field.positions.size(); ++n)
+            visible.push_back(static_cast<uint32_t>(n));
+    }
+    int picked = -1;
+    bool wasPressed = false;
 
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); // TO DRAW IN LINES
-    shader.use();
     int i = 0;
+    double lastReport = glfwGetTime();
     /* Loop until the user closes the window */
     while (!glfwWindowShouldClose(window))
     {
+        GLState::beginFrame();
+        stream.beginFrame();
+        streamer.update();
+        textures.beginFrame();
+
         /* Input here */
         processInput(window);
+        watcher.update();
 
         /* Render here */
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // one block write and upload per frame instead of a glUniform per value
+        FrameBlock &frame = frameUniforms.as<FrameBlock>(0);
+        frame.view = Mat4::identity();
+        frame.projection = Mat4::identity();
+        frame.time = static_cast<float>(glfwGetTime());
+        Vec3 eye;
+        float pixelsPerUnit = 0.0f;     // at distance 1
+        float farPlane = 1.0f;
+        if (model || pool)
+        {
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            pixelsPerUnit = height / (2.0f * std::tan(CAMERA_FOVY * 0.5f));
+            float distance = field.extent * 0.8f + 10.0f;
+            eye = Vec3(0.0f, distance * 0.6f, distance);
+            farPlane = distance * 3.0f;
+            frame.view = Mat4::lookAt(eye, Vec3(), Vec3(0.0f, 1.0f, 0.0f));
+            frame.projection = Mat4::perspective(CAMERA_FOVY, height > 0 ? (float)width / height : 1.0f,
+                                                 0.5f, farPlane);
+
+            // left click selects the object under the cursor
+            bool pressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+            if (pressed && !wasPressed)
+            {
+                picked = pickObject(cursorRay(window, eye, Vec3()), scene, field, frame.time,
+                                    pickModels, pickCenters);
+                if (picked >= 0)
+                    std::cout << "picked object " << picked << std::endl;
+            }
+            wasPressed = pressed;
+        }
+        frame.viewProjection = frame.projection * frame.view;
+        frameUniforms.upload();
+        frameUniforms.bind();
+        if (!gpu)
+            culler.cull(Frustum::fromMatrix(frame.viewProjection), visible);
+        if (options.occlusion && !visible.empty())
+        {
+            // near objects cover the most screen, so they hide the most. The
+            // camera is fixed, so the GPU path sorts its objects only once
+            if (!gpu || occluders.empty())
+            {
+                occluders = visible;
+                size_t count = std::min(MAX_OCCLUDERS, occluders.size());
+                std::partial_sort(occluders.begin(), occluders.begin() + count, occluders.end(),
+                                  [&](uint32_t a, uint32_t b) {
+                    Vec3 da = field.positions[a] - eye, db = field.positions[b] - eye;
+                    return Vec3::dot(da, da) < Vec3::dot(db, db);
+                });
+                occluders.resize(count);
+            }
+            occlusion.beginFrame(frame.viewProjection);
+            for (size_t k = 0; k < occluders.size(); ++k)
+            {
+                uint32_t n = occluders[k];
+                uint32_t m = static_cast<uint32_t>(n % pickCenters.size());
+                occlusion.addOccluder(m, Mat4::translate(field.positions[n])
+                                         * Mat4::rotateY(frame.time + field.phases[n])
+                                         * Mat4::translate(pickCenters[m] * -1.0f));
+            }
+            occlusion.finish();
+            if (gpu)
+                gpu->setDepthPyramid(&occlusion);
+            else
+                occlusion.cull(visible, objectBounds);
+        }
 
-        shader.use();
         float timeValue = glfwGetTime();
         float Sine = sin(i) / 1.f;
         float Cosine = cos(i) / 1.f;
@@ -118,10 +614,265 @@ int main(void)
         // glUniform4f(vertexColorLocation, 0.0f, greenValue, 0.0f, 1.0f);
 
         // glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-        
+        if (model)
+        {
+            // visible instances go straight into this frame's ring region
+            float time = frame.time;
+            InstanceData *data = instances->map();
+            Parallel::forChunks(visible.size(), 4096, [&](size_t, size_t begin, size_t end) {
+                for (size_t k = begin; k < end; ++k)
+                {
+                    uint32_t n = visible[k];
+                    data[k].model = Mat4::translate(field.positions[n])
+                                  * Mat4::rotateY(time + field.phases[n])
+                                  * Mat4::translate(modelCenter * -1.0f);
+                    data[k].color = static_cast<int>(n) == picked ? PICKED_COLOR : field.colors[n];
+                }
+            });
+            instances->unmap(visible.size());
+
+            shaders.submit(ShaderPermutations::INSTANCED | ShaderPermutations::LIT, [&](Shader &shader) {
+                materialUniforms.bind(0);
+                shader.setVec3("lightDir", -0.4f, -1.0f, -0.3f);
+                shader.flush();
+                GLState::bindVertexArray(vertexArrays.get(shader, Mesh::format(), model->vertexBuffer(),
+                                         model->indexBuffer(), &InstanceBuffer::format(),
+                                         instances->buffer(), instances->offset()));
+                glDrawElementsInstanced(GL_TRIANGLES, model->indexCount(), GL_UNSIGNED_INT, 0,
+                                        static_cast<GLsizei>(visible.size()));
+            });
+            shaders.flush();
+        }
+        else if (gpu)
+        {
+            // no per-object work here: the compute pass fills the commands
+            gpu->cull(picked, PICKED_COLOR);
+            GLState::bindTexture(MATERIAL_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, materialTextures);
+            const uint32_t features = ShaderPermutations::MULTI_DRAW | ShaderPermutations::LIT
+                                    | ShaderPermutations::TEXTURE_ARRAY;
+            for (unsigned b = 0; b < MULTIDRAW_MATERIALS; ++b)
+                shaders.submit(features, [&, b](Shader &shader) {
+                    materialUniforms.bind(b);
+                    shader.setVec3("lightDir", -0.4f, -1.0f, -0.3f);
+                    shader.setInt("materialTextures", MATERIAL_TEXTURE_UNIT);
+                    gpu->draw(b, shader, vertexArrays, DRAW_DATA_UNIT);
+                });
+            shaders.flush();
+        }
+        else if (pool)
+        {
+            // object n uses model n % 3 and material n % 2
+            if (!meshlets.empty())
+            {
+                // the meshlets of each object facing the eye inside the
+                // frustum, both brought into the object's own space
+                Frustum frustum = Frustum::fromMatrix(frame.viewProjection);
+                objectRanges.resize(visible.size());
+                Parallel::forChunks(visible.size(), 256, [&](size_t, size_t begin, size_t end) {
+                    for (size_t k = begin; k < end; ++k)
+                    {
+                        uint32_t n = visible[k];
+                        size_t m = n % MULTIDRAW_MODEL_COUNT;
+                        float angle = frame.time + field.phases[n];
+                        Mat4 model = Mat4::translate(field.positions[n]) * Mat4::rotateY(angle)
+                                   * Mat4::translate(pickCenters[m] * -1.0f);
+                        Vec3 localEye = pickCenters[m] + Mat4::rotateY(-angle).transformPoint(eye - field.positions[n]);
+                        objectRanges[k].clear();
+                        meshlets[m].cull(frustum.transformed(model), localEye, objectRanges[k]);
+                    }
+                });
+            }
+            // grouped by program, material and mesh, each group front to
+            // back; one program here, so every material is a single run
+            const uint32_t features = ShaderPermutations::MULTI_DRAW | ShaderPermutations::LIT
+                                    | ShaderPermutations::TEXTURE_ARRAY;
+            GLState::bindTexture(MATERIAL_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, materialTextures);
+            queue.clear();
+            for (size_t k = 0; k < visible.size(); ++k)
+            {
+                uint32_t n = visible[k];
+                float depth = (field.positions[n] - eye).length() / farPlane;
+                queue.push(RenderQueue::key(0, false, features, n % MULTIDRAW_MATERIALS,
+                                            n % MULTIDRAW_MODEL_COUNT, depth), static_cast<uint32_t>(k));
+            }
+            queue.sort();
+            drawnTriangles = fullTriangles = 0;
+            std::fill(lodObjects, lodObjects + MeshPool::MAX_LODS, 0);
+            auto submitRun = [&](uint64_t runKey, MultiDrawBatch *runBatch) {
+                unsigned b = RenderQueue::material(runKey);
+                runBatch->upload();
+                shaders.submit(RenderQueue::program(runKey), [&, b, runBatch](Shader &shader) {
+                    materialUniforms.bind(b);
+                    shader.setVec3("lightDir", -0.4f, -1.0f, -0.3f);
+                    shader.setInt("materialTextures", MATERIAL_TEXTURE_UNIT);
+                    runBatch->draw(shader, vertexArrays, *pool, DRAW_DATA_UNIT);
+                });
+            };
+            // a batch per run of program and material, in queue order: its
+            // program, material block and draw data texture are bound once.
+            // A material can come back in a later run (translucents sorted
+            // by depth), so each run fills its own batch
+            queueRuns = 0;
+            MultiDrawBatch *batch = NULL;
+            for (size_t s = 0; s < queue.size(); ++s)
+            {
+                uint64_t key = queue.keyAt(s);
+                if (s == 0 || RenderQueue::program(key) != RenderQueue::program(queue.keyAt(s - 1))
+                    || RenderQueue::material(key) != RenderQueue::material(queue.keyAt(s - 1)))
+                {
+                    if (batch)
+                        submitRun(queue.keyAt(s - 1), batch);
+                    // flush() groups by program, which would pull a later
+                    // run of this program ahead of the runs between
+                    if (s > 0 && RenderQueue::program(key) != RenderQueue::program(queue.keyAt(s - 1)))
+                        shaders.flush();
+                    if (queueRuns == batches.size())
+                        batches.push_back(new MultiDrawBatch(stream, options.instances,
+                                                             options.instances * commandsPerObject));
+                    batch = batches[queueRuns++];
+                    batch->clear();
+                }
+                size_t k = queue.itemAt(s);
+                uint32_t n = visible[k];
+                const MeshPool::Range &range = pool->range(static_cast<uint32_t>(n % MULTIDRAW_MODEL_COUNT));
+                const std::vector<IndexRange> *parts = meshlets.empty() ? NULL : &objectRanges[k];
+                fullTriangles += range.indexCount / 3;
+                if (parts && parts->empty())
+                    continue;
+                // a coarser level is drawn whole, it has no meshlets
+                IndexRange lodPart = { 0, 0 };
+                if (options.lod)
+                {
+                    float distance = std::max((field.positions[n] - eye).length(), 1e-3f);
+                    unsigned lod = selectLod(range, pixelsPerUnit / distance, objectLods[n]);
+                    objectLods[n] = static_cast<unsigned char>(lod);
+                    ++lodObjects[lod];
+                    if (lod > 0)
+                    {
+                        lodPart.first = range.lods[lod].firstIndex - range.firstIndex;
+                        lodPart.count = range.lods[lod].indexCount;
+                        parts = NULL;
+                    }
+                }
+                // too scattered: cheaper drawn whole
+                if (parts && parts->size() > MAX_MESHLET_RANGES)
+                    parts = NULL;
+                InstanceData data;
+                data.model = Mat4::translate(field.positions[n])
+                           * Mat4::rotateY(frame.time + field.phases[n])
+                           * Mat4::translate((range.boundsMin + range.boundsMax) * -0.5f);
+                data.color = static_cast<int>(n) == picked ? PICKED_COLOR : field.colors[n];
+                data.color.w = static_cast<float>(n % MULTIDRAW_MATERIALS);
+                if (parts)
+                {
+                    batch->add(range, data, parts->data(), parts->size());
+                    for (size_t p = 0; p < parts->size(); ++p)
+                        drawnTriangles += (*parts)[p].count / 3;
+                }
+                else if (options.lod && objectLods[n] > 0)
+                {
+                    batch->add(range, data, &lodPart, 1);
+                    drawnTriangles += lodPart.count / 3;
+                }
+                else
+                {
+                    batch->add(range, data);
+                    drawnTriangles += range.indexCount / 3;
+                }
+            }
+            if (batch)
+                submitRun(queue.keyAt(queue.size() - 1), batch);
+            shaders.flush();
+        }
+        else if (virtualTexture)
+        {
+            // low over the plane and panning, so near pages are fine, far
+            // ones coarse, and pages keep coming into view
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            float pan = std::sin(frame.time * 0.1f) * VT_PLANE_SIZE * 0.5f;
+            Vec3 vtEye(pan, 1.5f, VT_PLANE_SIZE * 0.6f);
+            Mat4 transform = Mat4::perspective(CAMERA_FOVY, height > 0 ? (float)width / height : 1.0f, 0.1f,
+                                               VT_PLANE_SIZE * 4.0f)
+                           * Mat4::lookAt(vtEye, Vec3(pan, 0.0f, 0.0f), Vec3(0.0f, 1.0f, 0.0f));
 
+            // pages this frame needs, read back next frame
+            virtualTexture->beginFeedback(width, height);
+            virtualTexture->setUniforms(*vtFeedback, VT_INDIRECTION_UNIT, VT_PHYSICAL_UNIT);
+            vtFeedback->setMat4("transform", transform.data());
+            vtFeedback->use();
+            GLState::bindVertexArray(vertexArrays.get(*vtFeedback, vtFormat, vtPlane));
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            virtualTexture->endFeedback();
+            virtualTexture->update();
+
+            virtualTexture->bindTextures(VT_INDIRECTION_UNIT, VT_PHYSICAL_UNIT);
+            virtualTexture->setUniforms(*vtShader, VT_INDIRECTION_UNIT, VT_PHYSICAL_UNIT);
+            vtShader->setMat4("transform", transform.data());
+            vtShader->use();
+            GLState::bindVertexArray(vertexArrays.get(*vtShader, vtFormat, vtPlane));
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        }
+        else
+        {
+            shaders.submit(ShaderPermutations::VERTEX_COLOR | ShaderPermutations::TEXTURED, [&](Shader &shader) {
+                materialUniforms.bind(0);
+                wall.bind(TEXTURE_UNIT);
+                shader.setInt("texture1", TEXTURE_UNIT);
+                shader.flush();
+                GLState::bindVertexArray(vertexArrays.get(shader, format, VBO));
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            });
+            shaders.flush();
+        }
+        stream.endFrame();
+
+        // once a second: the previous frame's issued / filtered GL calls,
+        // this frame's stream usage, fence wait and culling counts
+        if (glfwGetTime() - lastReport >= 1.0)
+        {
+            lastReport = glfwGetTime();
+            std::string title = GLState::report() + ", " + stream.report() + ", "
+                              + (gpu ? gpu->report() : culler.report());
+            if (options.occlusion)
+                title += ", " + occlusion.report();
+            {
+                char text[64];
+                std::snprintf(text, sizeof(text), ", textures: %zu KB%s", textures.usage() / 1024,
+                              options.compress ? " compressed" : "");
+                title += text;
+            }
+            if (virtualTexture)
+            {
+                char text[96];
+                std::snprintf(text, sizeof(text), ", virtual texture: %zu pages resident, %zu pending",
+                              virtualTexture->residentPages(), virtualTexture->pendingPages());
+                title += text;
+            }
+            if (!meshlets.empty() && !gpu)
+            {
+                char text[96];
+                std::snprintf(text, sizeof(text), ", meshlets: %zu/%zu triangles (%s)",
+                              drawnTriangles, fullTriangles, Meshlets::simdPath());
+                title += text;
+            }
+            if (pool && !gpu)
+            {
+                char text[64];
+                std::snprintf(text, sizeof(text), ", queue: %zu draws in %zu runs, %u passes",
+                              queue.size(), queueRuns, queue.passes());
+                title += text;
+            }
+            if (options.lod && !gpu)
+            {
+                char text[96];
+                std::snprintf(text, sizeof(text), ", lod: %zu/%zu triangles, objects %zu/%zu/%zu/%zu",
+                              drawnTriangles, fullTriangles, lodObjects[0], lodObjects[1],
+                              lodObjects[2], lodObjects[3]);
+                title += text;
+            }
+            glfwSetWindowTitle(window, title.c_str());
+        }
 
         /* Swap front and back buffers */
         glfwSwapBuffers(window);
@@ -129,10 +880,73 @@ int main(void)
         glfwPollEvents();
         i++;
     }
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    vertexArrays.clear();
+    delete instances;
+    delete model;
+    for (size_t b = 0; b < batches.size(); ++b)
+        delete batches[b];
+    delete gpu;
+    delete pool;
+    if (materialTextures)
+        GLState::deleteTextures(1, &materialTextures);
+    delete virtualTexture;
+    if (vtShader)
+    {
+        GLState::deleteProgram(vtShader->ID);
+        GLState::deleteProgram(vtFeedback->ID);
+        GLState::deleteBuffers(1, &vtPlane);
+    }
+    delete vtShader;
+    delete vtFeedback;
+    GLState::deleteBuffers(1, &VBO);
     // glDeleteBuffers(1, &EBO);
-    glDeleteProgram(shader.ID);
+    GLState::deleteProgram(fallback.ID);
+
+}
+
+int main(int argc, char **argv)
+{
+    GLFWwindow* window;
+    Options options;
+
+    if (!parseOptions(argc, argv, options))
+        return 1;
+
+    /* Initialize the library */
+    if (!glfwInit())
+        return -1;
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    /* Create a windowed mode window and its OpenGL context */
+    window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Hello World", NULL, NULL);
+    if (!window)
+    {
+        glfwTerminate();
+        return -1;
+    }
+
+    /* Make the window's context current */
+    glfwMakeContextCurrent(window);
+    
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        glfwTerminate();
+        return (-1);
+    }
+    glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback); 
+    
+    try
+    {
+        run(window, options);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+    }
 
     glfwTerminate();
     return 0;
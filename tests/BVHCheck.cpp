@@ -0,0 +1,220 @@
+#include "check.h"
+#include "Render/BVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+    float uniform(std::mt19937 &random, float low, float high)
+    {
+        return low + (high - low) * static_cast<float>(random() % 1000000) / 1000000.0f;
+    }
+
+    std::vector<AABB> randomBoxes(std::mt19937 &random, size_t count, float spread)
+    {
+        std::vector<AABB> boxes(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            Vec3 center(uniform(random, -spread, spread), uniform(random, -spread, spread),
+                        uniform(random, -spread, spread));
+            Vec3 half(uniform(random, 0.05f, 1.0f), uniform(random, 0.05f, 1.0f), uniform(random, 0.05f, 1.0f));
+            boxes[i] = AABB(center - half, center + half);
+        }
+        return boxes;
+    }
+
+    BVHNode boxNode(const AABB &box)
+    {
+        BVHNode node;
+        node.boundsMin[0] = box.min.x;
+        node.boundsMin[1] = box.min.y;
+        node.boundsMin[2] = box.min.z;
+        node.boundsMax[0] = box.max.x;
+        node.boundsMax[1] = box.max.y;
+        node.boundsMax[2] = box.max.z;
+        node.leftFirst = node.count = 0;
+        return node;
+    }
+
+    bool contains(const BVHNode &outer, const BVHNode &inner)
+    {
+        for (int a = 0; a < 3; ++a)
+            if (inner.boundsMin[a] < outer.boundsMin[a] || inner.boundsMax[a] > outer.boundsMax[a])
+                return false;
+        return true;
+    }
+
+    // nodes on the longest path below index, walking the tree itself
+    uint32_t subtreeDepth(const std::vector<BVHNode> &nodes, uint32_t index)
+    {
+        if (nodes[index].count > 0)
+            return 1;
+        return 1 + std::max(subtreeDepth(nodes, index + 1), subtreeDepth(nodes, nodes[index].leftFirst));
+    }
+
+    // every primitive in exactly one leaf, every box inside its parent's
+    void checkStructure(const BVH &bvh, const std::vector<AABB> &boxes)
+    {
+        const std::vector<BVHNode> &nodes = bvh.nodes();
+        const std::vector<uint32_t> &indices = bvh.indices();
+        CHECK(bvh.primitiveCount() == boxes.size());
+        CHECK(indices.size() == boxes.size());
+        std::vector<int> seen(boxes.size(), 0);
+        for (size_t i = 0; i < indices.size(); ++i)
+            if (indices[i] < boxes.size())
+                ++seen[indices[i]];
+        CHECK(std::count(seen.begin(), seen.end(), 1) == static_cast<long>(boxes.size()));
+
+        bool nested = true, covered = true;
+        size_t leafSlots = 0;
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            const BVHNode &node = nodes[i];
+            if (node.count > 0)
+            {
+                leafSlots += node.count;
+                for (uint32_t k = 0; k < node.count; ++k)
+                    covered = covered && contains(node, boxNode(boxes[indices[node.leftFirst + k]]));
+                continue;
+            }
+            nested = nested && i + 1 < nodes.size() && node.leftFirst > i + 1 && node.leftFirst < nodes.size()
+                  && contains(node, nodes[i + 1]) && contains(node, nodes[node.leftFirst]);
+        }
+        CHECK(nested);
+        CHECK(covered);
+        CHECK(leafSlots == boxes.size());
+        CHECK(!nodes.empty() && bvh.depth() == subtreeDepth(nodes, 0));
+    }
+
+    // raycast and nearest against every box in turn, cull against every box
+    // through the same plane test
+    void checkQueries(std::mt19937 &random, const BVH &bvh, const std::vector<AABB> &boxes, float spread)
+    {
+        auto hitBox = [&](uint32_t p, const Ray &ray, float tMax) {
+            Vec3 inverse(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+            return BVH::intersectNode(boxNode(boxes[p]), ray, inverse, tMax);
+        };
+        int rayMismatches = 0, hits = 0;
+        for (int r = 0; r < 500; ++r)
+        {
+            Ray ray;
+            ray.origin = Vec3(uniform(random, -spread, spread), uniform(random, -spread, spread), -2.0f * spread);
+            ray.direction = Vec3(uniform(random, -0.3f, 0.3f), uniform(random, -0.3f, 0.3f), 1.0f);
+            float best = HUGE_VALF;
+            for (uint32_t p = 0; p < boxes.size(); ++p)
+                best = std::min(best, hitBox(p, ray, HUGE_VALF));
+            float t = HUGE_VALF;
+            uint32_t primitive = 0;
+            bool found = bvh.raycast(ray, t, primitive, hitBox);
+            if (found != (best < HUGE_VALF) || (found && (t != best || hitBox(primitive, ray, HUGE_VALF) != best)))
+                ++rayMismatches;
+            hits += found;
+        }
+        CHECK(rayMismatches == 0);
+        CHECK(hits > 0);
+
+        auto distanceTo = [&](uint32_t p, const Vec3 &point, float) {
+            return BVH::nodeDistance(boxNode(boxes[p]), point);
+        };
+        int nearMismatches = 0;
+        for (int q = 0; q < 200; ++q)
+        {
+            Vec3 point(uniform(random, -2.0f * spread, 2.0f * spread), uniform(random, -2.0f * spread, 2.0f * spread),
+                       uniform(random, -2.0f * spread, 2.0f * spread));
+            float best = HUGE_VALF;
+            for (uint32_t p = 0; p < boxes.size(); ++p)
+                best = std::min(best, distanceTo(p, point, best));
+            float distance = HUGE_VALF;
+            uint32_t primitive = 0;
+            if (!bvh.nearest(point, distance, primitive, distanceTo) || distance != best)
+                ++nearMismatches;
+        }
+        CHECK(nearMismatches == 0);
+
+        int cullMismatches = 0;
+        for (int f = 0; f < 20; ++f)
+        {
+            Vec3 eye(uniform(random, -2.0f * spread, 2.0f * spread), uniform(random, -spread, spread), 2.0f * spread);
+            Mat4 viewProjection = Mat4::perspective(uniform(random, 0.3f, 1.5f), 1.5f, 0.1f, 4.0f * spread)
+                                * Mat4::lookAt(eye, Vec3(), Vec3(0.0f, 1.0f, 0.0f));
+            Frustum frustum = Frustum::fromMatrix(viewProjection);
+            std::vector<uint32_t> expected;
+            for (uint32_t p = 0; p < boxes.size(); ++p)
+            {
+                Vec3 center = boxes[p].center(), extents = boxes[p].extents();
+                bool inside = true;
+                for (int k = 0; k < 6 && inside; ++k)
+                {
+                    const Vec4 &plane = frustum.planes[k];
+                    float d = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+                    float radius = std::fabs(plane.x) * extents.x + std::fabs(plane.y) * extents.y
+                                 + std::fabs(plane.z) * extents.z;
+                    inside = d + radius >= 0.0f;
+                }
+                if (inside)
+                    expected.push_back(p);
+            }
+            std::vector<uint32_t> visible;
+            bvh.cull(frustum, visible, &boxes);
+            std::sort(visible.begin(), visible.end());
+            if (visible != expected)
+                ++cullMismatches;
+        }
+        CHECK(cullMismatches == 0);
+    }
+
+    void checkEmpty()
+    {
+        BVH bvh;
+        bvh.build(std::vector<AABB>());
+        CHECK(bvh.depth() == 0);
+        CHECK(bvh.nodes().empty());
+        Ray ray;
+        ray.direction = Vec3(0.0f, 0.0f, 1.0f);
+        float t = 0.0f;
+        uint32_t primitive = 0;
+        CHECK(!bvh.raycast(ray, t, primitive, [](uint32_t, const Ray &, float) { return 0.0f; }));
+
+        std::vector<AABB> one(1, AABB(Vec3(-1.0f, -1.0f, -1.0f), Vec3(1.0f, 1.0f, 1.0f)));
+        bvh.build(one);
+        CHECK(bvh.depth() == 1);
+        bvh.clear();
+        CHECK(bvh.depth() == 0);
+    }
+}
+
+void checkBVH()
+{
+    std::mt19937 random(45);
+    checkEmpty();
+
+    // large enough for the parallel subtree build
+    std::vector<AABB> boxes = randomBoxes(random, 20000, 100.0f);
+    BVH bvh;
+    bvh.build(boxes);
+    checkStructure(bvh, boxes);
+    checkQueries(random, bvh, boxes, 100.0f);
+
+    // moved primitives, same tree
+    size_t nodeCount = bvh.nodes().size();
+    for (size_t i = 0; i < boxes.size(); ++i)
+    {
+        Vec3 offset(uniform(random, -3.0f, 3.0f), uniform(random, -3.0f, 3.0f), uniform(random, -3.0f, 3.0f));
+        boxes[i] = AABB(boxes[i].min + offset, boxes[i].max + offset);
+    }
+    bvh.refit(boxes);
+    CHECK(bvh.nodes().size() == nodeCount);
+    checkStructure(bvh, boxes);
+    checkQueries(random, bvh, boxes, 100.0f);
+
+    // equal centroids leave the SAH nothing to split on
+    std::vector<AABB> stacked(300, AABB(Vec3(-1.0f, -1.0f, -1.0f), Vec3(1.0f, 1.0f, 1.0f)));
+    for (size_t i = 0; i < stacked.size(); ++i)
+        stacked[i].max.x += static_cast<float>(i) * 0.01f;
+    bvh.build(stacked);
+    checkStructure(bvh, stacked);
+    checkQueries(random, bvh, stacked, 2.0f);
+}
@@ -0,0 +1,167 @@
+#include "check.h"
+#include "Render/FrustumCuller.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // MIN_CHUNK_GROUPS of FrustumCuller.cpp times its group size: with
+    // more cores, more objects than this are split into chunks whose
+    // lists are then compacted
+    const size_t CHUNK_OBJECTS = 4096 * 8;
+
+    struct Object {
+        Vec3 center;
+        float radius;
+        Vec3 extents;
+    };
+
+    float uniform(std::mt19937 &random, float low, float high)
+    {
+        return low + (high - low) * static_cast<float>(random() % 1000000) / 1000000.0f;
+    }
+
+    std::vector<Object> randomObjects(std::mt19937 &random, size_t count, float spread)
+    {
+        std::vector<Object> objects(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            objects[i].center = Vec3(uniform(random, -spread, spread), uniform(random, -spread, spread),
+                                     uniform(random, -spread, spread));
+            objects[i].extents = Vec3(uniform(random, 0.1f, 2.0f), uniform(random, 0.1f, 2.0f),
+                                      uniform(random, 0.1f, 2.0f));
+            // usually the box's own sphere, sometimes a tighter one
+            objects[i].radius = objects[i].extents.length() * (random() % 4 ? 1.0f : 0.6f);
+        }
+        return objects;
+    }
+
+    // one object, one plane at a time, summed in the order the SIMD paths use
+    bool scalarVisible(const Frustum &frustum, const Object &object)
+    {
+        for (int p = 0; p < 6; ++p)
+        {
+            const Vec4 &plane = frustum.planes[p];
+            float d = (object.center.x * plane.x + object.center.y * plane.y)
+                    + (object.center.z * plane.z + plane.w);
+            float box = (object.extents.x * std::fabs(plane.x) + object.extents.y * std::fabs(plane.y))
+                      + object.extents.z * std::fabs(plane.z);
+            float reach = object.radius < box ? object.radius : box;
+            if (d + reach < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    std::vector<uint32_t> scalarCull(const Frustum &frustum, const std::vector<Object> &objects)
+    {
+        std::vector<uint32_t> visible;
+        for (size_t i = 0; i < objects.size(); ++i)
+            if (scalarVisible(frustum, objects[i]))
+                visible.push_back(static_cast<uint32_t>(i));
+        return visible;
+    }
+
+    Frustum cameraFrustum(const Vec3 &eye, const Vec3 &target)
+    {
+        Mat4 viewProjection = Mat4::perspective(1.0f, 16.0f / 9.0f, 0.5f, 60.0f)
+                            * Mat4::lookAt(eye, target, Vec3(0.0f, 1.0f, 0.0f));
+        return Frustum::fromMatrix(viewProjection);
+    }
+
+    // cull() against the scalar test, for counts that leave padding lanes
+    // in the last group and counts past a chunk
+    void checkAgainstScalar(std::mt19937 &random, size_t count)
+    {
+        std::vector<Object> objects = randomObjects(random, count, 40.0f);
+        FrustumCuller culler;
+        for (size_t i = 0; i < objects.size(); ++i)
+            CHECK(culler.add(objects[i].center, objects[i].radius, objects[i].extents) == i);
+        CHECK(culler.size() == count);
+
+        const Frustum frusta[] = {
+            cameraFrustum(Vec3(0.0f, 10.0f, 45.0f), Vec3()),
+            cameraFrustum(Vec3(-30.0f, 0.0f, 0.0f), Vec3(30.0f, 5.0f, 10.0f)),
+            cameraFrustum(Vec3(0.0f, 0.0f, 0.0f), Vec3(0.0f, -1.0f, 0.01f)),
+        };
+        for (size_t f = 0; f < sizeof(frusta) / sizeof(frusta[0]); ++f)
+        {
+            // stale contents must not survive
+            std::vector<uint32_t> visible(3, 12345u);
+            size_t found = culler.cull(frusta[f], visible);
+            std::vector<uint32_t> expected = scalarCull(frusta[f], objects);
+            CHECK(found == visible.size());
+            CHECK(visible == expected);
+            FrustumCuller::Stats stats = culler.stats();
+            CHECK(stats.tested == count);
+            CHECK(stats.visible == expected.size());
+            CHECK(stats.culled == count - expected.size());
+        }
+    }
+
+    // padding lanes stay hidden even when every real object is visible
+    void checkPadding()
+    {
+        Frustum frustum = cameraFrustum(Vec3(0.0f, 0.0f, 10.0f), Vec3());
+        for (size_t count = 1; count <= 17; ++count)
+        {
+            FrustumCuller culler;
+            for (size_t i = 0; i < count; ++i)
+                culler.addSphere(Vec3(0.0f, 0.0f, 0.0f), 1.0f);
+            std::vector<uint32_t> visible;
+            CHECK(culler.cull(frustum, visible) == count);
+            bool ascending = visible.size() == count;
+            for (size_t i = 0; ascending && i < count; ++i)
+                ascending = visible[i] == i;
+            CHECK(ascending);
+        }
+
+        FrustumCuller empty;
+        std::vector<uint32_t> visible(4, 0u);
+        CHECK(empty.cull(frustum, visible) == 0);
+        CHECK(visible.empty());
+    }
+
+    // set() moves an object, clear() drops them all
+    void checkUpdates()
+    {
+        Frustum frustum = cameraFrustum(Vec3(0.0f, 0.0f, 10.0f), Vec3());
+        FrustumCuller culler;
+        for (int i = 0; i < 11; ++i)
+            culler.addBox(Vec3(-0.5f, -0.5f, -0.5f), Vec3(0.5f, 0.5f, 0.5f));
+        std::vector<uint32_t> visible;
+        CHECK(culler.cull(frustum, visible) == 11);
+
+        // behind the eye, then back in front
+        culler.set(3, Vec3(0.0f, 0.0f, 30.0f), 1.0f, Vec3(0.5f, 0.5f, 0.5f));
+        culler.set(9, Vec3(0.0f, 0.0f, 30.0f), 1.0f, Vec3(0.5f, 0.5f, 0.5f));
+        CHECK(culler.cull(frustum, visible) == 9);
+        CHECK(std::find(visible.begin(), visible.end(), 3u) == visible.end());
+        CHECK(std::find(visible.begin(), visible.end(), 9u) == visible.end());
+        culler.set(3, Vec3(), 1.0f, Vec3(0.5f, 0.5f, 0.5f));
+        CHECK(culler.cull(frustum, visible) == 10);
+
+        culler.clear();
+        CHECK(culler.size() == 0);
+        CHECK(culler.cull(frustum, visible) == 0);
+        CHECK(culler.addSphere(Vec3(), 1.0f) == 0);
+        CHECK(culler.cull(frustum, visible) == 1);
+    }
+}
+
+void checkFrustumCuller()
+{
+#if defined(__AVX2__)
+    CHECK(std::strcmp(FrustumCuller::simdPath(), "AVX2") == 0);
+#endif
+    std::mt19937 random(44);
+    const size_t counts[] = { 1, 7, 8, 9, 100, 1021, CHUNK_OBJECTS - 3, CHUNK_OBJECTS * 3 + 5 };
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+        checkAgainstScalar(random, counts[i]);
+    checkPadding();
+    checkUpdates();
+}
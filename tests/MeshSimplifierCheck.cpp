@@ -0,0 +1,222 @@
+#include "check.h"
+#include "Render/MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    void addVertex(OBJLoader::MeshData &mesh, float x, float y, float z, float u, float v)
+    {
+        float length = std::sqrt(x * x + y * y + z * z);
+        float n = length > 0.0f ? 1.0f / length : 0.0f;
+        const float vertex[OBJLoader::FLOATS_PER_VERTEX] = { x, y, z, x * n, y * n, z * n, u, v };
+        mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + OBJLoader::FLOATS_PER_VERTEX);
+    }
+
+    void setBounds(OBJLoader::MeshData &mesh)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            mesh.bounds_min[a] = HUGE_VALF;
+            mesh.bounds_max[a] = -HUGE_VALF;
+        }
+        for (size_t v = 0; v < mesh.vertices.size(); v += OBJLoader::FLOATS_PER_VERTEX)
+            for (int a = 0; a < 3; ++a)
+            {
+                mesh.bounds_min[a] = std::min(mesh.bounds_min[a], mesh.vertices[v + a]);
+                mesh.bounds_max[a] = std::max(mesh.bounds_max[a], mesh.vertices[v + a]);
+            }
+    }
+
+    struct Topology {
+        size_t outOfRange;          // indices past the vertex buffer
+        size_t degenerate;          // triangles with two corners at one position
+        size_t nonManifold;         // edges of more than two triangles
+        size_t repeatedDirected;    // edges two triangles walk the same way
+        size_t border;              // edges of a single triangle
+    };
+
+    // edges between positions, so vertices split by a seam count as one
+    Topology topology(const OBJLoader::MeshData &mesh, const std::vector<uint32_t> &indices)
+    {
+        Topology result = { 0, 0, 0, 0, 0 };
+        size_t vertexCount = mesh.vertices.size() / OBJLoader::FLOATS_PER_VERTEX;
+        std::map<std::vector<float>, uint32_t> positionIds;
+        std::vector<uint32_t> position(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            const float *p = &mesh.vertices[v * OBJLoader::FLOATS_PER_VERTEX];
+            std::vector<float> key(p, p + 3);
+            position[v] = positionIds.insert(std::make_pair(key, static_cast<uint32_t>(positionIds.size()))).first->second;
+        }
+        std::map<std::pair<uint32_t, uint32_t>, int> directed, undirected;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            uint32_t corner[3];
+            bool valid = true;
+            for (int k = 0; k < 3; ++k)
+            {
+                valid = valid && indices[t + k] < vertexCount;
+                corner[k] = valid ? position[indices[t + k]] : 0;
+            }
+            if (!valid)
+            {
+                ++result.outOfRange;
+                continue;
+            }
+            if (corner[0] == corner[1] || corner[1] == corner[2] || corner[2] == corner[0])
+            {
+                ++result.degenerate;
+                continue;
+            }
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t a = corner[k], b = corner[(k + 1) % 3];
+                ++directed[std::make_pair(a, b)];
+                ++undirected[std::make_pair(std::min(a, b), std::max(a, b))];
+            }
+        }
+        for (std::map<std::pair<uint32_t, uint32_t>, int>::const_iterator e = directed.begin(); e != directed.end(); ++e)
+            result.repeatedDirected += e->second > 1;
+        for (std::map<std::pair<uint32_t, uint32_t>, int>::const_iterator e = undirected.begin(); e != undirected.end(); ++e)
+        {
+            result.nonManifold += e->second > 2;
+            result.border += e->second == 1;
+        }
+        return result;
+    }
+
+    // closed, with a texcoord seam where u wraps: the seam column is split
+    // into two vertices per position
+    OBJLoader::MeshData sphere(int rings, int segments)
+    {
+        OBJLoader::MeshData mesh;
+        const float PI = 3.14159265f;
+        addVertex(mesh, 0.0f, 1.0f, 0.0f, 0.5f, 1.0f);
+        for (int r = 1; r < rings; ++r)
+            for (int s = 0; s <= segments; ++s)
+            {
+                float theta = PI * r / rings, phi = 2.0f * PI * (s % segments) / segments;
+                addVertex(mesh, std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi),
+                          static_cast<float>(s) / segments, 1.0f - static_cast<float>(r) / rings);
+            }
+        addVertex(mesh, 0.0f, -1.0f, 0.0f, 0.5f, 0.0f);
+        uint32_t bottom = static_cast<uint32_t>(mesh.vertices.size() / OBJLoader::FLOATS_PER_VERTEX - 1);
+        int row = segments + 1;
+        for (int s = 0; s < segments; ++s)
+        {
+            uint32_t triangle[3] = { 0, static_cast<uint32_t>(1 + s + 1), static_cast<uint32_t>(1 + s) };
+            mesh.indices.insert(mesh.indices.end(), triangle, triangle + 3);
+        }
+        for (int r = 0; r + 2 < rings; ++r)
+            for (int s = 0; s < segments; ++s)
+            {
+                uint32_t a = 1 + r * row + s, b = a + 1, c = a + row, d = c + 1;
+                uint32_t quad[6] = { a, b, d, a, d, c };
+                mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+            }
+        uint32_t last = 1 + (rings - 2) * row;
+        for (int s = 0; s < segments; ++s)
+        {
+            uint32_t triangle[3] = { bottom, last + s, last + s + 1 };
+            mesh.indices.insert(mesh.indices.end(), triangle, triangle + 3);
+        }
+        setBounds(mesh);
+        return mesh;
+    }
+
+    // open: a bumpy grid whose outline is a border
+    OBJLoader::MeshData grid(int cells)
+    {
+        OBJLoader::MeshData mesh;
+        for (int y = 0; y <= cells; ++y)
+            for (int x = 0; x <= cells; ++x)
+            {
+                float u = static_cast<float>(x) / cells, v = static_cast<float>(y) / cells;
+                addVertex(mesh, u, 0.05f * std::sin(u * 9.0f) * std::cos(v * 7.0f), v, u, v);
+            }
+        for (int y = 0; y < cells; ++y)
+            for (int x = 0; x < cells; ++x)
+            {
+                uint32_t a = y * (cells + 1) + x, b = a + 1, c = a + cells + 1, d = c + 1;
+                uint32_t quad[6] = { a, c, d, a, d, b };
+                mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+            }
+        setBounds(mesh);
+        return mesh;
+    }
+}
+
+void checkMeshSimplifier()
+{
+    OBJLoader::MeshData meshes[3] = { sphere(24, 32), grid(24), OBJLoader::loadOBJ("res/obj/teapot.obj") };
+    std::vector<const OBJLoader::MeshData *> all;
+    for (int m = 0; m < 3; ++m)
+    {
+        const OBJLoader::MeshData &mesh = meshes[m];
+        all.push_back(&mesh);
+        Topology full = topology(mesh, mesh.indices);
+        std::vector<MeshLod> chain = MeshSimplifier::buildChain(mesh);
+        CHECK(chain.size() == MeshSimplifier::LOD_LEVELS);
+        float previousError = 0.0f;
+        for (size_t l = 0; l < chain.size(); ++l)
+        {
+            const MeshLod &lod = chain[l];
+            size_t target = (mesh.indices.size() / 3 >> (l + 1)) * 3;
+            CHECK(!lod.indices.empty() && lod.indices.size() % 3 == 0);
+            CHECK(lod.indices.size() <= target);
+            CHECK(lod.error >= previousError);
+            previousError = lod.error;
+            Topology level = topology(mesh, lod.indices);
+            CHECK(level.outOfRange == 0);
+            CHECK(level.degenerate == 0);
+            // no edge gains a third triangle, none is walked twice the same way
+            CHECK(level.nonManifold <= full.nonManifold);
+            CHECK(level.repeatedDirected <= full.repeatedDirected);
+            // closed stays closed
+            if (full.border == 0)
+                CHECK(level.border == 0);
+        }
+        // border positions only slide along the border: the outline keeps its extent
+        if (m == 1)
+        {
+            const MeshLod &coarsest = chain.back();
+            float low[3] = { HUGE_VALF, HUGE_VALF, HUGE_VALF }, high[3] = { -HUGE_VALF, -HUGE_VALF, -HUGE_VALF };
+            for (size_t i = 0; i < coarsest.indices.size(); ++i)
+                for (int a = 0; a < 3; a += 2)
+                {
+                    float p = mesh.vertices[coarsest.indices[i] * OBJLoader::FLOATS_PER_VERTEX + a];
+                    low[a] = std::min(low[a], p);
+                    high[a] = std::max(high[a], p);
+                }
+            CHECK(low[0] == 0.0f && high[0] == 1.0f && low[2] == 0.0f && high[2] == 1.0f);
+        }
+    }
+
+    // a level simplified as far as it goes is still a valid closed surface
+    std::vector<size_t> nothing(1, 0);
+    std::vector<MeshLod> smallest = MeshSimplifier::simplify(meshes[0], nothing);
+    CHECK(smallest.size() == 1);
+    if (smallest.size() == 1)
+    {
+        Topology level = topology(meshes[0], smallest[0].indices);
+        CHECK(!smallest[0].indices.empty() && smallest[0].indices.size() < 100);
+        CHECK(level.outOfRange == 0 && level.degenerate == 0 && level.nonManifold == 0 && level.border == 0);
+    }
+
+    // the JobSystem spread gives the same chains
+    std::vector<std::vector<MeshLod> > chains = MeshSimplifier::buildChains(all);
+    CHECK(chains.size() == 3);
+    for (size_t m = 0; m < chains.size(); ++m)
+    {
+        std::vector<MeshLod> chain = MeshSimplifier::buildChain(*all[m]);
+        bool same = chain.size() == chains[m].size();
+        for (size_t l = 0; same && l < chain.size(); ++l)
+            same = chain[l].indices == chains[m][l].indices && chain[l].error == chains[m][l].error;
+        CHECK(same);
+    }
+}
@@ -0,0 +1,111 @@
+#include "check.h"
+#include "Render/RenderQueue.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    void checkFields(std::mt19937 &random)
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            unsigned layer = random() % (1u << RenderQueue::LAYER_BITS);
+            bool translucent = random() & 1;
+            unsigned program = random() % (1u << RenderQueue::PROGRAM_BITS);
+            unsigned material = random() % (1u << RenderQueue::MATERIAL_BITS);
+            unsigned mesh = random() % (1u << RenderQueue::MESH_BITS);
+            float depth = static_cast<float>(random() % 10000) / 10000.0f;
+            uint64_t key = RenderQueue::key(layer, translucent, program, material, mesh, depth);
+            CHECK(RenderQueue::layer(key) == layer);
+            CHECK(RenderQueue::translucent(key) == translucent);
+            CHECK(RenderQueue::program(key) == program);
+            CHECK(RenderQueue::material(key) == material);
+            CHECK(RenderQueue::mesh(key) == mesh);
+        }
+        // fields are cut to their bits
+        uint64_t cut = RenderQueue::key(1u << RenderQueue::LAYER_BITS, false, 1u << RenderQueue::PROGRAM_BITS,
+                                        (1u << RenderQueue::MATERIAL_BITS) + 3, 1u << RenderQueue::MESH_BITS, 0.5f);
+        CHECK(RenderQueue::layer(cut) == 0);
+        CHECK(RenderQueue::program(cut) == 0);
+        CHECK(RenderQueue::material(cut) == 3);
+        CHECK(RenderQueue::mesh(cut) == 0);
+    }
+
+    void checkOrder()
+    {
+        // opaques front to back within a state, grouped by program first
+        CHECK(RenderQueue::key(0, false, 1, 2, 3, 0.1f) < RenderQueue::key(0, false, 1, 2, 3, 0.5f));
+        CHECK(RenderQueue::key(0, false, 1, 9, 9, 0.9f) < RenderQueue::key(0, false, 2, 0, 0, 0.0f));
+        CHECK(RenderQueue::key(0, false, 1, 2, 9, 0.9f) < RenderQueue::key(0, false, 1, 3, 0, 0.0f));
+        // translucents back to front whatever their state
+        CHECK(RenderQueue::key(0, true, 9, 9, 9, 0.9f) < RenderQueue::key(0, true, 0, 0, 0, 0.1f));
+        // opaques before translucents, layer before everything
+        CHECK(RenderQueue::key(0, false, 255, 1023, 4095, 1.0f) < RenderQueue::key(0, true, 0, 0, 0, 1.0f));
+        CHECK(RenderQueue::key(0, true, 255, 1023, 4095, 0.0f) < RenderQueue::key(1, false, 0, 0, 0, 0.0f));
+        // depth clamps to [0, 1], NaN counts as 0
+        CHECK(RenderQueue::key(0, false, 1, 1, 1, -1.0f) == RenderQueue::key(0, false, 1, 1, 1, 0.0f));
+        CHECK(RenderQueue::key(0, false, 1, 1, 1, std::nanf("")) == RenderQueue::key(0, false, 1, 1, 1, 0.0f));
+        CHECK(RenderQueue::key(0, false, 1, 1, 1, 2.0f) == RenderQueue::key(0, false, 1, 1, 1, 1.0f));
+    }
+
+    // the radix sort against std::stable_sort, equal keys keeping push order
+    void checkSort(std::mt19937 &random, size_t count, unsigned materials)
+    {
+        RenderQueue queue;
+        std::vector<std::pair<uint64_t, uint32_t> > expected;
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint64_t key = RenderQueue::key(random() % 2, random() % 4 == 0, random() % 3, random() % materials,
+                                            random() % 5, static_cast<float>(random() % 64) / 64.0f);
+            queue.push(key, static_cast<uint32_t>(i));
+            expected.push_back(std::make_pair(key, static_cast<uint32_t>(i)));
+        }
+        queue.sort();
+        std::stable_sort(expected.begin(), expected.end(),
+                         [](const std::pair<uint64_t, uint32_t> &a, const std::pair<uint64_t, uint32_t> &b) {
+                             return a.first < b.first;
+                         });
+        CHECK(queue.size() == count);
+        bool same = true;
+        for (size_t i = 0; i < count && same; ++i)
+            same = queue.keyAt(i) == expected[i].first && queue.itemAt(i) == expected[i].second;
+        CHECK(same);
+    }
+
+    void checkPasses()
+    {
+        RenderQueue queue;
+        queue.sort();
+        CHECK(queue.size() == 0 && queue.passes() == 0);
+
+        // keys sharing every byte but the lowest sort in one pass
+        for (uint32_t i = 0; i < 200; ++i)
+            queue.push(RenderQueue::key(0, false, 1, 1, 1, 0.0f) + (199 - i), i);
+        queue.sort();
+        CHECK(queue.passes() == 1);
+        CHECK(queue.itemAt(0) == 199 && queue.itemAt(199) == 0);
+
+        // equal keys need none and keep their order
+        queue.clear();
+        for (uint32_t i = 0; i < 50; ++i)
+            queue.push(7, i);
+        queue.sort();
+        CHECK(queue.passes() == 0);
+        CHECK(queue.itemAt(0) == 0 && queue.itemAt(49) == 49);
+    }
+}
+
+void checkRenderQueue()
+{
+    std::mt19937 random(50);
+    checkFields(random);
+    checkOrder();
+    checkSort(random, 1, 2);
+    checkSort(random, 1000, 2);
+    checkSort(random, 20000, 1024);
+    checkPasses();
+}
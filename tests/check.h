@@ -0,0 +1,27 @@
+#ifndef CHECK_H
+# define CHECK_H
+
+# include <cstdio>
+
+// Self-checks of the CPU side, built without GL by `make check`. Each
+// suite is a function that CHECKs as it goes; main() runs them all and
+// fails when any CHECK did.
+
+// CHECKs failed so far
+extern int checkFailures;
+
+# define CHECK(condition) \
+    do { \
+        if (!(condition)) \
+        { \
+            ++checkFailures; \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+        } \
+    } while (0)
+
+void checkRenderQueue();
+void checkBVH();
+void checkMeshSimplifier();
+void checkFrustumCuller();
+
+#endif
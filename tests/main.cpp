@@ -0,0 +1,24 @@
+#include "check.h"
+
+int checkFailures = 0;
+
+int main()
+{
+    struct Suite {
+        const char *name;
+        void (*run)();
+    };
+    const Suite suites[] = {
+        { "RenderQueue", checkRenderQueue },
+        { "BVH", checkBVH },
+        { "MeshSimplifier", checkMeshSimplifier },
+        { "FrustumCuller", checkFrustumCuller },
+    };
+    for (size_t i = 0; i < sizeof(suites) / sizeof(suites[0]); ++i)
+    {
+        int before = checkFailures;
+        suites[i].run();
+        std::printf("%-16s %s\n", suites[i].name, checkFailures == before ? "ok" : "FAILED");
+    }
+    return checkFailures == 0 ? 0 : 1;
+}